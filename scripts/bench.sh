@@ -0,0 +1,82 @@
+#!/bin/sh
+#
+# End-to-end benchmark of TIFAA on a synthetic survey made with
+# mksurvey. The full pipeline is run with several numbers of threads
+# (`-t`), once with a cold page cache (only possible as root) and once
+# with a warm one, and the results are printed as a table that can be
+# diffed between commits:
+#
+#     $ make bench > bench-before.txt
+#     ... change the code ...
+#     $ make bench > bench-after.txt
+#     $ diff bench-before.txt bench-after.txt
+#
+# Environment variables (with their default values):
+#   BENCH_DIR=./bench-data/    Directory keeping the survey and outputs.
+#   BENCH_THREADS="1 2 4 N"    Values of `-t` (N: number of CPUs).
+#   BENCH_RES=0.2              Resolution (arcseconds/pixel).
+#   BENCH_PSSIZE=20            Size of the thumbnails (arcseconds).
+#   MKSURVEY_OPTS=""           Other options to mksurvey (see `-h`).
+#
+# Copyright (C) 2013-2014 Mohammad Akhlaghi
+# This file is part of tifaa, distributed under the GNU GPL v3+.
+
+set -e
+
+dir=${BENCH_DIR:-./bench-data/}
+res=${BENCH_RES:-0.2}
+pssize=${BENCH_PSSIZE:-20}
+threads=${BENCH_THREADS:-"1 2 4 $(nproc)"}
+survey="$dir"survey/
+out="$dir"out/
+
+# Only make the survey if it doesn't exist with these options.
+opts="-o $survey -a $res $MKSURVEY_OPTS"
+mkdir -p "$dir"
+if [ ! -f "$dir"options ] || [ "$(cat "$dir"options)" != "$opts" ]; then
+    rm -rf "$survey"
+    ./mksurvey $opts >&2
+    echo "$opts" > "$dir"options
+fi
+nobj=$(grep -v '^#' "$survey"cat.txt | wc -l)
+
+# Dropping the page cache is only possible for root.
+if [ -w /proc/sys/vm/drop_caches ]; then caches="cold warm"
+else
+    caches="warm"
+    echo "bench.sh: not root, runs with a cold cache are skipped." >&2
+fi
+
+echo "# TIFAA benchmark: $(git describe --always --dirty 2>/dev/null)"
+echo "# mksurvey $opts"
+echo "# $nobj objects, $pssize arcsecond thumbnails."
+echo "# Col 0: Number of threads."
+echo "# Col 1: Page cache."
+echo "# Col 2: Reading the WCS of all images (seconds)."
+echo "# Col 3: Finding the images of each target (seconds)."
+echo "# Col 4: Cropping and stitching (seconds)."
+echo "# Col 5: Total (seconds)."
+echo "# Col 6: Targets per second in cropping."
+echo "# Col 7: MB/s read from the survey in cropping."
+for t in $threads; do
+    for c in $caches; do
+        if [ $c = cold ]; then
+            sync; echo 3 > /proc/sys/vm/drop_caches
+        else
+            # Read everything once so the cache is warm.
+            cat "$survey"* > /dev/null
+        fi
+        ./tifaa -e -g -c "$survey"cat.txt -r1 -d2 -a$res -p$pssize \
+                -s "$survey"'tile*_sci.fits*' -t$t -o "$out" \
+                > "$dir"run.txt
+        bytes=$(awk '!/^#/{s+=$9} END{print s+0}' "$out"tifaatable.txt)
+        awk -v t=$t -v c=$c -v n=$nobj -v b=$bytes '
+            /WCS info of/           {w=$(NF-1)}
+            /Target\/image/         {m=$(NF-1)}
+            /stitched or cropped\./ {s=$(NF-1)}
+            /finished in/           {f=$(NF-1)}
+            END {printf "%-4d %-5s %-10.4f %-10.4f %-10.4f %-10.4f "\
+                        "%-10.1f %-10.2f\n", t, c, w, m, s, f,
+                        s>0 ? n/s : 0, s>0 ? b/s/1e6 : 0}' "$dir"run.txt
+    done
+done
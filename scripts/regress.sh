@@ -0,0 +1,159 @@
+#!/bin/sh
+#
+# Regression test of TIFAA's outputs. Synthetic surveys are made with
+# mksurvey (with a fixed seed) and TIFAA is run on them with a few
+# reference configurations. Every thumbnail is then compared with
+# `tifaacmp` (pixels bit by bit and all the header cards except the
+# time of creation) and `tifaalog.txt` is compared byte by byte with
+# the golden outputs. Any difference makes this script fail.
+#
+# Before a change (or on a commit known to be correct), make the
+# golden outputs, then after the change compare with them:
+#
+#     $ make golden
+#     ... change the code ...
+#     $ make regress
+#
+# The golden outputs depend on the versions of CFITSIO and WCSLIB, so
+# they are made locally and not kept in the repository.
+#
+# Environment variables (with their default values):
+#   REGRESS_DIR=./regress-data/  Directory keeping surveys and outputs.
+#
+# Copyright (C) 2013-2014 Mohammad Akhlaghi
+# This file is part of tifaa, distributed under the GNU GPL v3+.
+
+set -e
+
+dir=${REGRESS_DIR:-./regress-data/}
+golden="$dir"golden/
+if [ "$1" = golden ]; then mode=golden; else mode=compare; fi
+
+# The surveys: one with floating point tiles and weights, one with
+# Rice compressed 16-bit tiles, one with Rice compressed (quantized
+# and dithered) floating point tiles, one with 16-bit tiles and
+# weights that have blank and zero edges and one where the CRPIX of
+# many thumbnails is written with an exponent. Their options must not
+# change, or the golden outputs have to be remade.
+mkdir -p "$dir"out "$golden"
+mk() {
+    name=$1; shift
+    [ -f "$dir$name"/cat.txt ] || ./mksurvey -o "$dir$name"/ -r 1729 -a 0.2 "$@" >&2
+}
+mk float -n 9 -x 500 -l 40 -b -32 -w -c 300 -k 4
+mk rice  -n 9 -x 500 -l 40 -b 16 -z rice -c 300 -k 4
+mk ricef -n 9 -x 500 -l 40 -b -32 -z rice -c 300 -k 4
+mk int   -n 9 -x 500 -l 40 -b 16 -w -W 16 -B -c 300 -k 4
+mk wcse  -n 4 -x 500 -l 40 -b -32 -E -c 300 -k 4
+
+# A manifest (`-M`) of the first survey (with the new `HDU,WHDU`
+# syntax) and a plan (`-X`) for it, made by `-x`.
+stream="$dir"stream.fits
+for f in "$dir"float/tile*_sci.fits; do
+    echo "$f ${f%_sci.fits}_wht.fits 0,0"
+done > "$dir"manifest.txt
+./tifaa -g -c "$dir"float/cat.txt -r1 -d2 -a0.2 -p20 -x -X "$dir"plan.txt \
+        -s "$dir"float/'tile*_sci.fits*' -o "$dir"out/plan-x/ > /dev/null
+
+# Each configuration: its name, the survey, the golden outputs it is
+# compared with, the options and the environment variables of TIFAA.
+# Configurations with the same golden outputs must give identical
+# results. With TIFAA_NOFZ, CFITSIO decompresses the tiles, so TIFAA's
+# own Rice decoder (and dithering) has to give the same pixels. The
+# integer survey is read in its own type only without the cache
+# (`-m 0`), so the kernels of src/pixels.c have to give the same
+# pixels as CFITSIO. With TIFAA_NOHDRTEMPLATE, every header is written
+# by wcshdo(), so the header templates must give the same cards. With
+# TIFAA_NOFUSEDSUM, DATASUM and CHECKSUM (`-C`) are found by
+# fits_write_chksum(), tifaacmp compares DATASUM and checks CHECKSUM.
+# The thumbnails that are streamed (`-O`) are split into files with
+# `tifaacmp -s` and compared like the others.
+configs="plain:float:plain:-t1:
+threads:float:plain:-t4:
+plain-notemplate:float:plain:-t2:TIFAA_NOHDRTEMPLATE=1
+stream:float:plain:-t2 -O $stream:
+plan:float:plain:-t2 -X ${dir}plan.txt:
+shards:float:shards:-t2 -l:
+sizes:float:sizes:-t2 -P 3:
+checksum:float:checksum:-t2 -C:TIFAA_NOFUSEDSUM=1
+checksum-fused:float:checksum:-t2 -C:
+short:float:short:-t2 -T short -C:TIFAA_NOFUSEDSUM=1
+short-fused:float:short:-t2 -T short -C:
+bands:float:bands:-t2 -s $dir"'rice/tile*_sci.fits*'":
+weight:float:weight:-t2 -w $dir"'float/tile*_wht.fits'":
+manifest:float:weight:-t2 -M ${dir}manifest.txt:
+rice:rice:rice:-t2:
+rice-cfitsio:rice:rice:-t2:TIFAA_NOFZ=1
+ricef:ricef:ricef:-t2:
+ricef-cfitsio:ricef:ricef:-t2 -m 0:TIFAA_NOFZ=1
+int:int:int:-t2 -m 0 -w $dir"'int/tile*_wht.fits'":
+int-cache:int:int:-t2 -w $dir"'int/tile*_wht.fits'":
+int-input:int:int-input:-t2 -m 0 -T input -C -w $dir"'int/tile*_wht.fits'":
+wcse:wcse:wcse:-t2:
+wcse-notemplate:wcse:wcse:-t2:TIFAA_NOHDRTEMPLATE=1"
+
+# The library (see src/tifaalibtest.c) on targets on and just outside
+# the images of the first survey.
+rm -f "$dir"failed
+if [ $mode = compare ]; then
+    if ./tifaalibtest "$dir"float/tile*_sci.fits; then echo "library: OK"
+    else echo "library: FAILED"; echo library >> "$dir"failed
+    fi
+fi
+
+# The wildcards in the options are for tifaa, not the shell.
+set -f
+echo "$configs" | while IFS=: read name survey ref opts envs; do
+    if [ $mode = golden ]; then
+        [ $name = $ref ] || continue
+        out="$golden$ref"/
+    else
+        out="$dir"out/$name/
+    fi
+    # With a manifest, it is the first band (instead of `-s`).
+    case " $opts " in
+        *" -M "*) surv= ;;
+        *)        surv="-s $dir$survey/tile*_sci.fits*" ;;
+    esac
+    env $envs ./tifaa -g -c "$dir$survey"/cat.txt -r1 -d2 -a0.2 -p20 \
+            $surv $opts -o "$out" > /dev/null
+    [ $mode = golden ] && { echo "regress.sh: made $out"; continue; }
+
+    # A stream has the thumbnails that would have been written, but
+    # the log doesn't have their names.
+    logcols='{print}'
+    case " $opts " in
+        *" -O "*) ./tifaacmp -s "$stream" "$out"
+                  rm "$stream"
+                  logcols='!/^#/{print $1, $2, $3}' ;;
+    esac
+
+    # Same thumbnails (also in subdirectories), identical thumbnails
+    # and an identical log.
+    fail=0
+    (cd "$golden$ref" && find . -name '*.fits' | sort) > "$dir"golden.list
+    (cd "$out" && find . -name '*.fits' | sort) > "$dir"out.list
+    if ! cmp -s "$dir"golden.list "$dir"out.list; then
+        echo "$name: the thumbnails made differ:"
+        diff "$dir"golden.list "$dir"out.list || true
+        fail=1
+    fi
+    for f in $(cat "$dir"golden.list); do
+        [ -f "$out$f" ] || continue
+        ./tifaacmp "$golden$ref/$f" "$out$f" || fail=1
+    done
+    awk "$logcols" "$golden$ref"/tifaalog.txt > "$dir"golden.log
+    awk "$logcols" "$out"tifaalog.txt > "$dir"out.log
+    if ! cmp -s "$dir"golden.log "$dir"out.log; then
+        echo "$name: tifaalog.txt differs."
+        fail=1
+    fi
+    if [ $fail = 0 ]; then echo "$name: OK"
+    else echo "$name: FAILED"; echo $name >> "$dir"failed
+    fi
+done
+
+if [ $mode = compare ] && [ -f "$dir"failed ]; then
+    rm "$dir"failed
+    exit 1
+fi
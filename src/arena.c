@@ -0,0 +1,103 @@
+/*********************************************************************
+tifaa - Thumbnail images from astronomical archives
+A simple set of functions to crop thumbnails from astronomical archives.
+
+Copyright (C) 2013-2014 Mohammad Akhlaghi
+Tohoku University Astronomical Institute, Sendai, Japan.
+http://astr.tohoku.ac.jp/~akhlaghi/
+
+tifaa is free software: you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation, either version 3 of the License, or
+(at your option) any later version.
+
+tifaa is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with tifaa.  If not, see <http://www.gnu.org/licenses/>.
+**********************************************************************/
+#include <stdio.h>
+#include <assert.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/mman.h>
+
+#include "arena.h"
+#include "pixels.h"
+
+
+
+
+
+/* Allocate `bytes` bytes, all zero. Large buffers are aligned to the
+   size of a huge page and (where the kernel allows it) backed by huge
+   pages, so the TLB isn't a bottleneck when going over the pixels.
+   Writing the zeros also brings all the pages into memory here, not
+   while cropping. */
+void *
+arenaalloc(size_t bytes)
+{
+  void *out=NULL;
+
+  if(bytes>=ARENA_HUGEPAGE)
+    {
+      assert(posix_memalign(&out, ARENA_HUGEPAGE, bytes)==0);
+#ifdef MADV_HUGEPAGE
+      madvise(out, bytes, MADV_HUGEPAGE);
+#endif
+    }
+  else
+    assert( (out=malloc(bytes))!=NULL );
+  memset(out, 0, bytes);
+  return out;
+}
+
+
+
+
+
+/* Make the arena for thumbnails of at most `crop_side` pixels on a
+   side in `nbands` bands, from at most `maximg` survey images. With
+   `quantize`, there is also space for one 16-bit thumbnail. */
+void
+arenainit(struct croparena *a, size_t crop_side, size_t nbands,
+	  int weight, int quantize, size_t maximg)
+{
+  memset(a, 0, sizeof *a);
+  a->npix=crop_side*crop_side;
+  a->nbands=nbands;
+  a->cropped=arenaalloc(nbands*a->npix*sizeof *a->cropped);
+  a->tmp=arenaalloc(a->npix*PIX_MAXBYTES);
+  if(weight)
+    a->wtmp=arenaalloc(a->npix*PIX_MAXBYTES);
+  if(quantize)
+    a->qbuf=arenaalloc(a->npix*sizeof *a->qbuf);
+
+  /* For the result table (at least one, so they are never NULL). */
+  a->maximg = maximg ? maximg : 1;
+  a->imgs=arenaalloc(a->maximg*sizeof *a->imgs);
+  a->ranges=arenaalloc(4*a->maximg*sizeof *a->ranges);
+  a->bread=arenaalloc(a->maximg*sizeof *a->bread);
+}
+
+
+
+
+
+void
+arenafree(struct croparena *a)
+{
+  free(a->cropped);
+  free(a->qbuf);
+  free(a->tmp);
+  free(a->wtmp);
+  free(a->header);
+  free(a->imgs);
+  free(a->ranges);
+  free(a->bread);
+  fzfreescratch(&a->fz);
+  memset(a, 0, sizeof *a);
+}
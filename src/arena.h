@@ -0,0 +1,57 @@
+/*********************************************************************
+tifaa - Thumbnail images from astronomical archives
+A simple set of functions to crop thumbnails from astronomical archives.
+
+Copyright (C) 2013-2014 Mohammad Akhlaghi
+Tohoku University Astronomical Institute, Sendai, Japan.
+http://astr.tohoku.ac.jp/~akhlaghi/
+
+tifaa is free software: you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation, either version 3 of the License, or
+(at your option) any later version.
+
+tifaa is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with tifaa.  If not, see <http://www.gnu.org/licenses/>.
+**********************************************************************/
+#ifndef ARENA_H
+#define ARENA_H
+
+#include "fitsfz.h"
+
+#define ARENA_HUGEPAGE    2097152 /* Alignment of large buffers.     */
+
+/* The buffers that each thread of stitchcroponthread() uses for all
+   its targets. They are made once for the largest thumbnail (no
+   section of a survey image that is read is larger than it), so
+   nothing has to be allocated for each target or survey image. */
+struct croparena
+{
+  size_t          npix;  /* Pixels in each of the buffers.             */
+  size_t        nbands;  /* Number of bands.                           */
+  float       *cropped;  /* The thumbnail of each band (`npix` each).  */
+  short          *qbuf;  /* A thumbnail quantized to 16 bits.          */
+  void            *tmp;  /* Pixels of a survey image (any type).       */
+  void           *wtmp;  /* Pixels of a weight image (any type).       */
+  char         *header;  /* Header of a survey image (for WCSLIB).     */
+  size_t         hsize;  /* Allocated bytes in `header`.               */
+  struct fzscratch  fz;  /* For decompressing tiles (see fitsfz.h).    */
+  size_t        maximg;  /* Most survey images of one target.          */
+  size_t         *imgs;  /* Images that were used for a target.        */
+  long         *ranges;  /* Pixel range of each image (4 each).        */
+  size_t        *bread;  /* Bytes read from each image.                */
+};
+
+void
+arenainit(struct croparena *a, size_t crop_side, size_t nbands,
+	  int weight, int quantize, size_t maximg);
+
+void
+arenafree(struct croparena *a);
+
+#endif
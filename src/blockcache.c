@@ -0,0 +1,355 @@
+/*********************************************************************
+tifaa - Thumbnail images from astronomical archives
+A simple set of functions to crop thumbnails from astronomical archives.
+
+Copyright (C) 2013-2014 Mohammad Akhlaghi
+Tohoku University Astronomical Institute, Sendai, Japan.
+http://astr.tohoku.ac.jp/~akhlaghi/
+
+tifaa is free software: you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation, either version 3 of the License, or
+(at your option) any later version.
+
+tifaa is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with tifaa.  If not, see <http://www.gnu.org/licenses/>.
+**********************************************************************/
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <pthread.h>
+
+#include "blockcache.h"
+
+
+
+
+
+
+
+
+
+
+
+
+
+
+
+
+
+
+
+
+/******************************************************************/
+/****************       Lists of blocks        ********************/
+/******************************************************************/
+size_t
+bchash(struct blockcache *bc, size_t img, int layer, long bx, long by)
+{
+  size_t h=img;
+  h=h*1000003 ^ (size_t)layer;
+  h=h*1000003 ^ (size_t)by;
+  h=h*1000003 ^ (size_t)bx;
+  return (h ^ h>>17) & (bc->nbuckets-1);
+}
+
+
+
+
+
+/* Remove `b` from the LRU list. */
+void
+bclruremove(struct blockcache *bc, struct bcblock *b)
+{
+  if(b->prev) b->prev->next=b->next; else bc->head=b->next;
+  if(b->next) b->next->prev=b->prev; else bc->tail=b->prev;
+  b->prev=b->next=NULL;
+}
+
+
+
+
+
+/* Put `b` at the start (most recently used) of the LRU list. */
+void
+bclrufront(struct blockcache *bc, struct bcblock *b)
+{
+  b->prev=NULL;
+  b->next=bc->head;
+  if(bc->head) bc->head->prev=b; else bc->tail=b;
+  bc->head=b;
+}
+
+
+
+
+
+void
+bchashremove(struct blockcache *bc, struct bcblock *b)
+{
+  struct bcblock **pp;
+
+  pp=&bc->hash[bchash(bc, b->img, b->layer, b->bx, b->by)];
+  while(*pp!=b) pp=&(*pp)->hnext;
+  *pp=b->hnext;
+  b->hnext=NULL;
+}
+
+
+
+
+
+
+
+
+
+
+
+
+
+
+
+
+
+
+
+
+/******************************************************************/
+/****************        Using the cache       ********************/
+/******************************************************************/
+/* Make a cache that keeps as many blocks as fit in `bytes`. If not
+   even one block fits, `*bc=NULL` (no cache). The output is 1 if
+   there wasn't enough memory. */
+int
+bcinit(struct blockcache **bc, size_t bytes)
+{
+  struct blockcache *c;
+  size_t maxblocks=bytes/(BC_SIDE*BC_SIDE*sizeof(float));
+
+  *bc=NULL;
+  if(maxblocks==0) return 0;
+  if( (c=calloc(1, sizeof *c))==NULL ) return 1;
+  c->maxblocks=maxblocks;
+  for(c->nbuckets=64;c->nbuckets<2*maxblocks;c->nbuckets*=2);
+  if( (c->hash=calloc(c->nbuckets, sizeof *c->hash))==NULL )
+    {
+      free(c);
+      return 1;
+    }
+  pthread_mutex_init(&c->m, NULL);
+  pthread_cond_init(&c->c, NULL);
+  *bc=c;
+  return 0;
+}
+
+
+
+
+
+/* Return block (bx, by) of image `img` (`layer` for its weight),
+   reading it from `fptr` if it isn't in the cache. The block can't
+   be evicted until bcrelease() is called. If all the blocks are in
+   use (or there isn't memory for a new one), a block that isn't
+   kept in the cache is read. NULL is only returned if there is no
+   memory at all. A block that couldn't be read is taken out of the
+   cache once it is ready (the threads already waiting for it see its
+   status), so the next bcget() tries to read it again. */
+struct bcblock *
+bcget(struct blockcache *bc, size_t img, int layer, long bx, long by,
+      fitsfile *fptr, struct fzindex *fz, long *naxes, float nulval)
+{
+  size_t h;
+  int anynul=0;
+  struct bcblock *b;
+  long fp[2], lp[2], inc[2]={1,1};
+
+  h=bchash(bc, img, layer, bx, by);
+  pthread_mutex_lock(&bc->m);
+  for(b=bc->hash[h];b;b=b->hnext)
+    if(b->bx==bx && b->by==by && b->img==img && b->layer==layer)
+      break;
+
+  /* In the cache (possibly still being read by another thread). */
+  if(b)
+    {
+      ++b->refs;
+      ++bc->hits;
+      bclruremove(bc, b);
+      bclrufront(bc, b);
+      while(b->ready==0)
+	pthread_cond_wait(&bc->c, &bc->m);
+      pthread_mutex_unlock(&bc->m);
+      return b;
+    }
+
+  /* A new block if the budget allows, otherwise the least recently
+     used one that no thread is using. */
+  if(bc->nblocks<bc->maxblocks
+     && (b=calloc(1, sizeof *b))!=NULL
+     && (b->data=malloc(BC_SIDE*BC_SIDE*sizeof *b->data))!=NULL)
+    {
+      b->cached=1;
+      ++bc->nblocks;
+    }
+  else
+    {
+      if(b) { free(b); b=NULL; }
+      for(b=bc->tail;b && (b->refs || b->ready==0);b=b->prev);
+      if(b)
+	{
+	  bclruremove(bc, b);
+	  bchashremove(bc, b);
+	}
+    }
+  if(b)
+    {
+      b->img=img; b->layer=layer; b->bx=bx; b->by=by;
+      b->ready=0; b->status=0; b->refs=1;
+      b->hnext=bc->hash[h];
+      bc->hash[h]=b;
+      bclrufront(bc, b);
+    }
+  ++bc->misses;
+  pthread_mutex_unlock(&bc->m);
+
+  /* Not possible to keep it: a private block. */
+  if(b==NULL)
+    {
+      if( (b=calloc(1, sizeof *b))==NULL
+	  || (b->data=malloc(BC_SIDE*BC_SIDE*sizeof *b->data))==NULL )
+	{
+	  free(b);
+	  return NULL;
+	}
+      b->img=img; b->layer=layer; b->bx=bx; b->by=by; b->refs=1;
+    }
+
+  /* Read the pixels (without the lock, other threads waiting for
+     this block wait on the condition variable). */
+  fp[0]=bx*BC_SIDE+1;  lp[0]=fp[0]+BC_SIDE-1;
+  fp[1]=by*BC_SIDE+1;  lp[1]=fp[1]+BC_SIDE-1;
+  if(lp[0]>naxes[0]) lp[0]=naxes[0];
+  if(lp[1]>naxes[1]) lp[1]=naxes[1];
+  b->width[0]=lp[0]-fp[0]+1;
+  b->width[1]=lp[1]-fp[1]+1;
+  if(fz==NULL || !fzreadsubset(fptr, fz, fp, lp, nulval, b->data, NULL,
+			       &b->status))
+    fits_read_subset_flt(fptr, 0, 2, naxes, fp, lp, inc, nulval, b->data,
+			 &anynul, &b->status);
+
+  if(b->cached)
+    {
+      pthread_mutex_lock(&bc->m);
+      b->ready=1;
+      if(b->status)
+	{
+	  bchashremove(bc, b);
+	  bclruremove(bc, b);
+	}
+      pthread_cond_broadcast(&bc->c);
+      pthread_mutex_unlock(&bc->m);
+    }
+  return b;
+}
+
+
+
+
+
+/* Let block `b` (from bcget()) be evicted again. A block that
+   couldn't be read isn't in the cache any more, so the last thread
+   using it frees it. */
+void
+bcrelease(struct blockcache *bc, struct bcblock *b)
+{
+  if(b->cached==0)
+    {
+      free(b->data);
+      free(b);
+      return;
+    }
+  pthread_mutex_lock(&bc->m);
+  if(--b->refs==0 && b->status)
+    {
+      free(b->data);
+      free(b);
+      --bc->nblocks;
+    }
+  pthread_mutex_unlock(&bc->m);
+}
+
+
+
+
+
+/* Read the pixels from `fpixel` to `lpixel` (counting from 1) of
+   layer `layer` of image `img` into `out`, which has
+   `stride` pixels in each row, from the blocks in the cache. The
+   blocks that aren't in the cache are read from `fptr` (with
+   fzreadsubset() when the image is indexed). All the reads from one
+   cache have to use the same `nulval`. */
+void
+bcread(struct blockcache *bc, size_t img, int layer, fitsfile *fptr,
+       struct fzindex *fz, long *naxes, long *fpixel, long *lpixel,
+       float nulval, float *out, size_t stride, int *status)
+{
+  struct bcblock *b;
+  long bx, by, x0, x1, y0, y1, y;
+
+  if(*status) return;
+  for(by=(fpixel[1]-1)/BC_SIDE;by<=(lpixel[1]-1)/BC_SIDE;++by)
+    for(bx=(fpixel[0]-1)/BC_SIDE;bx<=(lpixel[0]-1)/BC_SIDE;++bx)
+      {
+	if( (b=bcget(bc, img, layer, bx, by, fptr, fz, naxes,
+		     nulval))==NULL )
+	  {
+	    *status=MEMORY_ALLOCATION;
+	    return;
+	  }
+	if(b->status)
+	  {
+	    *status=b->status;
+	    bcrelease(bc, b);
+	    return;
+	  }
+
+	/* The part of this block that is needed (counting from 1 in
+	   the image). */
+	x0 = fpixel[0]>bx*BC_SIDE+1 ? fpixel[0] : bx*BC_SIDE+1;
+	x1 = lpixel[0]<(bx+1)*BC_SIDE ? lpixel[0] : (bx+1)*BC_SIDE;
+	y0 = fpixel[1]>by*BC_SIDE+1 ? fpixel[1] : by*BC_SIDE+1;
+	y1 = lpixel[1]<(by+1)*BC_SIDE ? lpixel[1] : (by+1)*BC_SIDE;
+	for(y=y0;y<=y1;++y)
+	  memcpy(&out[(y-fpixel[1])*stride+x0-fpixel[0]],
+		 &b->data[(y-1-by*BC_SIDE)*b->width[0]+x0-1-bx*BC_SIDE],
+		 (x1-x0+1)*sizeof *out);
+	bcrelease(bc, b);
+      }
+}
+
+
+
+
+
+void
+bcfree(struct blockcache *bc)
+{
+  struct bcblock *b, *next;
+
+  if(bc==NULL) return;
+  for(b=bc->head;b;b=next)
+    {
+      next=b->next;
+      free(b->data);
+      free(b);
+    }
+  pthread_mutex_destroy(&bc->m);
+  pthread_cond_destroy(&bc->c);
+  free(bc->hash);
+  free(bc);
+}
@@ -0,0 +1,79 @@
+/*********************************************************************
+tifaa - Thumbnail images from astronomical archives
+A simple set of functions to crop thumbnails from astronomical archives.
+
+Copyright (C) 2013-2014 Mohammad Akhlaghi
+Tohoku University Astronomical Institute, Sendai, Japan.
+http://astr.tohoku.ac.jp/~akhlaghi/
+
+tifaa is free software: you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation, either version 3 of the License, or
+(at your option) any later version.
+
+tifaa is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with tifaa.  If not, see <http://www.gnu.org/licenses/>.
+**********************************************************************/
+#ifndef BLOCKCACHE_H
+#define BLOCKCACHE_H
+
+#include <pthread.h>
+#include <fitsio.h>
+
+#include "fitsfz.h"
+
+#define BC_SIDE           256   /* Width and height of each block.    */
+#define BC_DEFAULTMB      256   /* Default budget in megabytes.       */
+
+/* One block of BC_SIDE*BC_SIDE pixels (less on the right and top
+   edges of the image) of a survey or weight image, as floats. */
+struct bcblock
+{
+  size_t            img;  /* Index of the survey image.                */
+  int             layer;  /* Band and weight (see readsurveysubset()). */
+  long           bx, by;  /* Position of the block (in blocks).        */
+  long         width[2];  /* Size of this block (pixels).              */
+  int             ready;  /* ==0: Still being read by a thread.        */
+  int            status;  /* CFITSIO status of reading it (!=0: not in  */
+                          /* the cache any more).                      */
+  size_t           refs;  /* Threads using it (can't be evicted).      */
+  int            cached;  /* ==0: Not in the cache, freed after use.   */
+  float           *data;  /* The pixels.                               */
+  struct bcblock *hnext;  /* Next block in the same hash bucket.       */
+  struct bcblock  *prev;  /* Newer block in the LRU list.              */
+  struct bcblock  *next;  /* Older block in the LRU list.              */
+};
+
+/* The blocks that were read most recently, in at most `maxblocks`
+   blocks of memory. It can be used by all the threads at once. */
+struct blockcache
+{
+  size_t      maxblocks;  /* Memory budget in blocks.                  */
+  size_t        nblocks;  /* Number of blocks in the cache.            */
+  size_t       nbuckets;  /* Size of the hash table (power of 2).      */
+  struct bcblock **hash;  /* Hash table of the blocks.                 */
+  struct bcblock  *head;  /* Most recently used block.                 */
+  struct bcblock  *tail;  /* Least recently used block.                */
+  size_t           hits;  /* Blocks found in the cache.                */
+  size_t         misses;  /* Blocks that had to be read.               */
+  pthread_mutex_t     m;  /* Mutex for everything above.               */
+  pthread_cond_t      c;  /* Signaled when a block is ready.           */
+};
+
+int
+bcinit(struct blockcache **bc, size_t bytes);
+
+void
+bcread(struct blockcache *bc, size_t img, int layer, fitsfile *fptr,
+       struct fzindex *fz, long *naxes, long *fpixel, long *lpixel,
+       float nulval, float *out, size_t stride, int *status);
+
+void
+bcfree(struct blockcache *bc);
+
+#endif
@@ -0,0 +1,534 @@
+/*********************************************************************
+tifaa - Thumbnail images from astronomical archives
+A simple set of functions to crop thumbnails from astronomical archives.
+
+Copyright (C) 2013-2014 Mohammad Akhlaghi
+Tohoku University Astronomical Institute, Sendai, Japan.
+http://astr.tohoku.ac.jp/~akhlaghi/
+
+tifaa is free software: you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation, either version 3 of the License, or
+(at your option) any later version.
+
+tifaa is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with tifaa.  If not, see <http://www.gnu.org/licenses/>.
+**********************************************************************/
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <pthread.h>
+
+#include "fitsfz.h"
+
+/* The random numbers used in dithering, they have to be exactly those
+   of CFITSIO (see fits_init_randoms() in CFITSIO's imcompress.c). */
+float fzrandom[FZ_NRANDOM];
+pthread_once_t fzrandomonce=PTHREAD_ONCE_INIT;
+
+
+
+
+/******************************************************************/
+/****************          Index a tile        ********************/
+/******************************************************************/
+void
+fzinitrandoms(void)
+{
+  int i;
+  double a=16807.0, m=2147483647.0, temp, seed=1;
+
+  for(i=0;i<FZ_NRANDOM;++i)
+    {
+      temp=a*seed;
+      seed=temp-m*((int)(temp/m));
+      fzrandom[i]=(float)(seed/m);
+    }
+}
+
+
+
+
+
+/* Read the value of the ZNAMEi keyword that is `name` (ZVALi), if it
+   doesn't exist, `value` is not changed. */
+void
+fzreadzval(fitsfile *fptr, char *name, int *value)
+{
+  int i, status;
+  long v;
+  char key[FLEN_KEYWORD], zname[FLEN_VALUE];
+
+  for(i=1;i<100;++i)
+    {
+      status=0;
+      sprintf(key, "ZNAME%d", i);
+      if(fits_read_key(fptr, TSTRING, key, zname, NULL, &status))
+	return;
+      if(strcmp(zname, name)==0)
+	{
+	  sprintf(key, "ZVAL%d", i);
+	  if(fits_read_key(fptr, TLONG, key, &v, NULL, &status)==0)
+	    *value=v;
+	  return;
+	}
+    }
+}
+
+
+
+
+
+/* The number of the column called `name` (counting from 1), or zero
+   if there is no such column. */
+int
+fzhascolumn(fitsfile *fptr, char *name)
+{
+  int col, s=0;
+  return fits_get_colnum(fptr, CASEINSEN, name, &col, &s) ? 0 : col;
+}
+
+
+
+
+
+/* If the current HDU of `fptr` is a Rice compressed image that this
+   file can decompress, keep the size of each compressed tile (and
+   the scaling of quantized tiles) in `ix` and set `ix->rice=1`. For
+   any other HDU (not compressed, other compression algorithms,
+   tiles that couldn't be Rice compressed) `ix->rice=0` and CFITSIO
+   has to be used. When the environment variable FZ_NOINDEXENV is set,
+   no image is indexed (so CFITSIO is always used, for comparing with
+   it in the regression tests). */
+int
+fzmakeindex(fitsfile *fptr, struct fzindex *ix, int *status)
+{
+  long i, ntiles;
+  int s=0, col, anynul;
+  LONGLONG offset;
+  char value[FLEN_VALUE];
+
+  memset(ix, 0, sizeof *ix);
+  if(*status || getenv(FZ_NOINDEXENV)
+     || fits_is_compressed_image(fptr, &s)==0)
+    return *status;
+
+  /* Only Rice compressed tiles of 2D images. */
+  if( fits_read_key(fptr, TSTRING, "ZCMPTYPE", value, NULL, &s)
+      || (strcmp(value, "RICE_1") && strcmp(value, "RICE_ONE"))
+      || fits_read_key(fptr, TINT, "ZNAXIS", &col, NULL, &s) || col!=2 )
+    return *status;
+  fits_read_key(fptr, TINT, "ZBITPIX", &ix->zbitpix, NULL, &s);
+  fits_read_key(fptr, TLONG, "ZNAXIS1", &ix->znaxes[0], NULL, &s);
+  fits_read_key(fptr, TLONG, "ZNAXIS2", &ix->znaxes[1], NULL, &s);
+  if(s) return *status;
+  ix->ztile[0]=ix->znaxes[0];
+  ix->ztile[1]=1;
+  fits_read_key(fptr, TLONG, "ZTILE1", &ix->ztile[0], NULL, &s); s=0;
+  fits_read_key(fptr, TLONG, "ZTILE2", &ix->ztile[1], NULL, &s); s=0;
+  ix->ntiles[0]=(ix->znaxes[0]+ix->ztile[0]-1)/ix->ztile[0];
+  ix->ntiles[1]=(ix->znaxes[1]+ix->ztile[1]-1)/ix->ztile[1];
+  ntiles=ix->ntiles[0]*ix->ntiles[1];
+
+  /* Parameters of the Rice compression. */
+  ix->blocksize=32;
+  ix->bytepix = ix->zbitpix==BYTE_IMG ? 1 : (ix->zbitpix==SHORT_IMG ? 2 : 4);
+  fzreadzval(fptr, "BLOCKSIZE", &ix->blocksize);
+  fzreadzval(fptr, "BYTEPIX", &ix->bytepix);
+  if(ix->bytepix!=1 && ix->bytepix!=2 && ix->bytepix!=4)
+    return *status;
+
+  /* Floating point images have to be quantized (otherwise they
+     aren't Rice compressed) and integers may be scaled. */
+  ix->bscale=1.0f; ix->bzero=0.0f;
+  if(ix->zbitpix<0)
+    {
+      ix->quantize=FZ_NODITHER;
+      if(fits_read_key(fptr, TSTRING, "ZQUANTIZ", value, NULL, &s)==0)
+	{
+	  if(strcmp(value, "SUBTRACTIVE_DITHER_1")==0)
+	    ix->quantize=FZ_DITHER1;
+	  else if(strcmp(value, "SUBTRACTIVE_DITHER_2")==0)
+	    ix->quantize=FZ_DITHER2;
+	  else if(strcmp(value, "NO_DITHER"))
+	    return *status;
+	}
+      s=0;
+      ix->dither0=1;
+      fits_read_key(fptr, TLONG, "ZDITHER0", &ix->dither0, NULL, &s); s=0;
+    }
+  else
+    {
+      fits_read_key(fptr, TDOUBLE, "BSCALE", &ix->bscale, NULL, &s); s=0;
+      fits_read_key(fptr, TDOUBLE, "BZERO", &ix->bzero, NULL, &s); s=0;
+    }
+
+  /* Null pixels can only be defined by a keyword here (not a ZBLANK
+     column). */
+  if(fzhascolumn(fptr, "ZBLANK"))
+    return *status;
+  if(fits_read_key(fptr, TLONG, "ZBLANK", &ix->zblank, NULL, &s)==0)
+    ix->hasblank=1;
+  else if(s=0, ix->zbitpix>0
+	  && fits_read_key(fptr, TLONG, "BLANK", &ix->zblank, NULL, &s)==0)
+    ix->hasblank=1;
+
+  /* Tiles that couldn't be Rice compressed are kept in other columns,
+     if there are any, leave this image to CFITSIO. So are quantized
+     images without a ZSCALE and ZZERO for each tile. */
+  if( fzhascolumn(fptr, "GZIP_COMPRESSED_DATA")
+      || fzhascolumn(fptr, "UNCOMPRESSED_DATA")
+      || (ix->zbitpix<0 && ( fzhascolumn(fptr, "ZSCALE")==0
+			     || fzhascolumn(fptr, "ZZERO")==0 ))
+      || (ix->datacol=fzhascolumn(fptr, "COMPRESSED_DATA"))==0 )
+    return *status;
+
+  /* Size of each compressed tile. */
+  ix->length=malloc(ntiles*sizeof *ix->length);
+  if(ix->zbitpix<0)
+    {
+      ix->zscale=malloc(ntiles*sizeof *ix->zscale);
+      ix->zzero=malloc(ntiles*sizeof *ix->zzero);
+    }
+  if( ix->length==NULL
+      || (ix->zbitpix<0 && (ix->zscale==NULL || ix->zzero==NULL)) )
+    {
+      fzfreeindex(ix);
+      return *status=MEMORY_ALLOCATION;
+    }
+  for(i=0;i<ntiles;++i)
+    {
+      fits_read_descriptll(fptr, ix->datacol, i+1, &ix->length[i], &offset,
+			   status);
+      if(ix->length[i]==0)	/* Not compressed: leave to CFITSIO. */
+	{
+	  fzfreeindex(ix);
+	  return *status;
+	}
+      if(ix->length[i]>ix->maxlen) ix->maxlen=ix->length[i];
+    }
+  if(ix->zbitpix<0)
+    {
+      fits_read_col_dbl(fptr, fzhascolumn(fptr, "ZSCALE"), 1, 1, ntiles,
+			0, ix->zscale, &anynul, status);
+      fits_read_col_dbl(fptr, fzhascolumn(fptr, "ZZERO"), 1, 1, ntiles,
+			0, ix->zzero, &anynul, status);
+    }
+  if(*status)
+    {
+      fzfreeindex(ix);
+      return *status;
+    }
+
+  pthread_once(&fzrandomonce, fzinitrandoms);
+  ix->rice=1;
+  return *status;
+}
+
+
+
+
+
+/* Index the first image HDU of the file `name` (see fzmakeindex()). */
+int
+fzindexfile(char *name, struct fzindex *ix, int *status)
+{
+  int c_status=0;
+  fitsfile *fptr=NULL;
+
+  fits_open_image(&fptr, name, READONLY, status);
+  fzmakeindex(fptr, ix, status);
+  if(fptr) fits_close_file(fptr, &c_status);
+  return *status;
+}
+
+
+
+
+
+void
+fzfreeindex(struct fzindex *ix)
+{
+  free(ix->length);
+  free(ix->zscale);
+  free(ix->zzero);
+  ix->length=NULL; ix->zscale=ix->zzero=NULL;
+  ix->rice=0;
+}
+
+
+
+
+
+
+
+
+
+
+
+
+
+
+
+
+
+
+
+
+/******************************************************************/
+/****************         Decompression        ********************/
+/******************************************************************/
+/* Decode the first `nx` pixels of one Rice compressed tile. This is
+   the algorithm of fits_rdecomp() in CFITSIO (for 1, 2 or 4 bytes
+   per pixel), but it stops after the pixels that are needed, so for
+   a tile that is a full row of a mosaic, only the pixels up to the
+   end of the crop are decoded. `c` must have at least 8 readable
+   bytes after its `clen` bytes. The output is 1 if the stream ended
+   before `nx` pixels. */
+int
+fzricedecode(unsigned char *c, LONGLONG clen, int bytepix, int nblock,
+	     int *out, long nx)
+{
+  long i, imax;
+  unsigned char *cend=c+clen;
+  int k, nbits, nzero, fs, fsbits, fsmax, bbits;
+  unsigned int b, diff, lastpix=0, mask;
+
+  switch(bytepix)
+    {
+    case 1:  fsbits=3; fsmax=6;  mask=0xff;       break;
+    case 2:  fsbits=4; fsmax=14; mask=0xffff;     break;
+    default: fsbits=5; fsmax=25; mask=0xffffffff; break;
+    }
+  bbits=1<<fsbits;
+
+  /* The first pixel is kept as it is (big endian). */
+  for(k=0;k<bytepix;++k)
+    lastpix=(lastpix<<8) | *c++;
+
+  b=*c++;			/* Bit buffer.                    */
+  nbits=8;			/* Number of bits remaining in b. */
+  for(i=0;i<nx;)
+    {
+      /* The FS value of this block. */
+      nbits-=fsbits;
+      while(nbits<0) { b=(b<<8) | *c++; nbits+=8; }
+      fs=(b>>nbits)-1;
+      b&=(1<<nbits)-1;
+
+      imax = i+nblock<nx ? i+nblock : nx;
+      if(fs<0)			/* All differences are zero.      */
+	for(;i<imax;++i)
+	  out[i]=lastpix;
+      else
+	for(;i<imax;++i)
+	  {
+	    if(fs==fsmax)		/* Differences without coding.    */
+	      {
+		k=bbits-nbits;
+		diff = k<32 ? b<<k : 0;
+		for(k-=8;k>=0;k-=8) { b=*c++; diff|=b<<k; }
+		if(nbits>0) { b=*c++; diff|=b>>(-k); b&=(1<<nbits)-1; }
+		else b=0;
+	      }
+	    else			/* Rice coded differences.        */
+	      {
+		while(b==0) { nbits+=8; b=*c++; }
+		nzero=nbits-(32-__builtin_clz(b));
+		nbits-=nzero+1;
+		b^=1<<nbits;
+		nbits-=fs;
+		while(nbits<0) { b=(b<<8) | *c++; nbits+=8; }
+		diff=(nzero<<fs) | (b>>nbits);
+		b&=(1<<nbits)-1;
+	      }
+
+	    /* Undo the mapping and differencing. */
+	    diff = (diff&1) ? ~(diff>>1) : diff>>1;
+	    lastpix=(diff+lastpix)&mask;
+	    switch(bytepix)
+	      {
+	      case 1:  out[i]=(unsigned char)lastpix; break;
+	      case 2:  out[i]=(short)lastpix;         break;
+	      default: out[i]=(int)lastpix;
+	      }
+	  }
+      if(c>cend)
+	return 1;
+    }
+  return 0;
+}
+
+
+
+
+
+/* Convert the `n` decoded integers of tile `tile` (counting from 0)
+   to floats, as CFITSIO would when reading it with
+   fits_read_subset_flt(). */
+void
+fztofloat(struct fzindex *ix, long tile, int *in, float *out, long n,
+	  float nulval)
+{
+  long i;
+  int iseed, nextrand;
+  double scale, zero;
+
+  /* Integer images. */
+  if(ix->zbitpix>0)
+    {
+      for(i=0;i<n;++i)
+	out[i] = ix->hasblank && in[i]==ix->zblank
+	  ? nulval : (float)(in[i]*ix->bscale+ix->bzero);
+      return;
+    }
+
+  /* Quantized floating point images. */
+  scale=ix->zscale[tile];
+  zero=ix->zzero[tile];
+  if(ix->quantize==FZ_NODITHER)
+    {
+      for(i=0;i<n;++i)
+	out[i] = ix->hasblank && in[i]==ix->zblank
+	  ? nulval : (float)(in[i]*scale+zero);
+      return;
+    }
+  iseed=(int)((tile+ix->dither0-1)%FZ_NRANDOM);
+  nextrand=(int)(fzrandom[iseed]*500);
+  for(i=0;i<n;++i)
+    {
+      if(ix->hasblank && in[i]==ix->zblank)
+	out[i]=nulval;
+      else if(ix->quantize==FZ_DITHER2 && in[i]==FZ_ZEROVALUE)
+	out[i]=0.0;
+      else
+	out[i]=(float)(((double)in[i]-fzrandom[nextrand]+0.5)*scale+zero);
+      if(++nextrand==FZ_NRANDOM)
+	{
+	  if(++iseed==FZ_NRANDOM) iseed=0;
+	  nextrand=(int)(fzrandom[iseed]*500);
+	}
+    }
+}
+
+
+
+
+
+/* Make sure the buffers of `s` are large enough for the tiles of
+   `ix`. The output is 1 if there isn't enough memory. */
+int
+fzgrowscratch(struct fzscratch *s, struct fzindex *ix)
+{
+  size_t clen=ix->maxlen+8, npix=ix->ztile[0]*ix->ztile[1];
+
+  if(clen>s->clen)
+    {
+      free(s->cbuf);
+      if( (s->cbuf=malloc(clen))==NULL ) { s->clen=0; return 1; }
+      s->clen=clen;
+    }
+  if(npix>s->npix)
+    {
+      free(s->ibuf);
+      free(s->fbuf);
+      s->ibuf=malloc(npix*sizeof *s->ibuf);
+      s->fbuf=malloc(npix*sizeof *s->fbuf);
+      if(s->ibuf==NULL || s->fbuf==NULL) { s->npix=0; return 1; }
+      s->npix=npix;
+    }
+  return 0;
+}
+
+
+
+
+
+void
+fzfreescratch(struct fzscratch *s)
+{
+  free(s->cbuf);
+  free(s->ibuf);
+  free(s->fbuf);
+  memset(s, 0, sizeof *s);
+}
+
+
+
+
+
+/* Read the pixels from `fpixel` to `lpixel` (inclusive, counting from
+   1, like fits_read_subset_flt()) into `out`. Only the compression
+   tiles that overlap with this region are read and decoded (and only
+   up to the last pixel needed in each). The buffers in `scratch` are
+   used (and grown if necessary), if it is NULL, they are allocated
+   and freed here. The output is 0 if the image wasn't indexed and
+   CFITSIO has to be used. */
+int
+fzreadsubset(fitsfile *fptr, struct fzindex *ix, long *fpixel,
+	     long *lpixel, float nulval, float *out,
+	     struct fzscratch *scratch, int *status)
+{
+  int *ibuf, anynul;
+  float *fbuf;
+  unsigned char *cbuf;
+  struct fzscratch local={NULL, 0, NULL, NULL, 0};
+  long tx, ty, x0, x1, y0, y1, y, tw, n, tile;
+  long width=lpixel[0]-fpixel[0]+1;
+
+  if(ix->rice==0 || *status)
+    return 0;
+
+  if(scratch==NULL) scratch=&local;
+  if(fzgrowscratch(scratch, ix))
+    {
+      *status=MEMORY_ALLOCATION;
+      fzfreescratch(&local);
+      return 1;
+    }
+  cbuf=scratch->cbuf;
+  ibuf=scratch->ibuf;
+  fbuf=scratch->fbuf;
+  memset(cbuf+ix->maxlen, 0, 8);
+
+  for(ty=(fpixel[1]-1)/ix->ztile[1];ty<=(lpixel[1]-1)/ix->ztile[1];++ty)
+    for(tx=(fpixel[0]-1)/ix->ztile[0];tx<=(lpixel[0]-1)/ix->ztile[0];++tx)
+      {
+	/* The part of this tile that is needed (counting from 0 in the
+	   tile) and the number of pixels that have to be decoded. */
+	tile=ty*ix->ntiles[0]+tx;
+	tw = tx==ix->ntiles[0]-1 ? ix->znaxes[0]-tx*ix->ztile[0] : ix->ztile[0];
+	x0 = fpixel[0]-1-tx*ix->ztile[0];      if(x0<0) x0=0;
+	x1 = lpixel[0]-1-tx*ix->ztile[0];      if(x1>=tw) x1=tw-1;
+	y0 = fpixel[1]-1-ty*ix->ztile[1];      if(y0<0) y0=0;
+	y1 = lpixel[1]-1-ty*ix->ztile[1];
+	if(y1>=ix->ztile[1]) y1=ix->ztile[1]-1;
+	n=y1*tw+x1+1;
+
+	/* Read and decode it. */
+	fits_read_col_byt(fptr, ix->datacol, tile+1, 1, ix->length[tile], 0,
+			  cbuf, &anynul, status);
+	if(*status) break;
+	if(fzricedecode(cbuf, ix->length[tile], ix->bytepix, ix->blocksize,
+			ibuf, n))
+	  {
+	    *status=DATA_DECOMPRESSION_ERR;
+	    break;
+	  }
+	fztofloat(ix, tile, ibuf, fbuf, n, nulval);
+
+	/* Put the needed part in the output. */
+	for(y=y0;y<=y1;++y)
+	  memcpy(&out[ (ty*ix->ztile[1]+y+1-fpixel[1])*width
+		       + tx*ix->ztile[0]+x0+1-fpixel[0] ],
+		 &fbuf[y*tw+x0], (x1-x0+1)*sizeof *out);
+      }
+
+  fzfreescratch(&local);
+  return 1;
+}
@@ -0,0 +1,91 @@
+/*********************************************************************
+tifaa - Thumbnail images from astronomical archives
+A simple set of functions to crop thumbnails from astronomical archives.
+
+Copyright (C) 2013-2014 Mohammad Akhlaghi
+Tohoku University Astronomical Institute, Sendai, Japan.
+http://astr.tohoku.ac.jp/~akhlaghi/
+
+tifaa is free software: you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation, either version 3 of the License, or
+(at your option) any later version.
+
+tifaa is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with tifaa.  If not, see <http://www.gnu.org/licenses/>.
+**********************************************************************/
+#ifndef FITSFZ_H
+#define FITSFZ_H
+
+#include <fitsio.h>
+
+#define FZ_NRANDOM        10000 /* Random numbers for dithering.      */
+#define FZ_ZEROVALUE      -2147483646 /* Zero in SUBTRACTIVE_DITHER_2.*/
+#define FZ_NOINDEXENV     "TIFAA_NOFZ" /* Set: always use CFITSIO.    */
+
+/* Quantization of floating point images. */
+#define FZ_NODITHER       0
+#define FZ_DITHER1        1
+#define FZ_DITHER2        2
+
+/* Everything needed to decompress any compression tile of a Rice
+   compressed (fpack) image without going through CFITSIO's
+   decompression. It is made once for each survey image (in
+   get_imginfo()) and can then be used by all threads. */
+struct fzindex
+{
+  int            rice;  /* ==1: Indexed, ==0: use CFITSIO.             */
+  long      znaxes[2];  /* Size of the uncompressed image.             */
+  long       ztile[2];  /* Size of each compression tile.              */
+  long      ntiles[2];  /* Number of compression tiles on each axis.   */
+  int         zbitpix;  /* BITPIX of the uncompressed image.           */
+  int         bytepix;  /* Bytes per integer in the Rice stream.       */
+  int       blocksize;  /* Pixels in each Rice block.                  */
+  int        quantize;  /* For floats: FZ_NODITHER, FZ_DITHER1 or 2.   */
+  long        dither0;  /* ZDITHER0: Seed of the dithering.            */
+  int         datacol;  /* Column of COMPRESSED_DATA.                  */
+  int        hasblank;  /* ==1: `zblank` is the value of null pixels.  */
+  long         zblank;  /* Value of null pixels.                       */
+  double       bscale;  /* BSCALE of integer images.                   */
+  double        bzero;  /* BZERO of integer images.                    */
+  LONGLONG    *length;  /* Compressed bytes of each tile.              */
+  LONGLONG     maxlen;  /* Largest value in `length`.                  */
+  double      *zscale;  /* ZSCALE of each tile (quantized floats).     */
+  double       *zzero;  /* ZZERO of each tile (quantized floats).      */
+};
+
+/* Buffers used while decompressing tiles. They can be kept (for
+   example by each thread) and reused for all the reads, their size
+   only grows. */
+struct fzscratch
+{
+  unsigned char *cbuf;  /* Compressed bytes of one tile.               */
+  size_t         clen;  /* Allocated bytes in `cbuf`.                  */
+  int           *ibuf;  /* Decoded integers of one tile.               */
+  float         *fbuf;  /* Decoded pixels of one tile.                 */
+  size_t         npix;  /* Allocated pixels in `ibuf` and `fbuf`.      */
+};
+
+int
+fzmakeindex(fitsfile *fptr, struct fzindex *ix, int *status);
+
+int
+fzindexfile(char *name, struct fzindex *ix, int *status);
+
+void
+fzfreeindex(struct fzindex *ix);
+
+void
+fzfreescratch(struct fzscratch *s);
+
+int
+fzreadsubset(fitsfile *fptr, struct fzindex *ix, long *fpixel,
+	     long *lpixel, float nulval, float *out,
+	     struct fzscratch *scratch, int *status);
+
+#endif
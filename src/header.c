@@ -0,0 +1,537 @@
+/*********************************************************************
+tifaa - Thumbnail images from astronomical archives
+A simple set of functions to crop thumbnails from astronomical archives.
+
+Copyright (C) 2013-2014 Mohammad Akhlaghi
+Tohoku University Astronomical Institute, Sendai, Japan.
+http://astr.tohoku.ac.jp/~akhlaghi/
+
+tifaa is free software: you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation, either version 3 of the License, or
+(at your option) any later version.
+
+tifaa is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with tifaa.  If not, see <http://www.gnu.org/licenses/>.
+**********************************************************************/
+#include <time.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <wcslib/wcshdr.h>
+
+#include "tifaa.h"
+#include "header.h"
+
+/* The comments of the thumbnail (see addheaderinfo()). */
+#define HDR_TITLE         "                   / %s"
+#define HDR_CREATED       "Created with TIFAA %s on %s."
+#define HDR_RA            "RA  of thumbnail center: %13f"
+#define HDR_DEC           "DEC of thumbnail center: %13f"
+#define HDR_SIZE          "Thumbnail is %.2f arcseconds across with %.3f " \
+                          "arcsecond/pixel."
+
+
+
+
+
+
+
+
+
+
+
+
+
+
+
+
+
+
+
+
+/******************************************************************/
+/****************       Formatting CRPIX       ********************/
+/******************************************************************/
+/* Print `v` with `format` into `buf` like wcsutil_double2str() of
+   WCSLIB: if there is no decimal point or exponent, `.0` is added
+   (the value is moved to the left). */
+void
+hdrdouble2str(char *buf, char *format, double v)
+{
+  char *bp, *cp;
+
+  sprintf(buf, format, v);
+  for(bp=buf;*bp;++bp)
+    if(*bp=='.' || *bp=='E')
+      return;
+
+  bp=buf;
+  if(*bp==' ')
+    {
+      cp=buf+1;
+      if(*cp==' ') ++cp;
+      while(*cp) *bp++=*cp++;
+      *bp++='.';
+      if(bp<cp) *bp++='0';
+      *bp='\0';
+    }
+}
+
+
+
+
+
+/* The format of the `n` values in `val` like wcshdo() of WCSLIB 5 and
+   later: the fewest decimals that keep their significant digits (at
+   most 15), or with an exponent when they are very large or small. */
+void
+hdrminformat(double *val, size_t n, char *format)
+{
+  size_t i;
+  char cval[32];
+  int cpi, expon, emax=-999, emin=999, precision=0;
+
+  for(i=0;i<n;++i)
+    {
+      hdrdouble2str(cval, "%21.14E", val[i]);
+      for(cpi=16;2<cpi && cval[cpi]=='0';--cpi);
+      cpi-=2;
+      if(precision<cpi) precision=cpi;
+      sscanf(cval+18, "%d", &expon);
+      if(emax<expon) emax=expon;
+      expon-=cpi;
+      if(expon<emin) emin=expon;
+    }
+
+  ++emax;
+  if(emin<-15 || 15<emax || 15<emax-emin)
+    {
+      if(precision<1)  precision=1;
+      if(14<precision) precision=14;
+      sprintf(format, precision<14 ? "%%20.%dE" : "%%21.%dE", precision);
+    }
+  else
+    {
+      precision=-emin;
+      if(precision<1)  precision=1;
+      if(17<precision) precision=17;
+      sprintf(format, "%%20.%df", precision);
+    }
+}
+
+
+
+
+
+/* Make the CRPIX cards (from the cards of the template, `h->cards`)
+   for these CRPIX values with `format` (HDR_G12 or HDR_MINDIGITS).
+   The output is 0 if the value doesn't fit where wcshdo() puts it
+   (only in the rare `%21.14E` format), `cards` is then not usable. */
+int
+hdrcrpixcards(struct hdrtemplate *h, int format, double *crpix,
+	      char cards[2][HDR_CARD+1])
+{
+  int i;
+  char fmt[20], value[40];
+
+  if(format==HDR_MINDIGITS)
+    hdrminformat(crpix, 2, fmt);
+  else
+    strcpy(fmt, "%20.12G");
+
+  for(i=0;i<2;++i)
+    {
+      hdrdouble2str(value, fmt, crpix[i]);
+      if(strlen(value)!=20) return 0;
+      memcpy(cards[i], &h->cards[h->crpix[i]*(HDR_CARD+1)], HDR_CARD+1);
+      memcpy(cards[i]+10, value, 20);
+    }
+  return 1;
+}
+
+
+
+
+
+/* Does `format` give the same CRPIX cards as wcshdo() (whose output
+   for these `crpix` values is `wcsheader`, the CRPIX cards are
+   `ic[0]` and `ic[1]` in it)? */
+int
+hdrsameformat(struct hdrtemplate *h, int format, double *crpix,
+	      char *wcsheader, int *ic)
+{
+  int i;
+  char cards[2][HDR_CARD+1];
+
+  if(!hdrcrpixcards(h, format, crpix, cards))
+    return 0;
+  for(i=0;i<2;++i)
+    if(strncmp(cards[i], &wcsheader[ic[i]*HDR_CARD], HDR_CARD-1))
+      return 0;
+  return 1;
+}
+
+
+
+
+
+/* Find how the version of WCSLIB that is used formats CRPIX: the
+   format has to give the cards of the template (`wcsheader`) and the
+   cards that wcshdo() writes for CRPIX values with more digits. */
+void
+hdrfindformat(struct hdrtemplate *h, struct wcsprm *wcs, char *wcsheader,
+	      int *ic)
+{
+  int nkeyrec;
+  char *probeheader;
+  double orig[2], probe[2]={1234.56789012345, 12.5};
+
+  h->format=HDR_WCSHDO;
+  orig[0]=wcs->crpix[0]; orig[1]=wcs->crpix[1];
+  wcs->crpix[0]=probe[0]; wcs->crpix[1]=probe[1];
+  if(wcshdo(0, wcs, &nkeyrec, &probeheader)==0)
+    {
+      if( hdrsameformat(h, HDR_MINDIGITS, orig, wcsheader, ic)
+	  && hdrsameformat(h, HDR_MINDIGITS, probe, probeheader, ic) )
+	h->format=HDR_MINDIGITS;
+      else if( hdrsameformat(h, HDR_G12, orig, wcsheader, ic)
+	       && hdrsameformat(h, HDR_G12, probe, probeheader, ic) )
+	h->format=HDR_G12;
+      free(probeheader);
+    }
+  wcs->crpix[0]=orig[0]; wcs->crpix[1]=orig[1];
+}
+
+
+
+
+
+
+
+
+
+
+
+
+
+
+
+
+
+
+
+
+/******************************************************************/
+/****************      Without a template      ********************/
+/******************************************************************/
+/* Write the WCS of a thumbnail (`wcs` of its first survey image
+   with CRPIX moved to the thumbnail, `wcs` is changed) and the
+   information about it with wcshdo(). hdrwrite() uses it when it
+   can't use the template. */
+void
+addheaderinfo(fitsfile *write_fptr, int *wr_status, struct wcsprm *wcs,
+	      long *fpixel_i, long *fpixel_c, double *world, 
+	      double ps_size, double res)
+{
+  size_t i;
+  time_t rawtime;
+  int nkeyrec, h;
+  char comment[1000];
+  char startblank[]="                   / ";
+  char *wcsheader, *cp, *cpf, blankrec[80], titlerec[80];
+
+  time(&rawtime);
+
+  /* Set the last element of the blank array. */
+  cpf=blankrec+79;
+  *cpf='\0';
+  titlerec[79]='\0';
+  cp=blankrec; do *cp=' '; while(++cp<cpf);
+
+  /* Delete the comments that already exist: */
+  fits_delete_key(write_fptr, "COMMENT", wr_status);
+  fits_delete_key(write_fptr, "COMMENT", wr_status);
+
+  /* Add the WCS information: */
+  fits_write_record(write_fptr, blankrec, wr_status);
+  sprintf(titlerec, "%sWCS INFORMATION", startblank);
+  titlerec[strlen(titlerec)]=' ';
+  fits_write_record(write_fptr, titlerec, wr_status);
+  wcs->crpix[0] -= (fpixel_i[0]-1)+(fpixel_c[0]-1);
+  wcs->crpix[1] -= (fpixel_i[1]-1)+(fpixel_c[1]-1);
+  wcshdo(0, wcs, &nkeyrec, &wcsheader);
+  for(h=0;h<nkeyrec-1;++h)
+    {
+      cp=&wcsheader[h*80];
+      wcsheader[(h+1)*80-1]='\0';
+      fits_write_record(write_fptr, cp, wr_status);
+    }
+  free(wcsheader);
+
+  /*Print all the other information in the header:  */
+  fits_write_record(write_fptr, blankrec, wr_status);
+  sprintf(titlerec, "%sABOUT THIS THUMBNAIL", startblank);
+  for(i=strlen(titlerec);i<79;++i)
+    titlerec[i]=' ';
+  fits_write_record(write_fptr, titlerec, wr_status);  
+  sprintf(comment, "Created with TIFAA %s on %s.", 
+	  TIFFAVERSION, ctime(&rawtime));
+  fits_write_comment(write_fptr, comment, wr_status);
+  sprintf(comment, "RA  of thumbnail center: %13f", world[0]);
+  fits_write_comment(write_fptr, comment, wr_status);
+  sprintf(comment, "DEC of thumbnail center: %13f", world[1]);
+  fits_write_comment(write_fptr, comment, wr_status);
+  sprintf(comment, "Thumbnail is %.2f arcseconds across with %.3f "
+	  "arcsecond/pixel.", ps_size, res);
+  fits_write_comment(write_fptr, comment, wr_status);
+
+  /* Copyright information */
+  fits_write_record(write_fptr, blankrec, wr_status);
+  sprintf(titlerec, "%sABOUT TIFAA", startblank);
+  for(i=strlen(titlerec);i<79;++i)
+    titlerec[i]=' ';
+  fits_write_record(write_fptr, titlerec, wr_status);
+  sprintf(comment, "TIFAA is available under the GNU GPL v3+.");
+  fits_write_comment(write_fptr, comment, wr_status);
+  sprintf(comment, "https://github.com/makhlaghi/tifaa");
+  fits_write_comment(write_fptr, comment, wr_status);
+  sprintf(comment, "Copyright 2013-2014, Mohammad Akhlaghi.");
+  fits_write_comment(write_fptr, comment, wr_status);
+  sprintf(comment, "http://www.astr.tohoku.ac.jp/~akhlaghi/");
+  fits_write_comment(write_fptr, comment, wr_status);
+}
+
+
+
+
+
+
+
+
+
+
+
+
+
+
+
+
+
+
+
+
+/******************************************************************/
+/****************         The template         ********************/
+/******************************************************************/
+/* Add the card `text` (padded with blanks) to the template. */
+void
+hdrcard(struct hdrtemplate *h, char *text)
+{
+  sprintf(&h->cards[h->ncards++*(HDR_CARD+1)], "%-80.80s", text);
+}
+
+
+
+
+
+/* Card of the comment `text` (like fits_write_comment()). */
+void
+hdrcomment(char *card, char *text)
+{
+  sprintf(card, "COMMENT %-72.72s", text);
+}
+
+
+
+
+
+/* Make the template of the header of the thumbnails with `wcs` (of
+   one survey image). Only wcshdo() is called here (twice, to find
+   how it formats CRPIX), all the thumbnails made with this template
+   then only need the cards. The output is the status of wcshdo(), or
+   WCSHDRERR_MEMORY if there wasn't enough memory. */
+int
+hdrmake(struct hdrtemplate *h, struct wcsprm *wcs)
+{
+  char *wcsheader, text[HDR_CARD+1], card[HDR_CARD+1];
+  int i, k, nkeyrec, err, ic[2]={-1,-1};
+
+  memset(h, 0, sizeof *h);
+  if( (err=wcshdo(0, wcs, &nkeyrec, &wcsheader)) )
+    return err;
+  /* The WCS cards and the 14 cards that addheaderinfo() adds. */
+  if( (h->cards=malloc((nkeyrec-1+14)*(HDR_CARD+1)))==NULL )
+    {
+      free(wcsheader);
+      return WCSHDRERR_MEMORY;
+    }
+
+  /* The WCS information (without the last card, as in
+     addheaderinfo()). */
+  hdrcard(h, "");
+  sprintf(text, HDR_TITLE, "WCS INFORMATION");
+  hdrcard(h, text);
+  for(i=0;i<nkeyrec-1;++i)
+    {
+      memcpy(text, &wcsheader[i*HDR_CARD], HDR_CARD-1);
+      text[HDR_CARD-1]='\0';
+      for(k=0;k<2;++k)
+	if(!strncmp(text, k ? "CRPIX2  =" : "CRPIX1  =", 9))
+	  {
+	    ic[k]=i;
+	    h->crpix[k]=h->ncards;
+	  }
+      hdrcard(h, text);
+    }
+
+  /* About this thumbnail: these cards are replaced for each one. */
+  hdrcard(h, "");
+  sprintf(text, HDR_TITLE, "ABOUT THIS THUMBNAIL");
+  hdrcard(h, text);
+  h->created=h->ncards;
+  hdrcard(h, "");
+  h->center=h->ncards;
+  hdrcard(h, "");
+  hdrcard(h, "");
+  h->size=h->ncards;
+  hdrcard(h, "");
+
+  /* Copyright information. */
+  hdrcard(h, "");
+  sprintf(text, HDR_TITLE, "ABOUT TIFAA");
+  hdrcard(h, text);
+  hdrcomment(card, "TIFAA is available under the GNU GPL v3+.");
+  hdrcard(h, card);
+  hdrcomment(card, "https://github.com/makhlaghi/tifaa");
+  hdrcard(h, card);
+  hdrcomment(card, "Copyright 2013-2014, Mohammad Akhlaghi.");
+  hdrcard(h, card);
+  hdrcomment(card, "http://www.astr.tohoku.ac.jp/~akhlaghi/");
+  hdrcard(h, card);
+
+  /* Without both CRPIX cards, wcshdo() is needed for each one. */
+  if(ic[0]>=0 && ic[1]>=0)
+    hdrfindformat(h, wcs, wcsheader, ic);
+  free(wcsheader);
+  return 0;
+}
+
+
+
+
+
+/* Write the header of a thumbnail from the template: the CRPIX values
+   are those of `wcs` moved like in addheaderinfo(), `wcs` isn't
+   changed. Without a template (`h==NULL`), if the cards can't be
+   made like addheaderinfo() makes them or when the environment
+   variable HDR_NOTEMPLATEENV is set (to compare the two in the
+   regression tests), it is used. */
+void
+hdrwrite(fitsfile *fptr, struct hdrtemplate *h, struct wcsprm *wcs,
+	 long *fpixel_i, long *fpixel_c, double *world, double ps_size,
+	 double res, int *status)
+{
+  size_t i;
+  time_t rawtime;
+  double crpix[2], orig[2];
+  char crpixcards[2][HDR_CARD+1], cards[4][HDR_CARD+1];
+  char text[HDR_CARD*2], *card;
+
+  crpix[0]=wcs->crpix[0]-((fpixel_i[0]-1)+(fpixel_c[0]-1));
+  crpix[1]=wcs->crpix[1]-((fpixel_i[1]-1)+(fpixel_c[1]-1));
+  sprintf(text, HDR_SIZE, ps_size, res);
+  if(h==NULL || h->format==HDR_WCSHDO || getenv(HDR_NOTEMPLATEENV)
+     || strlen(text)>HDR_CARD-8
+     || !hdrcrpixcards(h, h->format, crpix, crpixcards))
+    {
+      orig[0]=wcs->crpix[0]; orig[1]=wcs->crpix[1];
+      addheaderinfo(fptr, status, wcs, fpixel_i, fpixel_c, world, ps_size,
+		    res);
+      wcs->crpix[0]=orig[0]; wcs->crpix[1]=orig[1];
+      return;
+    }
+
+  /* The cards that are different in each thumbnail. */
+  hdrcomment(cards[3], text);
+  time(&rawtime);
+  sprintf(text, HDR_CREATED, TIFFAVERSION, ctime(&rawtime));
+  hdrcomment(cards[0], text);
+  sprintf(text, HDR_RA, world[0]);
+  hdrcomment(cards[1], text);
+  sprintf(text, HDR_DEC, world[1]);
+  hdrcomment(cards[2], text);
+
+  /* Delete the comments that already exist and write all the cards. */
+  fits_delete_key(fptr, "COMMENT", status);
+  fits_delete_key(fptr, "COMMENT", status);
+  for(i=0;i<h->ncards;++i)
+    {
+      if(i==h->crpix[0])                card=crpixcards[0];
+      else if(i==h->crpix[1])           card=crpixcards[1];
+      else if(i==h->created)            card=cards[0];
+      else if(i==h->center)             card=cards[1];
+      else if(i==h->center+1)           card=cards[2];
+      else if(i==h->size)               card=cards[3];
+      else card=&h->cards[i*(HDR_CARD+1)];
+      fits_write_record(fptr, card, status);
+    }
+}
+
+
+
+
+
+/* Write DATASUM (`datasum`, see pixdatasum()) and a CHECKSUM that is
+   set by hdrchecksum() once the data are written. They are written
+   with the rest of the header, so it doesn't have to be moved. */
+void
+hdrdatasum(fitsfile *fptr, unsigned long datasum, int *status)
+{
+  char value[FLEN_VALUE];
+
+  sprintf(value, "%lu", datasum);
+  fits_write_key_str(fptr, "CHECKSUM", HDR_ZEROSUM, "HDU checksum.",
+		     status);
+  fits_write_key_str(fptr, "DATASUM", value, "Data unit checksum.",
+		     status);
+}
+
+
+
+
+
+/* Set CHECKSUM (written by hdrdatasum()) of the current HDU of `fptr`
+   with the sum of its header and `datasum`, like fits_write_chksum()
+   but only the header is read (it is still in CFITSIO's buffers).
+   The header must be complete (after fits_set_hdustruc()). */
+void
+hdrchecksum(fitsfile *fptr, unsigned long datasum, int *status)
+{
+  unsigned long sum=datasum;
+  char checksum[FLEN_VALUE];
+  LONGLONG hstart, dstart, dend;
+
+  if(*status) return;
+  fits_get_hduaddrll(fptr, &hstart, &dstart, &dend, status);
+  ffmbyt(fptr, hstart, REPORT_EOF, status);
+  ffcsum(fptr, (long)((dstart-hstart)/2880), &sum, status);
+  fits_encode_chksum(sum, 1, checksum);
+  fits_modify_key_str(fptr, "CHECKSUM", checksum, "&", status);
+}
+
+
+
+
+
+void
+hdrfree(struct hdrtemplate *h)
+{
+  free(h->cards);
+  h->cards=NULL;
+}
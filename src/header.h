@@ -0,0 +1,76 @@
+/*********************************************************************
+tifaa - Thumbnail images from astronomical archives
+A simple set of functions to crop thumbnails from astronomical archives.
+
+Copyright (C) 2013-2014 Mohammad Akhlaghi
+Tohoku University Astronomical Institute, Sendai, Japan.
+http://astr.tohoku.ac.jp/~akhlaghi/
+
+tifaa is free software: you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation, either version 3 of the License, or
+(at your option) any later version.
+
+tifaa is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with tifaa.  If not, see <http://www.gnu.org/licenses/>.
+**********************************************************************/
+#ifndef HEADER_H
+#define HEADER_H
+
+#include <fitsio.h>
+#include <wcslib/wcs.h>
+
+#define HDR_CARD          80    /* Characters in a header card.       */
+#define HDR_ZEROSUM       "0000000000000000" /* CHECKSUM to set.      */
+#define HDR_NOTEMPLATEENV "TIFAA_NOHDRTEMPLATE" /* Set: wcshdo() only. */
+#define HDR_NOFUSEDSUMENV "TIFAA_NOFUSEDSUM" /* Set: fits_write_chksum(). */
+
+/* How wcshdo() formats the CRPIX values (it depends on the version
+   of WCSLIB, see hdrmake()). */
+#define HDR_WCSHDO        0     /* Unknown: wcshdo() is called.       */
+#define HDR_G12           1     /* `%20.12G`.                         */
+#define HDR_MINDIGITS     2     /* The fewest digits (WCSLIB>=5).     */
+
+/* All the header cards that addheaderinfo() writes in the thumbnails
+   made with the WCS of one survey image. It is made once for each
+   image and only the cards that change (CRPIX, the center and size
+   of the thumbnail and the time) are changed for each thumbnail. */
+struct hdrtemplate
+{
+  char          *cards;  /* `ncards` cards (HDR_CARD+1 chars each).    */
+  size_t        ncards;  /* Number of cards.                           */
+  size_t      crpix[2];  /* Cards of CRPIX1 and CRPIX2.                */
+  size_t       created;  /* Card of the time it was made.              */
+  size_t        center;  /* Cards of the RA (and then the Dec).        */
+  size_t          size;  /* Card of the size of the thumbnail.         */
+  int           format;  /* Format of the CRPIX values: HDR_* above.   */
+};
+
+void
+addheaderinfo(fitsfile *write_fptr, int *wr_status, struct wcsprm *wcs,
+	      long *fpixel_i, long *fpixel_c, double *world, 
+	      double ps_size, double res);
+
+int
+hdrmake(struct hdrtemplate *h, struct wcsprm *wcs);
+
+void
+hdrwrite(fitsfile *fptr, struct hdrtemplate *h, struct wcsprm *wcs,
+	 long *fpixel_i, long *fpixel_c, double *world, double ps_size,
+	 double res, int *status);
+
+void
+hdrdatasum(fitsfile *fptr, unsigned long datasum, int *status);
+
+void
+hdrchecksum(fitsfile *fptr, unsigned long datasum, int *status);
+
+void
+hdrfree(struct hdrtemplate *h);
+
+#endif
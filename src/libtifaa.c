@@ -0,0 +1,564 @@
+/*********************************************************************
+tifaa - Thumbnail images from astronomical archives
+A simple set of functions to crop thumbnails from astronomical archives.
+
+Copyright (C) 2013-2014 Mohammad Akhlaghi
+Tohoku University Astronomical Institute, Sendai, Japan.
+http://astr.tohoku.ac.jp/~akhlaghi/
+
+tifaa is free software: you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation, either version 3 of the License, or
+(at your option) any later version.
+
+tifaa is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with tifaa.  If not, see <http://www.gnu.org/licenses/>.
+**********************************************************************/
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <pthread.h>
+
+#include "tifaa.h"
+#include "fitsfz.h"
+#include "libtifaa.h"
+#include "blockcache.h"
+#include "surveyimginfo.h"
+
+#define LT_STACKIMGS      64    /* Images of a target without malloc. */
+
+
+
+
+/* A survey image that is kept open between calls. It is opened the
+   first time a target needs it. */
+struct tifaatile
+{
+  fitsfile       *fptr;  /* Survey image (NULL: not opened yet).       */
+  fitsfile      *wfptr;  /* Weight image (NULL: not opened yet).       */
+  struct wcsprm   *wcs;  /* WCS of the survey image.                   */
+  int             nwcs;  /* Number of WCSs in `wcs`.                   */
+  long        naxes[2];  /* Size of the survey image.                  */
+  struct hdrtemplate hdr; /* Header of its thumbnails (see header.h).  */
+  pthread_mutex_t    m;  /* Only one thread can use a tile at a time.  */
+};
+
+struct tifaasurvey
+{
+  char       **imgnames;  /* Names of the survey images.               */
+  char       **whtnames;  /* Names of the weight images (can be NULL). */
+  size_t         numimg;  /* Number of survey images.                  */
+  double            res;  /* Resolution (arcseconds/pixel).            */
+  double       *imginfo;  /* NUM_IMAGEINFO_COLS columns for each image.*/
+  struct fzindex    *fz;  /* Compression tiles of each image.          */
+  struct fzindex   *wfz;  /* Compression tiles of each weight image.   */
+  struct blockcache *cache; /* Blocks of the images (NULL: no cache).  */
+  struct tifaatile *tiles; /* The opened images.                       */
+  pthread_mutex_t    wm;  /* WCS mutex (wcspih isn't thread-safe).     */
+};
+
+
+
+
+
+
+
+
+
+
+
+
+
+
+
+
+
+
+
+
+/******************************************************************/
+/****************        Survey handle        *********************/
+/******************************************************************/
+const char *
+tifaastrerror(int code)
+{
+  switch(code)
+    {
+    case TIFAA_OK:     return "no error";
+    case TIFAA_ENOMEM: return "not enough memory";
+    case TIFAA_EFITS:  return "CFITSIO error";
+    case TIFAA_EWCS:   return "WCSLIB couldn't read or use the WCS";
+    case TIFAA_EARGS:  return "bad arguments";
+    default:           return "unknown error";
+    }
+}
+
+
+
+
+
+/* Copy the `n` strings of `in`. */
+char **
+copynames(char **in, size_t n)
+{
+  size_t i;
+  char **out;
+
+  if( (out=calloc(n, sizeof *out))==NULL )
+    return NULL;
+  for(i=0;i<n;++i)
+    if( (out[i]=strdup(in[i]))==NULL )
+      {
+	while(i--) free(out[i]);
+	free(out);
+	return NULL;
+      }
+  return out;
+}
+
+
+
+
+
+/* Read the WCS of the `numimg` survey images (on `numthrd` threads)
+   and prepare the survey for cropping. The names are copied. If
+   `whtnames!=NULL`, it must have as many images as `imgnames` and
+   weighted thumbnails can be requested. If an image can't be read,
+   its index is put in `badimg` (when it isn't NULL). */
+int
+tifaaopen(struct tifaasurvey **survey, char **imgnames, char **whtnames,
+	  size_t numimg, double res, size_t numthrd, size_t *badimg)
+{
+  int err;
+  size_t i;
+  struct tifaasurvey *s;
+
+  *survey=NULL;
+  if(imgnames==NULL || numimg==0 || numimg>=UINT32_MAX || res<=0
+     || numthrd==0)
+    return TIFAA_EARGS;
+
+  if( (s=calloc(1, sizeof *s))==NULL )
+    return TIFAA_ENOMEM;
+  s->numimg=numimg;
+  s->res=res;
+  pthread_mutex_init(&s->wm, NULL);
+  if( (s->imgnames=copynames(imgnames, numimg))==NULL
+      || (whtnames && (s->whtnames=copynames(whtnames, numimg))==NULL)
+      || (s->imginfo=malloc(numimg*NUM_IMAGEINFO_COLS
+			    *sizeof *s->imginfo))==NULL
+      || (s->fz=calloc(numimg, sizeof *s->fz))==NULL
+      || (whtnames && (s->wfz=calloc(numimg, sizeof *s->wfz))==NULL)
+      || (s->tiles=calloc(numimg, sizeof *s->tiles))==NULL
+      || bcinit(&s->cache, (size_t)BC_DEFAULTMB*1024*1024) )
+    {
+      tifaaclose(s);
+      return TIFAA_ENOMEM;
+    }
+  for(i=0;i<numimg;++i)
+    pthread_mutex_init(&s->tiles[i].m, NULL);
+
+  if( (err=surveyimageinfo(s->imgnames, s->whtnames, numimg, res, numthrd,
+			   s->imginfo, s->fz, s->wfz, badimg)) )
+    {
+      tifaaclose(s);
+      return err;
+    }
+
+  *survey=s;
+  return TIFAA_OK;
+}
+
+
+
+
+
+/* Close all the opened images and free everything. */
+void
+tifaaclose(struct tifaasurvey *s)
+{
+  size_t i;
+  int status=0;
+
+  if(s==NULL) return;
+  if(s->tiles)
+    for(i=0;i<s->numimg;++i)
+      {
+	if(s->tiles[i].fptr)
+	  {
+	    fits_close_file(s->tiles[i].fptr, &status);
+	    wcsvfree(&s->tiles[i].nwcs, &s->tiles[i].wcs);
+	    hdrfree(&s->tiles[i].hdr);
+	  }
+	if(s->tiles[i].wfptr)
+	  fits_close_file(s->tiles[i].wfptr, &status);
+	pthread_mutex_destroy(&s->tiles[i].m);
+      }
+  for(i=0;i<s->numimg;++i)
+    {
+      if(s->imgnames) free(s->imgnames[i]);
+      if(s->whtnames) free(s->whtnames[i]);
+      if(s->fz) fzfreeindex(&s->fz[i]);
+      if(s->wfz) fzfreeindex(&s->wfz[i]);
+    }
+  pthread_mutex_destroy(&s->wm);
+  free(s->imgnames);
+  free(s->whtnames);
+  free(s->imginfo);
+  free(s->fz);
+  free(s->wfz);
+  free(s->tiles);
+  bcfree(s->cache);
+  free(s);
+}
+
+
+
+
+
+/* Replace the cache of decoded survey blocks with one of `bytes`
+   bytes (by default it has BC_DEFAULTMB megabytes, see
+   blockcache.h). With `bytes==0`, there will be no cache. It must not
+   be called while other threads are cropping from this survey. */
+int
+tifaasetcache(struct tifaasurvey *s, size_t bytes)
+{
+  if(s==NULL)
+    return TIFAA_EARGS;
+  bcfree(s->cache);
+  return bcinit(&s->cache, bytes) ? TIFAA_ENOMEM : TIFAA_OK;
+}
+
+
+
+
+
+/* Width (and height) of the thumbnails of `ps_size` arcseconds, as
+   in stitchandcrop(). Zero if it is smaller than one pixel. */
+size_t
+tifaacropside(struct tifaasurvey *s, double ps_size)
+{
+  size_t crop_side=ps_size/s->res;
+  if (crop_side%2==0 && crop_side>0) crop_side-=1;
+  return crop_side;
+}
+
+
+
+
+
+
+
+
+
+
+
+
+
+
+
+
+
+
+
+
+/******************************************************************/
+/****************           Cropping          *********************/
+/******************************************************************/
+/* Open survey image `index` (and its weight if `weight==1`) if no
+   previous target has. The tile's mutex has to be locked. */
+int
+opentile(struct tifaasurvey *s, size_t index, int weight, int *status)
+{
+  int err, w_status=0;
+  char *header=NULL;
+  size_t hsize=0;
+  struct tifaatile *t=&s->tiles[index];
+
+  if(t->fptr==NULL)
+    {
+      err=prepare_fitswcs(s->imgnames[index], &t->fptr, status, &w_status,
+			  &t->nwcs, &t->wcs, &s->wm, &header, &hsize, NULL);
+      free(header);
+      if(err) return err;
+      fits_get_img_size(t->fptr, 2, t->naxes, status);
+      if(*status) return TIFAA_EFITS;
+    }
+  if(weight && t->wfptr==NULL)
+    {
+      fits_open_image(&t->wfptr, s->whtnames[index], READONLY, status);
+      if(*status) return TIFAA_EFITS;
+    }
+  return TIFAA_OK;
+}
+
+
+
+
+
+/* Read the pixels from `fpixel` to `lpixel` of survey image `img`
+   (or its weight if `layer==1`) into `out`, which has `stride` pixels
+   in each row. With a cache, the pixels come from its blocks.
+   Otherwise each row is read directly into its place, or if the
+   image is Rice compressed and indexed (see fitsfz.h), the whole
+   region is decoded at once (each compression tile only once) and
+   then copied. */
+void
+readregion(struct tifaasurvey *s, size_t img, int layer, fitsfile *fptr,
+	   long *naxes, long *fpixel, long *lpixel, float nulval,
+	   float *out, size_t stride, int *status)
+{
+  float *buf;
+  int anynul=0;
+  long row, fp[2], lp[2], inc[2]={1,1};
+  struct fzindex *fz = layer ? &s->wfz[img] : &s->fz[img];
+  size_t width=lpixel[0]-fpixel[0]+1, height=lpixel[1]-fpixel[1]+1;
+
+  if(s->cache)
+    {
+      bcread(s->cache, img, layer, fptr, fz, naxes, fpixel, lpixel,
+	     nulval, out, stride, status);
+      return;
+    }
+
+  if(fz->rice)
+    {
+      if( (buf=malloc(width*height*sizeof *buf))==NULL )
+	{
+	  *status=MEMORY_ALLOCATION;
+	  return;
+	}
+      fzreadsubset(fptr, fz, fpixel, lpixel, nulval, buf, NULL, status);
+      for(row=0;row<(long)height;++row)
+	memcpy(&out[row*stride], &buf[row*width], width*sizeof *out);
+      free(buf);
+      return;
+    }
+
+  for(row=0;row<(long)height;++row)
+    {
+      fp[0]=fpixel[0]; fp[1]=lp[1]=fpixel[1]+row;
+      lp[0]=lpixel[0];
+      fits_read_subset_flt(fptr, 0, 2, naxes, fp, lp, inc, nulval,
+			   &out[row*stride], &anynul, status);
+    }
+}
+
+
+
+
+
+/* Crop one target into the `crop_side*crop_side` array `out`. The
+   pixels of each survey image are read directly into their place in
+   `out` (see readregion()), the weights into a second array of the
+   same size. If `write_fptr!=NULL`, the WCS of the first image is
+   also written in its header (see hdrwrite()). Like the log of
+   `tifaa`, `info->numimg` only counts the images that have pixels in
+   the thumbnail, if none do, it is TIFAA_NOTINFIELD. */
+int
+croponetarget(struct tifaasurvey *s, double *world, double ps_size,
+	      int weight, long chk_size, size_t crop_side, float *out,
+	      fitsfile *write_fptr, struct tifaacropinfo *info)
+{
+  struct tifaatile *t;
+  float *wout=NULL, nulval=-9999;
+  uint32_t stackimgs[LT_STACKIMGS], *imgs=stackimgs;
+  size_t j, numcand, width, start;
+  int stat[NWCSFIX], err=TIFAA_OK, first=1;
+  long fpixel_c[2], lpixel_c[2], fpixel_i[2], lpixel_i[2];
+  long row, shift[2];
+  double phi, theta, imgcrd[2], pixcrd[2];
+
+  memset(out, 0, crop_side*crop_side*sizeof *out);
+  info->fitsstatus=0;
+  info->firstimg=NONINDEX;
+  info->crpix[0]=info->crpix[1]=0.0;
+  info->numimg=0;
+
+  /* Find the images whose footprint overlaps the thumbnail. */
+  numcand=imagesforonetarget(world[0], world[1], crop_side/2.0,
+			     s->imginfo, s->numimg, imgs, LT_STACKIMGS);
+  if(numcand==0)
+    {
+      info->flag=TIFAA_NOTINFIELD;
+      return TIFAA_OK;
+    }
+  if(numcand>LT_STACKIMGS)
+    {
+      if( (imgs=malloc(numcand*sizeof *imgs))==NULL )
+	return TIFAA_ENOMEM;
+      imagesforonetarget(world[0], world[1], crop_side/2.0, s->imginfo,
+			 s->numimg, imgs, numcand);
+    }
+  if(weight && (wout=malloc(crop_side*crop_side*sizeof *wout))==NULL)
+    {
+      if(imgs!=stackimgs) free(imgs);
+      return TIFAA_ENOMEM;
+    }
+
+  for(j=0;j<numcand && err==TIFAA_OK;++j)
+    {
+      t=&s->tiles[imgs[j]];
+      pthread_mutex_lock(&t->m);
+      if( (err=opentile(s, imgs[j], weight, &info->fitsstatus)) )
+	{
+	  pthread_mutex_unlock(&t->m);
+	  break;
+	}
+
+      /* Find the pixel ranges (see find_desired_pixel_range()). */
+      if( wcss2p(t->wcs, 1, 2, world, &phi, &theta, imgcrd, pixcrd, stat) )
+	{
+	  pthread_mutex_unlock(&t->m);
+	  continue;
+	}
+      find_desired_pixel_range(pixcrd, t->naxes[0], t->naxes[1],
+			       crop_side, fpixel_i, lpixel_i, fpixel_c,
+			       lpixel_c);
+      if(fpixel_i[0]>lpixel_i[0] || fpixel_i[1]>lpixel_i[1])
+	{
+	  pthread_mutex_unlock(&t->m);
+	  continue;
+	}
+
+      /* Read the pixels into their place in the thumbnail. */
+      ++info->numimg;
+      width=lpixel_i[0]-fpixel_i[0]+1;
+      start=(fpixel_c[1]-1)*crop_side+fpixel_c[0]-1;
+      readregion(s, imgs[j], 0, t->fptr, t->naxes, fpixel_i, lpixel_i,
+		 nulval, out+start, crop_side, &info->fitsstatus);
+      if(weight)
+	{
+	  readregion(s, imgs[j], 1, t->wfptr, t->naxes, fpixel_i,
+		     lpixel_i, nulval, wout+start, crop_side,
+		     &info->fitsstatus);
+	  for(row=0;row<=lpixel_i[1]-fpixel_i[1];++row)
+	    multiplyweight(out+start+row*crop_side,
+			   wout+start+row*crop_side, width);
+	}
+
+      /* The WCS of the first image is used for the thumbnail. Its
+	 header template is made the first time it is needed (if
+	 wcshdo() fails, hdrwrite() uses addheaderinfo()). */
+      if(first)
+	{
+	  first=0;
+	  shift[0]=(fpixel_i[0]-1)+(fpixel_c[0]-1);
+	  shift[1]=(fpixel_i[1]-1)+(fpixel_c[1]-1);
+	  info->firstimg=imgs[j];
+	  info->crpix[0]=t->wcs->crpix[0]-shift[0];
+	  info->crpix[1]=t->wcs->crpix[1]-shift[1];
+	  if(write_fptr)
+	    {
+	      if(t->hdr.cards==NULL) hdrmake(&t->hdr, t->wcs);
+	      hdrwrite(write_fptr, t->hdr.cards ? &t->hdr : NULL, t->wcs,
+		       fpixel_i, fpixel_c, world, ps_size, s->res,
+		       &info->fitsstatus);
+	    }
+	}
+      pthread_mutex_unlock(&t->m);
+      if(info->fitsstatus) err=TIFAA_EFITS;
+    }
+  if(imgs!=stackimgs) free(imgs);
+  free(wout);
+
+  /* The candidates can all be skipped (the thumbnail's edge is only
+     within the half pixel margin of imagesforonetarget()). */
+  if(info->numimg==0)
+    info->flag=TIFAA_NOTINFIELD;
+  else
+    info->flag = centeriszero(out, crop_side, chk_size)
+      ? TIFAA_BLANK : TIFAA_CROPPED;
+  return err;
+}
+
+
+
+
+
+/* Crop the `n` targets at (`ra[i]`, `dec[i]`) into `out`, which must
+   have space for `n` thumbnails of tifaacropside() pixels on each
+   side. The information of each is put in `info` (which must have
+   `n` elements). `chk_size` is the side of the central box that is
+   checked for zeros (see `-k`). Several threads can call this with
+   the same survey. */
+int
+tifaacrop(struct tifaasurvey *s, size_t n, double *ra, double *dec,
+	  double ps_size, int weight, long chk_size, float *out,
+	  struct tifaacropinfo *info)
+{
+  int err;
+  size_t i, crop_side;
+  double world[2];
+
+  if(s==NULL || ps_size<=0 || (weight && s->whtnames==NULL))
+    return TIFAA_EARGS;
+  if( (crop_side=tifaacropside(s, ps_size))==0 )
+    return TIFAA_EARGS;
+
+  for(i=0;i<n;++i)
+    {
+      world[0]=ra[i]; world[1]=dec[i];
+      if( (err=croponetarget(s, world, ps_size, weight, chk_size,
+			     crop_side, &out[i*crop_side*crop_side], NULL,
+			     &info[i])) )
+	return err;
+    }
+  return TIFAA_OK;
+}
+
+
+
+
+
+/* Crop one target into the FITS file `name` with the WCS and other
+   information that TIFAA writes. The file is only kept if the flag
+   in `info` is TIFAA_CROPPED. */
+int
+tifaacropfile(struct tifaasurvey *s, double ra, double dec,
+	      double ps_size, int weight, long chk_size, char *name,
+	      struct tifaacropinfo *info)
+{
+  int err, status=0;
+  float *out;
+  size_t crop_side;
+  long onaxes[2];
+  double world[2]={ra, dec};
+  fitsfile *write_fptr=NULL;
+
+  if(s==NULL || name==NULL || ps_size<=0 || (weight && s->whtnames==NULL))
+    return TIFAA_EARGS;
+  if( (crop_side=tifaacropside(s, ps_size))==0 )
+    return TIFAA_EARGS;
+  if( (out=malloc(crop_side*crop_side*sizeof *out))==NULL )
+    return TIFAA_ENOMEM;
+
+  /* The header is written while cropping, the pixels after. */
+  onaxes[0]=onaxes[1]=crop_side;
+  unlink(name);
+  fits_create_file(&write_fptr, name, &status);
+  fits_create_img(write_fptr, FLOAT_IMG, 2, onaxes, &status);
+  if(status)
+    {
+      info->fitsstatus=status;
+      free(out);
+      return TIFAA_EFITS;
+    }
+  err=croponetarget(s, world, ps_size, weight, chk_size, crop_side, out,
+		    write_fptr, info);
+  fits_write_img(write_fptr, TFLOAT, 1, crop_side*crop_side, out,
+		 &info->fitsstatus);
+  fits_close_file(write_fptr, &info->fitsstatus);
+  if(err==TIFAA_OK && info->fitsstatus) err=TIFAA_EFITS;
+
+  if(err || info->flag!=TIFAA_CROPPED)
+    unlink(name);
+  free(out);
+  return err;
+}
@@ -0,0 +1,102 @@
+/*********************************************************************
+tifaa - Thumbnail images from astronomical archives
+A simple set of functions to crop thumbnails from astronomical archives.
+
+Copyright (C) 2013-2014 Mohammad Akhlaghi
+Tohoku University Astronomical Institute, Sendai, Japan.
+http://astr.tohoku.ac.jp/~akhlaghi/
+
+tifaa is free software: you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation, either version 3 of the License, or
+(at your option) any later version.
+
+tifaa is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with tifaa.  If not, see <http://www.gnu.org/licenses/>.
+**********************************************************************/
+#ifndef LIBTIFAA_H
+#define LIBTIFAA_H
+
+/* The TIFAA library: Crop thumbnails from a survey inside another
+   program. None of these functions exit the program, they all return
+   one of the error codes below. A survey can be used by several
+   threads at the same time.
+
+   An example (without checking the returned values):
+
+       struct tifaasurvey *s;
+       tifaaopen(&s, imgnames, NULL, numimg, 0.03, 8, NULL);
+       side=tifaacropside(s, 5);
+       out=malloc(n*side*side*sizeof *out);
+       tifaacrop(s, n, ra, dec, 5, 0, 3, out, info);
+       tifaaclose(s);                                                 */
+
+#include <stddef.h>
+
+/* The library is built with hidden symbols, only these functions are
+   exported. */
+#if defined(__GNUC__)
+#define TIFAA_API __attribute__((visibility("default")))
+#else
+#define TIFAA_API
+#endif
+
+/* Error codes returned by the functions. */
+#define TIFAA_OK          0     /* No error.                            */
+#define TIFAA_ENOMEM      1     /* Not enough memory.                   */
+#define TIFAA_EFITS       2     /* CFITSIO error (see `fitsstatus`).    */
+#define TIFAA_EWCS        3     /* WCSLIB couldn't read or use the WCS. */
+#define TIFAA_EARGS       4     /* Bad arguments.                       */
+
+/* Flag of each thumbnail (the same values as in tifaalog.txt). */
+#define TIFAA_CROPPED     0     /* Thumbnail is ready.                  */
+#define TIFAA_BLANK       1     /* The central region is zero.          */
+#define TIFAA_NOTINFIELD  2     /* No survey image covers the target.   */
+
+/* The survey: Its images, their positions and the images that are
+   kept open between calls. Only used through the functions below. */
+struct tifaasurvey;
+
+/* Information about one thumbnail. The WCS of the thumbnail is that
+   of survey image `firstimg` with CRPIX replaced by `crpix`. */
+struct tifaacropinfo
+{
+  int           flag;  /* TIFAA_CROPPED, TIFAA_BLANK or NOTINFIELD.    */
+  size_t      numimg;  /* Number of survey images used.                */
+  size_t    firstimg;  /* Index of the image the WCS comes from.       */
+  double    crpix[2];  /* CRPIX of the thumbnail on that WCS.          */
+  int     fitsstatus;  /* CFITSIO status when TIFAA_EFITS is returned. */
+};
+
+TIFAA_API int
+tifaaopen(struct tifaasurvey **survey, char **imgnames, char **whtnames,
+	  size_t numimg, double res, size_t numthrd, size_t *badimg);
+
+TIFAA_API size_t
+tifaacropside(struct tifaasurvey *survey, double ps_size);
+
+TIFAA_API int
+tifaasetcache(struct tifaasurvey *survey, size_t bytes);
+
+TIFAA_API int
+tifaacrop(struct tifaasurvey *survey, size_t n, double *ra, double *dec,
+	  double ps_size, int weight, long chk_size, float *out,
+	  struct tifaacropinfo *info);
+
+TIFAA_API int
+tifaacropfile(struct tifaasurvey *survey, double ra, double dec,
+	      double ps_size, int weight, long chk_size, char *name,
+	      struct tifaacropinfo *info);
+
+TIFAA_API const char *
+tifaastrerror(int code);
+
+TIFAA_API void
+tifaaclose(struct tifaasurvey *survey);
+
+#endif
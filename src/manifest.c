@@ -0,0 +1,311 @@
+/*********************************************************************
+tifaa - Thumbnail images from astronomical archives
+A simple set of functions to crop thumbnails from astronomical archives.
+
+Copyright (C) 2013-2014 Mohammad Akhlaghi
+Tohoku University Astronomical Institute, Sendai, Japan.
+http://astr.tohoku.ac.jp/~akhlaghi/
+
+tifaa is free software: you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation, either version 3 of the License, or
+(at your option) any later version.
+
+tifaa is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with tifaa.  If not, see <http://www.gnu.org/licenses/>.
+**********************************************************************/
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <assert.h>
+
+#include "tifaa.h"
+#include "fitsfz.h"
+#include "libtifaa.h"
+#include "surveyimginfo.h"
+#include "survey.h"
+#include "manifest.h"
+
+
+
+
+
+
+
+
+
+
+
+
+
+
+
+
+
+
+
+
+/******************************************************************/
+/****************       Reading the file       ********************/
+/******************************************************************/
+void
+manifesterror(char *filename, size_t line, char *message)
+{
+  printf("\nError: %s:%lu: %s. TIFAA aborted.\n\n", filename, line,
+	 message);
+  exit(EXIT_FAILURE);
+}
+
+
+
+
+
+/* A copy of `name`, with `[hdu]` after it (for CFITSIO) if `hdu`
+   isn't `-`. */
+char *
+manifestname(char *name, char *hdu, char *filename, size_t line)
+{
+  char *out, *tailptr;
+
+  if(strcmp(hdu, "-")==0)
+    {
+      assert( (out=malloc(strlen(name)+1))!=NULL );
+      strcpy(out, name);
+    }
+  else
+    {
+      if(strtol(hdu, &tailptr, 10)<0 || *tailptr!='\0' || tailptr==hdu)
+	manifesterror(filename, line, "the HDU has to be a non-negative "
+		      "integer or `-`");
+      assert( (out=malloc(strlen(name)+strlen(hdu)+3))!=NULL );
+      sprintf(out, "%s[%s]", name, hdu);
+    }
+  return out;
+}
+
+
+
+
+
+/* Add one line (already broken into its `n` words) to `m`. */
+void
+manifestline(struct manifest *m, char **words, size_t n, char *filename,
+	     size_t line)
+{
+  size_t i, c=m->names.gl_pathc;
+  char *tailptr, *hdu=words[2], *whdu;
+
+  if(n!=3 && n!=3+NUM_IMAGEINFO_COLS)
+    manifesterror(filename, line, "each line needs a path, a weight "
+		  "(or `-`), an HDU (or `-`, optionally followed by `,` "
+		  "and the HDU of the weight) and optionally the "
+		  "footprint");
+  if( c>0 && (strcmp(words[1], "-")==0) != (m->wnames.gl_pathc==0) )
+    manifesterror(filename, line, "the weight has to be given for all "
+		  "the images or for none");
+
+  /* Make sure there is space for this image. */
+  if(c==m->size)
+    {
+      m->size*=2;
+      assert( (m->names.gl_pathv=realloc(m->names.gl_pathv, (m->size+1)
+				      *sizeof *m->names.gl_pathv))!=NULL );
+      assert( (m->wnames.gl_pathv=realloc(m->wnames.gl_pathv, (m->size+1)
+				      *sizeof *m->wnames.gl_pathv))!=NULL );
+      assert( (m->rows=realloc(m->rows, m->size*NUM_IMAGEINFO_COLS
+			       *sizeof *m->rows))!=NULL );
+      assert( (m->known=realloc(m->known, m->size
+				*sizeof *m->known))!=NULL );
+    }
+
+  /* The names (the weight in the same HDU as the image, unless its
+     own HDU is given after a comma). */
+  if( (whdu=strchr(hdu, ','))!=NULL )
+    *whdu++='\0';
+  else
+    whdu=hdu;
+  m->names.gl_pathv[c]=manifestname(words[0], hdu, filename, line);
+  if(strcmp(words[1], "-"))
+    m->wnames.gl_pathv[m->wnames.gl_pathc++]=manifestname(words[1], whdu,
+							 filename, line);
+
+  /* The footprint. */
+  m->known[c] = n>3;
+  for(i=3;i<n;++i)
+    {
+      m->rows[c*NUM_IMAGEINFO_COLS+i-3]=strtod(words[i], &tailptr);
+      if(*tailptr!='\0')
+	manifesterror(filename, line, "the footprint has to be numbers");
+    }
+  ++m->names.gl_pathc;
+}
+
+
+
+
+
+void
+manifestread(char *filename, struct manifest *m)
+{
+  FILE *fp;
+  char *buf=NULL, *c, *save;
+  size_t n, bufsize=0, line=0;
+  char *words[3+NUM_IMAGEINFO_COLS+1];
+
+  if( (fp=fopen(filename, "r"))==NULL )
+    {
+      printf("\nError: Cannot open the manifest %s. TIFAA aborted.\n\n",
+	     filename);
+      exit(EXIT_FAILURE);
+    }
+
+  memset(m, 0, sizeof *m);
+  m->size=MANIFESTSIZE;
+  assert( (m->names.gl_pathv=malloc((m->size+1)
+				    *sizeof *m->names.gl_pathv))!=NULL );
+  assert( (m->wnames.gl_pathv=malloc((m->size+1)
+				     *sizeof *m->wnames.gl_pathv))!=NULL );
+  assert( (m->rows=malloc(m->size*NUM_IMAGEINFO_COLS
+			  *sizeof *m->rows))!=NULL );
+  assert( (m->known=malloc(m->size*sizeof *m->known))!=NULL );
+
+  while(getline(&buf, &bufsize, fp)!=-1)
+    {
+      ++line;
+      n=0;
+      for(c=strtok_r(buf, " \t\r\n", &save);
+	  c && n<sizeof words/sizeof *words;
+	  c=strtok_r(NULL, " \t\r\n", &save))
+	words[n++]=c;
+      if(n==0 || words[0][0]=='#') continue;
+      manifestline(m, words, n, filename, line);
+    }
+  free(buf);
+  fclose(fp);
+
+  if(m->names.gl_pathc==0)
+    {
+      printf("\nError: There are no images in the manifest %s. "
+	     "TIFAA aborted.\n\n", filename);
+      exit(EXIT_FAILURE);
+    }
+  m->names.gl_pathv[m->names.gl_pathc]=NULL;
+  m->wnames.gl_pathv[m->wnames.gl_pathc]=NULL;
+}
+
+
+
+
+
+
+
+
+
+
+
+
+
+
+
+
+
+
+
+
+/******************************************************************/
+/****************       Outside function       ********************/
+/******************************************************************/
+/* Read the images of the first band (and their weights) from the
+   manifest `filename` into `p->survglob` (and `p->wsurvglob`). Unless
+   it is a server (where tifaaopen() reads the survey), `p->imginfo`
+   and `p->fzindex` are also filled here (like discoversurvey()): the
+   WCS of the images with a footprint in the manifest isn't read, but
+   (like planindex()) their compression tiles are still indexed for
+   fzreadsubset(). Both are done on all the threads. */
+void
+readmanifest(struct tifaaparams *p, char *filename)
+{
+  int err;
+  struct manifest m;
+  double *info=NULL;
+  char **names=NULL;
+  struct fzindex *fz=NULL;
+  size_t i, j, k, n, nread, badimg;
+
+  manifestread(filename, &m);
+  n=m.names.gl_pathc;
+
+  /* Weights are either in the manifest or not used in this band. */
+  if(p->weightmultip && m.wnames.gl_pathc==0)
+    {
+      printf("\nError: `-w` was given, but there are no weights in the "
+	     "manifest %s. TIFAA aborted.\n\n", filename);
+      exit(EXIT_FAILURE);
+    }
+  p->weightmultip = m.wnames.gl_pathc>0;
+  p->survglob=m.names;
+  p->wsurvglob=m.wnames;
+  if(p->socket_name)
+    {
+      free(m.rows);
+      free(m.known);
+      return;
+    }
+
+  /* The images without a footprint (first in `names`) are read, the
+     others are only indexed. */
+  assert( (p->imginfo=malloc(n*NUM_IMAGEINFO_COLS
+			     *sizeof *p->imginfo))!=NULL );
+  assert( (p->fzindex=calloc(p->numbands*n, sizeof *p->fzindex))!=NULL );
+  for(nread=i=0;i<n;++i)
+    nread += m.known[i]==0;
+  assert( (names=malloc(n*sizeof *names))!=NULL );
+  assert( (fz=calloc(n, sizeof *fz))!=NULL );
+  for(j=0, k=nread, i=0;i<n;++i)
+    names[ m.known[i] ? k++ : j++ ]=m.names.gl_pathv[i];
+  if(nread)
+    {
+      assert( (info=malloc(nread*NUM_IMAGEINFO_COLS
+			   *sizeof *info))!=NULL );
+      err=surveyimageinfo(names, NULL, nread, p->res, p->numthrd, info, fz,
+			  NULL, &badimg);
+      if(err)
+	exitonerror(err, names[badimg], 0, 0);
+    }
+  if(n>nread)
+    {
+      err=surveyimageinfo(names+nread, NULL, n-nread, p->res, p->numthrd,
+			  NULL, fz+nread, NULL, &badimg);
+      if(err)
+	exitonerror(err, names[nread+badimg], 0, 0);
+    }
+
+  /* Put all the rows in `p->imginfo`. */
+  for(j=0, k=nread, i=0;i<n;++i)
+    if(m.known[i])
+      {
+	memcpy(&p->imginfo[i*NUM_IMAGEINFO_COLS],
+	       &m.rows[i*NUM_IMAGEINFO_COLS],
+	       NUM_IMAGEINFO_COLS*sizeof *p->imginfo);
+	p->fzindex[i]=fz[k++];
+      }
+    else
+      {
+	memcpy(&p->imginfo[i*NUM_IMAGEINFO_COLS],
+	       &info[j*NUM_IMAGEINFO_COLS],
+	       NUM_IMAGEINFO_COLS*sizeof *p->imginfo);
+	p->fzindex[i]=fz[j++];
+      }
+  p->indexed=1;
+
+  free(fz);
+  free(info);
+  free(names);
+  free(m.rows);
+  free(m.known);
+}
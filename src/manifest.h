@@ -0,0 +1,53 @@
+/*********************************************************************
+tifaa - Thumbnail images from astronomical archives
+A simple set of functions to crop thumbnails from astronomical archives.
+
+Copyright (C) 2013-2014 Mohammad Akhlaghi
+Tohoku University Astronomical Institute, Sendai, Japan.
+http://astr.tohoku.ac.jp/~akhlaghi/
+
+tifaa is free software: you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation, either version 3 of the License, or
+(at your option) any later version.
+
+tifaa is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with tifaa.  If not, see <http://www.gnu.org/licenses/>.
+**********************************************************************/
+#ifndef MANIFEST_H
+#define MANIFEST_H
+
+#include <glob.h>
+
+#define MANIFESTSIZE      1024  /* Initial number of images.          */
+
+/* The images of the first band read from a manifest (`-M`) instead
+   of a wildcard. Each line is one image:
+
+       PATH  WEIGHT  HDU  [FOOTPRINT]
+
+   WEIGHT is the weight image of PATH (`-` for none, it has to be
+   given for all the images or for none), HDU the HDU to use (counting
+   from 0, `-` for the first image; the weight image is read from the
+   same HDU, unless its own is given after a comma: `HDU,WHDU`) and
+   FOOTPRINT, if present, the NUM_IMAGEINFO_COLS values that are
+   otherwise found from the WCS of the image (see imagefootprint()).
+   Empty lines and lines starting with `#` are ignored. */
+struct manifest
+{
+  glob_t         names;  /* The images (with their HDU).               */
+  glob_t        wnames;  /* Their weights (if there are any).          */
+  double         *rows;  /* Footprint of each image.                   */
+  unsigned char *known;  /* ==1: The footprint of this image is given. */
+  size_t          size;  /* Allocated elements in the arrays above.    */
+};
+
+void
+readmanifest(struct tifaaparams *p, char *filename);
+
+#endif
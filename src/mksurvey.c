@@ -0,0 +1,613 @@
+/*********************************************************************
+mksurvey - Make a synthetic tiled survey to test and benchmark tifaa.
+A simple set of functions to crop thumbnails from astronomical archives.
+
+Copyright (C) 2013-2014 Mohammad Akhlaghi
+Tohoku University Astronomical Institute, Sendai, Japan.
+http://astr.tohoku.ac.jp/~akhlaghi/
+
+tifaa is free software: you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation, either version 3 of the License, or
+(at your option) any later version.
+
+tifaa is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with tifaa.  If not, see <http://www.gnu.org/licenses/>.
+**********************************************************************/
+#include <math.h>
+#include <ctype.h>
+#include <float.h>
+#include <limits.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <assert.h>
+#include <string.h>
+#include <unistd.h>
+#include <sys/stat.h>
+
+#include <fitsio.h>
+#include <wcslib/wcs.h>
+#include <wcslib/wcsfix.h>
+
+#define MKSURVEYVERSION "v0.1"
+#define STAMPHW         10      /* Half width of each mock galaxy.   */
+#define BLANKSTRIP      20      /* Width of the blank and zero edges. */
+#define CRPIXFRAC       0.123456789012345 /* Fraction of CRPIX (-E).  */
+#define CRPIXOBJS       64      /* Objects next to CRPIX with `-E`.   */
+
+
+
+
+
+/* All the mock surveys are on one TAN projected grid (like the
+   tiles of real surveys that were drizzled onto one grid), the
+   tiles are different sections of that grid. */
+struct mksurveyparams
+{
+  char     *out_name;  /* Directory to keep the tiles and catalog.   */
+  size_t      numimg;  /* Number of tiles.                           */
+  long          side;  /* Side of each tile in pixels.               */
+  long       overlap;  /* Overlap of tiles (<0: gaps) in pixels.     */
+  int         bitpix;  /* BITPIX of the tiles.                       */
+  char         *comp;  /* Compression: none, rice, gzip or hcomp.    */
+  long         ztile;  /* Side of compression tiles (0: rows).       */
+  int        weights;  /* ==1: Also make weight images.              */
+  int        wbitpix;  /* BITPIX of the weight images.               */
+  int         blanks;  /* ==1: Blank and zero edges (integers).      */
+  int         crpixe;  /* ==1: CRPIX of some thumbnails needs E.     */
+  double         res;  /* Resolution in arcseconds/pixel.            */
+  double          ra;  /* RA of the survey center.                   */
+  double         dec;  /* Dec of the survey center.                  */
+  size_t      numobj;  /* Number of objects in catalog.              */
+  size_t  numcluster;  /* Number of clusters (0: uniform).           */
+  double     clsigma;  /* Size of each cluster (arcseconds).         */
+  unsigned      seed;  /* Seed for the random number generator.      */
+
+  /* Internal: */
+  size_t       ncols;  /* Number of tiles along the first axis.      */
+  size_t       nrows;  /* Number of tiles along the second axis.     */
+  long       gnaxis1;  /* Size of the full grid along the first axis. */
+  long       gnaxis2;  /* Size of the full grid along the second axis.*/
+  double        *cat;  /* RA and Dec of the objects.                 */
+  struct wcsprm  wcs;  /* WCS of the full grid.                      */
+};
+
+
+
+
+
+
+
+
+
+
+
+
+
+
+
+
+
+
+
+
+/*************************************************************/
+/*****************     Random numbers     ********************/
+/*************************************************************/
+/* The C library's rand() is not guaranteed to give the same results
+   on different systems, so a simple generator (xorshift) is used
+   here to make exactly the same survey everywhere. */
+double
+uniformrand(unsigned *state)
+{
+  *state ^= *state<<13;
+  *state ^= *state>>17;
+  *state ^= *state<<5;
+  return (*state%1000000000)/1e9;
+}
+
+
+
+
+
+/* Box-Muller transform. */
+double
+gaussianrand(unsigned *state)
+{
+  double u1, u2;
+  do u1=uniformrand(state); while(u1==0.0f);
+  u2=uniformrand(state);
+  return sqrt(-2*log(u1))*cos(2*M_PI*u2);
+}
+
+
+
+
+
+
+
+
+
+
+
+
+
+
+
+
+
+
+
+
+/*************************************************************/
+/*****************      Make the survey     ******************/
+/*************************************************************/
+/* WCS of the full grid: the reference pixel is its center (moved by
+   CRPIXFRAC with `-E`). */
+void
+makegridwcs(struct mksurveyparams *p)
+{
+  int status;
+
+  p->wcs.flag=-1;
+  assert( wcsini(1, 2, &p->wcs)==0 );
+  strcpy(p->wcs.ctype[0], "RA---TAN");
+  strcpy(p->wcs.ctype[1], "DEC--TAN");
+  p->wcs.crval[0]=p->ra;
+  p->wcs.crval[1]=p->dec;
+  p->wcs.crpix[0]=p->gnaxis1/2.0f + (p->crpixe ? CRPIXFRAC : 0);
+  p->wcs.crpix[1]=p->gnaxis2/2.0f + (p->crpixe ? CRPIXFRAC : 0);
+  p->wcs.cdelt[0]=-1*p->res/3600;
+  p->wcs.cdelt[1]=p->res/3600;
+  if( (status=wcsset(&p->wcs)) )
+    {
+      fprintf(stderr, "wcsset ERROR %d: %s.\n", status,
+	      wcs_errmsg[status]);
+      exit(EXIT_FAILURE);
+    }
+}
+
+
+
+
+
+/* Put the objects in the survey area. 10% of the area around the
+   survey is also included so some of the objects are not in the
+   field and some are on the borders. Each object also gets a
+   thumbnail size (for `-P` of TIFAA), from 10 to 25 arcseconds, or 0
+   (not given) for every fifth. With `-E`, the last CRPIXOBJS
+   objects are on a diagonal from the reference pixel, so it is near
+   the corner of some thumbnails (of any size up to 2*CRPIXOBJS
+   pixels): their CRPIX is then below 1 (with 15 significant digits)
+   on one axis and above 10 on the other, which WCSLIB writes with an
+   exponent. */
+void
+makecatalog(struct mksurveyparams *p)
+{
+  FILE *fp;
+  size_t i, c;
+  char name[5000];
+  int stat[NWCSFIX];
+  unsigned seed=p->seed;
+  double *centers=NULL, pixcrd[2], imgcrd[2], phi, theta;
+
+  assert( (p->cat=malloc(2*p->numobj*sizeof *p->cat))!=NULL );
+  if(p->numcluster)
+    assert( (centers=malloc(2*p->numcluster*sizeof *centers))!=NULL );
+
+  /* Random positions in pixel coordinates of the full grid. */
+  for(i=0;i<p->numcluster;++i)
+    {
+      centers[i*2  ]=(uniformrand(&p->seed)*1.1-0.05)*p->gnaxis1;
+      centers[i*2+1]=(uniformrand(&p->seed)*1.1-0.05)*p->gnaxis2;
+    }
+  for(i=0;i<p->numobj;++i)
+    {
+      if(p->numcluster)
+	{
+	  c=i%p->numcluster;
+	  pixcrd[0]=( centers[c*2]
+		      + gaussianrand(&p->seed)*p->clsigma/p->res );
+	  pixcrd[1]=( centers[c*2+1]
+		      + gaussianrand(&p->seed)*p->clsigma/p->res );
+	}
+      else
+	{
+	  pixcrd[0]=(uniformrand(&p->seed)*1.1-0.05)*p->gnaxis1;
+	  pixcrd[1]=(uniformrand(&p->seed)*1.1-0.05)*p->gnaxis2;
+	}
+      if(p->crpixe && i+CRPIXOBJS>=p->numobj)
+	{
+	  pixcrd[0]=p->wcs.crpix[0]+(p->numobj-i);
+	  pixcrd[1]=p->wcs.crpix[1]+(p->numobj-i)+20;
+	}
+      assert( wcsp2s(&p->wcs, 1, 2, pixcrd, imgcrd, &phi, &theta,
+		     &p->cat[i*2], stat)==0 );
+    }
+
+  sprintf(name, "%scat.txt", p->out_name);
+  assert( (fp=fopen(name, "w"))!=NULL );
+  fprintf(fp, "# Synthetic catalog made by mksurvey %s (seed %u).\n"
+	  "# Col 0: ID.\n# Col 1: RA.\n# Col 2: Dec.\n"
+	  "# Col 3: Thumbnail size (arcseconds, 0: not given).\n",
+	  MKSURVEYVERSION, seed);
+  for(i=0;i<p->numobj;++i)
+    fprintf(fp, "%-8lu %-15.10f %-15.10f %-4d\n", i+1, p->cat[i*2],
+	    p->cat[i*2+1], i%5==4 ? 0 : 10+5*(int)(i%4));
+  fclose(fp);
+
+  free(centers);
+}
+
+
+
+
+
+/* Name of the tile, with the compression specification for cfitsio
+   (it will only be used when creating the file). */
+void
+tilename(struct mksurveyparams *p, size_t i, int weight, char *name,
+	 int forcreate)
+{
+  char comp[100]="";
+
+  if(strcmp(p->comp, "none") && !weight)
+    {
+      if(forcreate)
+	{
+	  if(p->ztile)
+	    sprintf(comp, "[compress %c %ld,%ld]", toupper(p->comp[0]),
+		    p->ztile, p->ztile);
+	  else
+	    sprintf(comp, "[compress %c]", toupper(p->comp[0]));
+	}
+      sprintf(name, "%stile%04lu_sci.fits.fz%s", p->out_name, i, comp);
+    }
+  else
+    sprintf(name, "%stile%04lu_%s.fits", p->out_name, i,
+	    weight ? "wht" : "sci");
+}
+
+
+
+
+
+/* The BLANK of integer images with `bitpix` (with `-B`). The pixels
+   are clamped so no other pixel has this value. */
+long
+blankvalue(int bitpix, float *min, float *max)
+{
+  if(bitpix==BYTE_IMG)
+    {
+      *max=UCHAR_MAX-1;
+      return UCHAR_MAX;
+    }
+  *min=0;
+  return -1;
+}
+
+
+
+
+
+/* With `-B`, the integer image `img` gets a BLANK keyword (`blank`),
+   the pixels of its `blankedge` edge (0: bottom, 1: top, 2: left, 3:
+   right) are blank and those of its `zeroedge` edge are zero (like a
+   masked region or no exposure). */
+void
+blankedges(fitsfile *fptr, float *img, long side, long blank,
+	   int blankedge, int zeroedge, int *status)
+{
+  int e;
+  long x, y;
+  float v;
+
+  for(e=0;e<4;++e)
+    {
+      if(e!=blankedge && e!=zeroedge) continue;
+      v = e==blankedge ? blank : 0;
+      for(y=0;y<side;++y)
+	for(x=0;x<side;++x)
+	  if( (e==0 && y<BLANKSTRIP) || (e==1 && y>=side-BLANKSTRIP)
+	      || (e==2 && x<BLANKSTRIP) || (e==3 && x>=side-BLANKSTRIP) )
+	    img[y*side+x]=v;
+    }
+  fits_write_key_lng(fptr, "BLANK", blank, "Value of blank pixels.",
+		     status);
+}
+
+
+
+
+
+/* The pixel values are Gaussian noise with a mock (Gaussian) galaxy
+   on each object. Integer types are scaled and shifted to fit in
+   their range, the few pixels that are still out of it (where
+   galaxies overlap or in the tails of the noise) are clamped. */
+void
+maketile(struct mksurveyparams *p, size_t i)
+{
+  fitsfile *fptr;
+  char name[5000];
+  size_t o, npix;
+  int status=0, stat[NWCSFIX];
+  float *img, *f, *ff, zero, scale, min=-FLT_MAX, max=FLT_MAX;
+  float wmin=-FLT_MAX, wmax=FLT_MAX;
+  long naxes[2], x0, y0, x, y, px, py, blank=0, wblank=0;
+  double crpix[2], pixcrd[2], imgcrd[2], phi, theta, amp;
+
+  /* Position of this tile in the full grid. */
+  x0=(i%p->ncols)*(p->side-p->overlap);
+  y0=(i/p->ncols)*(p->side-p->overlap);
+  naxes[0]=naxes[1]=p->side;
+  npix=p->side*p->side;
+  assert( (img=malloc(npix*sizeof *img))!=NULL );
+
+  /* Values in the different types. */
+  switch(p->bitpix)
+    {
+    case BYTE_IMG:
+      zero=30;   scale=5;   min=0;         max=UCHAR_MAX;  break;
+    case SHORT_IMG:
+      zero=1000; scale=100; min=SHRT_MIN;  max=SHRT_MAX;   break;
+    case LONG_IMG:
+      zero=1000; scale=100; break;
+    default:
+      zero=0;    scale=1;
+    }
+  if(p->blanks && p->bitpix>0)
+    blank=blankvalue(p->bitpix, &min, &max);
+
+  /* Noise, (the seed also depends on the tile so the tiles can be
+     made in any order). */
+  p->seed+=i;
+  ff=(f=img)+npix;
+  do *f=zero+scale*gaussianrand(&p->seed); while(++f<ff);
+
+  /* The mock galaxies. */
+  for(o=0;o<p->numobj;++o)
+    {
+      assert( wcss2p(&p->wcs, 1, 2, &p->cat[o*2], &phi, &theta, imgcrd,
+		     pixcrd, stat)==0 );
+      px=pixcrd[0]-x0; py=pixcrd[1]-y0;
+      if(px<-STAMPHW || px>p->side+STAMPHW
+	 || py<-STAMPHW || py>p->side+STAMPHW)
+	continue;
+      amp=scale*(5+(o%20));
+      for(y=py-STAMPHW;y<=py+STAMPHW;++y)
+	for(x=px-STAMPHW;x<=px+STAMPHW;++x)
+	  if(x>=1 && x<=p->side && y>=1 && y<=p->side)
+	    img[(y-1)*p->side+x-1]+=amp*exp( -1*((x-px)*(x-px)
+				       +(y-py)*(y-py))/8.0f );
+    }
+
+  for(f=img;f<ff;++f)
+    *f = *f<min ? min : (*f>max ? max : *f);
+
+  /* Write the science image. */
+  crpix[0]=p->wcs.crpix[0]-x0;
+  crpix[1]=p->wcs.crpix[1]-y0;
+  tilename(p, i, 0, name, 0);
+  unlink(name);
+  tilename(p, i, 0, name, 1);
+  fits_create_file(&fptr, name, &status);
+  fits_create_img(fptr, p->bitpix, 2, naxes, &status);
+  if(p->blanks && p->bitpix>0)
+    blankedges(fptr, img, p->side, blank, 1, 3, &status);
+  fits_write_img(fptr, TFLOAT, 1, npix, img, &status);
+  fits_write_key(fptr, TSTRING, "CTYPE1", "RA---TAN", NULL, &status);
+  fits_write_key(fptr, TSTRING, "CTYPE2", "DEC--TAN", NULL, &status);
+  fits_write_key(fptr, TDOUBLE, "CRPIX1", &crpix[0], NULL, &status);
+  fits_write_key(fptr, TDOUBLE, "CRPIX2", &crpix[1], NULL, &status);
+  fits_write_key(fptr, TDOUBLE, "CRVAL1", &p->wcs.crval[0], NULL, &status);
+  fits_write_key(fptr, TDOUBLE, "CRVAL2", &p->wcs.crval[1], NULL, &status);
+  fits_write_key(fptr, TDOUBLE, "CD1_1", &p->wcs.cdelt[0], NULL, &status);
+  fits_write_key(fptr, TDOUBLE, "CD2_2", &p->wcs.cdelt[1], NULL, &status);
+  fits_write_comment(fptr, "Synthetic tile made by mksurvey.", &status);
+  fits_close_file(fptr, &status);
+
+  /* The weight image: an exposure map that changes smoothly (smaller
+     for 8-bit weights, to fit in their range). */
+  if(p->weights)
+    {
+      zero  = p->wbitpix==BYTE_IMG ? 50 : 1000;
+      scale = p->wbitpix==BYTE_IMG ? 50 : 100;
+      if(p->blanks && p->wbitpix>0)
+	wblank=blankvalue(p->wbitpix, &wmin, &wmax);
+      for(y=0;y<p->side;++y)
+	for(x=0;x<p->side;++x)
+	  img[y*p->side+x]=zero+(float)(x+y)/p->side*scale;
+      for(f=img;f<ff;++f)
+	*f = *f<wmin ? wmin : (*f>wmax ? wmax : *f);
+      tilename(p, i, 1, name, 0);
+      unlink(name);
+      fits_create_file(&fptr, name, &status);
+      fits_create_img(fptr, p->wbitpix, 2, naxes, &status);
+      if(p->blanks && p->wbitpix>0)
+	blankedges(fptr, img, p->side, wblank, 2, 0, &status);
+      fits_write_img(fptr, TFLOAT, 1, npix, img, &status);
+      fits_close_file(fptr, &status);
+    }
+
+  if(status)
+    {
+      fits_report_error(stderr, status);
+      exit(EXIT_FAILURE);
+    }
+  free(img);
+}
+
+
+
+
+
+
+
+
+
+
+
+
+
+
+
+
+
+
+
+
+/*************************************************************/
+/**************     Read the parameters     ******************/
+/*************************************************************/
+void
+printmksurveyhelp(struct mksurveyparams *p)
+{
+  printf("\n\nmksurvey %s\n"
+	 "============\n"
+	 "Make a synthetic tiled survey and catalog for testing and\n"
+	 "benchmarking TIFAA. All options have a default value.\n\n"
+	 " -h:\n\tPrint this help message.\n\n"
+	 "-o STRING:\n\tDEFAULT: `%s`\n"
+	 "\tDirectory to keep the tiles and catalog (ending with `/`).\n\n"
+	 "-n INTEGER:\n\tDEFAULT: %lu\n\tNumber of tiles.\n\n"
+	 "-x INTEGER:\n\tDEFAULT: %ld\n\tSide of each tile (pixels).\n\n"
+	 "-l INTEGER:\n\tDEFAULT: %ld\n"
+	 "\tOverlap of neighboring tiles (pixels), negative for gaps.\n\n"
+	 "-b INTEGER:\n\tDEFAULT: %d\n"
+	 "\tBITPIX of the tiles (8, 16, 32, -32 or -64).\n\n"
+	 "-z STRING:\n\tDEFAULT: `%s`\n"
+	 "\tCompression of the tiles: `none`, `rice`, `gzip` or `hcomp`.\n\n"
+	 "-T INTEGER:\n\tDEFAULT: %ld\n"
+	 "\tSide of the compression tiles, 0 for one row per tile.\n\n"
+	 "-w:\n\tAlso make weight images.\n\n"
+	 "-W INTEGER:\n\tDEFAULT: %d\n"
+	 "\tBITPIX of the weight images (8, 16, 32, -32 or -64).\n\n"
+	 "-B:\n\tInteger tiles and weights have a BLANK keyword and blank\n"
+	 "\tpixels on one edge (the top of the tiles, the left of the\n"
+	 "\tweights) and zero pixels on another (their right and bottom).\n\n"
+	 "-E:\n\tMove the reference pixel of the grid by %.15g pixels\n"
+	 "\tand put the last %d objects next to it, so some thumbnails\n"
+	 "\thave a CRPIX that is written with an exponent.\n\n"
+	 "-a FLOAT:\n\tDEFAULT: %.3f\n\tResolution (arcseconds/pixel).\n\n"
+	 "-R FLOAT:\n\tDEFAULT: %.3f\n\tRA of survey center.\n\n"
+	 "-D FLOAT:\n\tDEFAULT: %.3f\n\tDec of survey center.\n\n"
+	 "-c INTEGER:\n\tDEFAULT: %lu\n\tNumber of objects in catalog.\n\n"
+	 "-k INTEGER:\n\tDEFAULT: %lu\n"
+	 "\tNumber of clusters, 0 for a uniform distribution.\n\n"
+	 "-S FLOAT:\n\tDEFAULT: %.3f\n\tSize of clusters (arcseconds).\n\n"
+	 "-r INTEGER:\n\tDEFAULT: %u\n\tRandom number seed.\n\n",
+	 MKSURVEYVERSION, p->out_name, p->numimg, p->side, p->overlap,
+	 p->bitpix, p->comp, p->ztile, p->wbitpix, CRPIXFRAC, CRPIXOBJS,
+	 p->res, p->ra, p->dec, p->numobj, p->numcluster, p->clsigma, p->seed);
+}
+
+
+
+
+
+void
+setmksurveyparams(int argc, char *argv[], struct mksurveyparams *p)
+{
+  int c;
+  char *tailptr;
+
+  p->out_name   = "./synthsurvey/";   p->numimg     = 16;
+  p->side       = 2000;               p->overlap    = 100;
+  p->bitpix     = FLOAT_IMG;          p->comp       = "none";
+  p->ztile      = 0;                  p->weights    = 0;
+  p->wbitpix    = FLOAT_IMG;          p->blanks     = 0;
+  p->crpixe     = 0;
+  p->res        = 0.2;                p->ra         = 150.0;
+  p->dec        = 2.0;                p->numobj     = 1000;
+  p->numcluster = 0;                  p->clsigma    = 30;
+  p->seed       = 1;
+
+  while( (c=getopt(argc, argv, "hwBEo:n:x:l:b:W:z:T:a:R:D:c:k:S:r:")) != -1 )
+    switch(c)
+      {
+      case 'h': printmksurveyhelp(p); exit(EXIT_SUCCESS);
+      case 'w': p->weights=1;                             break;
+      case 'B': p->blanks=1;                              break;
+      case 'E': p->crpixe=1;                              break;
+      case 'o': p->out_name=optarg;                       break;
+      case 'n': p->numimg=strtoul(optarg, &tailptr, 0);   break;
+      case 'x': p->side=strtol(optarg, &tailptr, 0);      break;
+      case 'l': p->overlap=strtol(optarg, &tailptr, 0);   break;
+      case 'b': p->bitpix=strtol(optarg, &tailptr, 0);    break;
+      case 'W': p->wbitpix=strtol(optarg, &tailptr, 0);   break;
+      case 'z': p->comp=optarg;                           break;
+      case 'T': p->ztile=strtol(optarg, &tailptr, 0);     break;
+      case 'a': p->res=strtod(optarg, &tailptr);          break;
+      case 'R': p->ra=strtod(optarg, &tailptr);           break;
+      case 'D': p->dec=strtod(optarg, &tailptr);          break;
+      case 'c': p->numobj=strtoul(optarg, &tailptr, 0);   break;
+      case 'k': p->numcluster=strtoul(optarg, &tailptr, 0); break;
+      case 'S': p->clsigma=strtod(optarg, &tailptr);      break;
+      case 'r': p->seed=strtoul(optarg, &tailptr, 0);     break;
+      case '?':
+	fprintf(stderr, "Unknown option: '-%c'.\n\n", optopt);
+	exit(EXIT_FAILURE);
+      default:
+	abort();
+      }
+
+  if(p->numimg==0 || p->side<=2*STAMPHW || p->overlap>=p->side
+     || p->res<=0 || p->seed==0)
+    {
+      fprintf(stderr, "mksurvey: bad value for -n, -x, -l, -a or -r. "
+	      "See `mksurvey -h`.\n");
+      exit(EXIT_FAILURE);
+    }
+  if(strcmp(p->comp, "none") && strcmp(p->comp, "rice")
+     && strcmp(p->comp, "gzip") && strcmp(p->comp, "hcomp"))
+    {
+      fprintf(stderr, "mksurvey: `%s` is not a known compression.\n",
+	      p->comp);
+      exit(EXIT_FAILURE);
+    }
+
+  /* Tiles are put in a grid that is as close to a square as
+     possible. */
+  p->ncols=ceil(sqrt(p->numimg));
+  p->nrows=(p->numimg+p->ncols-1)/p->ncols;
+  p->gnaxis1=p->ncols*(p->side-p->overlap)+p->overlap;
+  p->gnaxis2=p->nrows*(p->side-p->overlap)+p->overlap;
+
+  mkdir(p->out_name, 0755);
+}
+
+
+
+
+
+int
+main(int argc, char *argv[])
+{
+  size_t i;
+  unsigned seed;
+  struct mksurveyparams p;
+
+  setmksurveyparams(argc, argv, &p);
+  makegridwcs(&p);
+  makecatalog(&p);
+
+  seed=p.seed;
+  for(i=0;i<p.numimg;++i)
+    {
+      p.seed=seed;
+      maketile(&p, i);
+    }
+
+  printf("mksurvey: %lu tiles (%ldx%ld, BITPIX %d, %s) and %lu objects "
+	 "in %s\n", p.numimg, p.side, p.side, p.bitpix, p.comp, p.numobj,
+	 p.out_name);
+
+  free(p.cat);
+  wcsfree(&p.wcs);
+  return 0;
+}
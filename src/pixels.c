@@ -0,0 +1,559 @@
+/*********************************************************************
+tifaa - Thumbnail images from astronomical archives
+A simple set of functions to crop thumbnails from astronomical archives.
+
+Copyright (C) 2013-2014 Mohammad Akhlaghi
+Tohoku University Astronomical Institute, Sendai, Japan.
+http://astr.tohoku.ac.jp/~akhlaghi/
+
+tifaa is free software: you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation, either version 3 of the License, or
+(at your option) any later version.
+
+tifaa is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with tifaa.  If not, see <http://www.gnu.org/licenses/>.
+**********************************************************************/
+#include <stdio.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "pixels.h"
+
+/* Is `v` (of the type of the image) a blank pixel? Only integers can
+   be (`b` is BLANK in their type), blank floats are replaced with
+   `nulval` by CFITSIO when they are read. */
+#define PIXINTBLANK(v, b) ((v)==(b))
+#define PIXNOBLANK(v, b)  ((void)(b), 0)
+
+/* Put `nulval` (whose bits are `nb`) in `v` if `isblank`. With the
+   bits of the floats, so there is no branch and the loops can be
+   vectorized (GCC doesn't if-convert a select between floats). */
+#define PIXSELECT(v, isblank, nb)					\
+  {									\
+    uint32_t r_, m_=-(uint32_t)(isblank);				\
+    memcpy(&r_, &(v), sizeof r_);					\
+    r_=(r_&~m_)|((nb)&m_);						\
+    memcpy(&(v), &r_, sizeof r_);					\
+  }
+
+/* The kernels for science pixels of type `ST` (named `SN`), without a
+   weight. `BLANK` is `PIXNOBLANK` (no blank pixels in this image) or
+   the blank test of this type, so each loop only converts (and
+   scales) the pixels, without any branches. */
+#define PIXKERNEL(NAME, ST, BLANK)					\
+  static void								\
+  NAME(float *out, long stride, long w, long h, struct pixregion *s,	\
+       struct pixregion *wt, float nulval)				\
+  {									\
+    long x, y;								\
+    uint32_t nb;							\
+    float *o, sv;							\
+    ST *sp=s->pix, sb=s->blank;						\
+    double ss=s->bscale, sz=s->bzero;					\
+									\
+    (void)wt;								\
+    memcpy(&nb, &nulval, sizeof nb);					\
+    for(y=0;y<h;++y)							\
+      {									\
+	o=out+y*stride;							\
+	for(x=0;x<w;++x)						\
+	  {								\
+	    sv=sp[x]*ss+sz;						\
+	    PIXSELECT(sv, BLANK(sp[x], sb), nb);			\
+	    o[x]=sv;							\
+	  }								\
+	sp+=w;								\
+      }									\
+  }
+
+/* Like PIXKERNEL, but multiplied by weights of type `WT`: like
+   reading both as floats (blank pixels are `nulval`) and multiplying
+   them, in one pass. */
+#define PIXWKERNEL(NAME, ST, SBLANK, WT, WBLANK)			\
+  static void								\
+  NAME(float *out, long stride, long w, long h, struct pixregion *s,	\
+       struct pixregion *wt, float nulval)				\
+  {									\
+    long x, y;								\
+    uint32_t nb;							\
+    float *o, sv, wv;							\
+    ST *sp=s->pix, sb=s->blank;						\
+    WT *wp=wt->pix, wb=wt->blank;					\
+    double ss=s->bscale, sz=s->bzero, ws=wt->bscale, wz=wt->bzero;	\
+									\
+    memcpy(&nb, &nulval, sizeof nb);					\
+    for(y=0;y<h;++y)							\
+      {									\
+	o=out+y*stride;							\
+	for(x=0;x<w;++x)						\
+	  {								\
+	    sv=sp[x]*ss+sz;						\
+	    wv=wp[x]*ws+wz;						\
+	    PIXSELECT(sv, SBLANK(sp[x], sb), nb);			\
+	    PIXSELECT(wv, WBLANK(wp[x], wb), nb);			\
+	    o[x]=sv*wv;							\
+	  }								\
+	sp+=w;								\
+	wp+=w;								\
+      }									\
+  }
+
+/* The kernels (named with `P`) for science pixels of type `ST` with
+   all the types of weights. `SB` and `WB` are the blank tests of the
+   science pixels and of the integer weights (`PIXNOBLANK` when that
+   image has no BLANK, so its pixels are never compared with it). */
+#define PIXWKERNELS(P, SN, ST, SB, WB)					\
+  PIXWKERNEL(P##_##SN##_uchar, ST, SB, unsigned char, WB)		\
+  PIXWKERNEL(P##_##SN##_short, ST, SB, short, WB)			\
+  PIXWKERNEL(P##_##SN##_int, ST, SB, int, WB)				\
+  PIXWKERNEL(P##_##SN##_float, ST, SB, float, PIXNOBLANK)		\
+  PIXWKERNEL(P##_##SN##_double, ST, SB, double, PIXNOBLANK)
+
+/* All the kernels for science pixels of type `ST`, with `B` the blank
+   test of this type (`PIXINTBLANK` for integers): without blank
+   pixels (`pix`), with blank science pixels (`pixs`, or `pixb`
+   without a weight), with blank weights (`pixw`) and with both
+   (`pixb`). */
+#define PIXKERNELS(SN, ST, B)						\
+  PIXKERNEL(pix_##SN, ST, PIXNOBLANK)					\
+  PIXKERNEL(pixb_##SN, ST, B)						\
+  PIXWKERNELS(pix, SN, ST, PIXNOBLANK, PIXNOBLANK)			\
+  PIXWKERNELS(pixs, SN, ST, B, PIXNOBLANK)				\
+  PIXWKERNELS(pixw, SN, ST, PIXNOBLANK, PIXINTBLANK)			\
+  PIXWKERNELS(pixb, SN, ST, B, PIXINTBLANK)
+
+/* Row of `pixkernels` for one type of science pixels: `N` without a
+   weight and `P` with the weights. */
+#define PIXROW(N, P, SN)						\
+  { N##_##SN, P##_##SN##_uchar, P##_##SN##_short, P##_##SN##_int,	\
+    P##_##SN##_float, P##_##SN##_double }
+
+PIXKERNELS(uchar, unsigned char, PIXINTBLANK)
+PIXKERNELS(short, short, PIXINTBLANK)
+PIXKERNELS(int, int, PIXINTBLANK)
+PIXKERNELS(float, float, PIXNOBLANK)
+PIXKERNELS(double, double, PIXNOBLANK)
+
+/* Without blank pixels, with blank science pixels, with blank
+   weights and with both, in the order of the PIX_* types of the
+   science pixels and then the weights (the first column is without a
+   weight). */
+static pixkernel pixkernels[4][PIX_NTYPES][PIX_NTYPES+1]=
+  {
+    {
+      PIXROW(pix, pix, uchar), PIXROW(pix, pix, short),
+      PIXROW(pix, pix, int), PIXROW(pix, pix, float),
+      PIXROW(pix, pix, double)
+    },
+    {
+      PIXROW(pixb, pixs, uchar), PIXROW(pixb, pixs, short),
+      PIXROW(pixb, pixs, int), PIXROW(pixb, pixs, float),
+      PIXROW(pixb, pixs, double)
+    },
+    {
+      PIXROW(pix, pixw, uchar), PIXROW(pix, pixw, short),
+      PIXROW(pix, pixw, int), PIXROW(pix, pixw, float),
+      PIXROW(pix, pixw, double)
+    },
+    {
+      PIXROW(pixb, pixb, uchar), PIXROW(pixb, pixb, short),
+      PIXROW(pixb, pixb, int), PIXROW(pixb, pixb, float),
+      PIXROW(pixb, pixb, double)
+    }
+  };
+
+/* CFITSIO's data type for each of the PIX_* types. */
+static int pixdatatype[PIX_NTYPES]={TBYTE, TSHORT, TINT, TFLOAT, TDOUBLE};
+
+
+
+
+
+
+
+
+
+
+
+
+
+
+
+
+
+
+
+
+
+/******************************************************************/
+/****************      Reading the pixels      ********************/
+/******************************************************************/
+/* The PIX_* type of images with this BITPIX, -1 if they have to be
+   read as floats. */
+int
+pixtype(int bitpix)
+{
+  switch(bitpix)
+    {
+    case BYTE_IMG:   return PIX_UCHAR;
+    case SHORT_IMG:  return PIX_SHORT;
+    case LONG_IMG:   return PIX_INT;
+    case FLOAT_IMG:  return PIX_FLOAT;
+    case DOUBLE_IMG: return PIX_DOUBLE;
+    default:         return -1;
+    }
+}
+
+
+
+
+
+/* The pixels of `r` are floats that were read with CFITSIO's scaling
+   (and blank pixels). */
+void
+pixfloat(struct pixregion *r)
+{
+  r->type=PIX_FLOAT;
+  r->bscale=1;
+  r->bzero=0;
+  r->blank=PIX_NOBLANK;
+}
+
+
+
+
+
+/* Prepare `r` for reading the pixels of `fptr` (with `bitpix`) in
+   their own type with pixread(). CFITSIO's scaling is then turned
+   off, the kernels scale the pixels. The output is 0 (and nothing is
+   changed) if the pixels have to be read as floats: unsupported
+   types and compressed images. */
+int
+pixnative(fitsfile *fptr, int bitpix, struct pixregion *r, int *status)
+{
+  int type=pixtype(bitpix);
+
+  if(*status || type<0 || fits_is_compressed_image(fptr, status))
+    return 0;
+
+  r->type=type;
+  r->bscale=1;
+  r->bzero=0;
+  r->blank=PIX_NOBLANK;
+  if(type<PIX_FLOAT)
+    {
+      fits_read_key(fptr, TDOUBLE, "BSCALE", &r->bscale, NULL, status);
+      if(*status==KEY_NO_EXIST) *status=0;
+      fits_read_key(fptr, TDOUBLE, "BZERO", &r->bzero, NULL, status);
+      if(*status==KEY_NO_EXIST) *status=0;
+      fits_read_key(fptr, TLONGLONG, "BLANK", &r->blank, NULL, status);
+      if(*status==KEY_NO_EXIST) *status=0;
+      fits_set_bscale(fptr, 1, 0, status);
+    }
+  return *status==0;
+}
+
+
+
+
+
+/* Read the pixels from `fpixel` to `lpixel` (counting from 1) into
+   `r->pix`, as they are in the image (see pixnative()). Blank floats
+   (NaN) are replaced with `nulval`, blank integers are kept (they are
+   found by the kernels). */
+void
+pixread(fitsfile *fptr, long *fpixel, long *lpixel, struct pixregion *r,
+	float nulval, int *status)
+{
+  int anynul=0;
+  long inc[2]={1,1};
+  long long nocheck=0;
+  double dnul=nulval;
+  void *nul = ( r->type==PIX_FLOAT ? (void *)&nulval
+		: (r->type==PIX_DOUBLE ? (void *)&dnul : (void *)&nocheck) );
+
+  fits_read_subset(fptr, pixdatatype[r->type], fpixel, lpixel, inc, nul,
+		   r->pix, &anynul, status);
+}
+
+
+
+
+
+
+
+
+
+
+
+
+
+
+
+
+
+
+
+
+
+/******************************************************************/
+/****************         Pixel ranges         ********************/
+/******************************************************************/
+/* The FITS standard assumes that pixels are counted from their center
+   and in integer values. So the bottom left corner of a FITS image
+   (in a continues space) has coordinates: (0.5,0.5). In converting
+   from WCS to pixel, wcslib gives continues values, this function
+   converts that into actual array elements.  */
+void 
+convert_double_to_long_in_FITS(const double a, long *b)
+{
+  /* Declarations: */
+  *b=(long)a;
+  if (a-(*b)>0.5) (*b)++;
+}
+
+
+
+
+
+/* Given the coordiantes of the object (of type double), this function
+   finds which pixels of the image correspond to which pixels in the
+   cropped image using the *pixel and *pixel_c arrays.
+
+   NOTE: I am going with the cfitsio standard here: the desired region
+         boundries are included.
+
+   The four long arrays are:
+
+   fpixel_i: First pixel in the input (large) image.
+   lpixel_i: Last pixel in the input (large) image.
+   fpixel_c: First pixel in the cropped image.
+   lpixel_c: Last pixel in the cropped image. 
+*/
+void 
+find_desired_pixel_range(double *pixcrd, const long naxis1,
+        const long naxis2, const long crop_side, long *fpixel_i, 
+        long *lpixel_i, long *fpixel_c, long *lpixel_c)
+{
+  /* Declarations: */
+  int hw;
+  long lpixcrd[2];
+  hw=crop_side/2;
+
+  /* Convert pixcrd from double to long based on the 
+     FITS standard: */
+  convert_double_to_long_in_FITS(pixcrd[0], &lpixcrd[0]);
+  convert_double_to_long_in_FITS(pixcrd[1], &lpixcrd[1]);
+
+  /* Set the initial values for the cropped array: */
+  fpixel_c[0]=1;          fpixel_c[1]=1;
+  lpixel_c[0]=crop_side;  lpixel_c[1]=crop_side;
+
+  /* Set the initial values for the actual image: */
+  fpixel_i[0]=lpixcrd[0]-hw; fpixel_i[1]=lpixcrd[1]-hw;
+  lpixel_i[0]=lpixcrd[0]+hw; lpixel_i[1]=lpixcrd[1]+hw;
+
+  /* Check the four corners to see if they should be adjusted:
+     To understand the first, look at this, suppose | separates pixels:
+     |-2|-1| 0|| 1| 2| 3| 4|  (survey image)
+     ||1 | 2| 3|  4| 5| 6| 7|  (crop image)
+     the || shows where the image actually begins. So when fpixel_i is
+     smaller than 1, e.g., fpixel_i=-2, then the pixel in the cropped image 
+     we want to begin with, that corresponds to 1 in the survey image is:
+     fpixel_c= 4 = 2 + -1*fpixel_i.*/
+  if (fpixel_i[0]<1) 
+    {    
+      fpixel_c[0]=-1*fpixel_i[0]+2;
+      fpixel_i[0]=1;
+    }
+  if (fpixel_i[1]<1) 
+    {
+      fpixel_c[1]=-1*fpixel_i[1]+2;
+      fpixel_i[1]=1; 
+    }
+  /*The same principle applies to the end of an image. Take "s"
+    is the maximum size along a specific axis in the survey image 
+    and "c" is the size along the same axis on the cropped image.
+    Assume the the cropped region's last pixel in that axis will
+    be 2 pixels larger than s:
+    |1|.....|s-3|s-2|s-1|s  ||s+1|s+2| (survey image)
+    |c-3|c-2| c-1| c ||
+    So you see that if the outer pixel is n pixels away then in
+    the cropped image we should only look upto c-n.*/
+  if (lpixel_i[0]>naxis1) 
+    {
+      lpixel_c[0]=crop_side-(lpixel_i[0]-naxis1);
+      lpixel_i[0]=naxis1;
+    }
+  if (lpixel_i[1]>naxis2) 
+    {
+      lpixel_c[1]=crop_side-(lpixel_i[1]-naxis2);
+      lpixel_i[1]=naxis2;
+    }
+
+  /* In case you wish to see the results (declare "junk"!).
+     The +1 in the final size section is because of the
+     cfitsio standard. An array of size 3 will have elements 
+     {1,2,3}, but the last element subtracted from the first is 
+     3-1=2, which doesn't show the number of pixels in it, it 
+     has to be increased by a unit! 
+     printf(" n1: %ld,  n2: %ld\n", naxis1, naxis2);
+     printf("if0: %ld, if1: %ld\n", fpixel_i[0], fpixel_i[1]);
+     printf("il0: %ld, il1: %ld\n", lpixel_i[0], lpixel_i[1]);
+     printf("cf0: %ld, cf1: %ld\n", fpixel_c[0], fpixel_c[1]);
+     printf("cl0: %ld, cl1: %ld\n", lpixel_c[0], lpixel_c[1]);
+     printf("\nThe sides of the desired region:\n");
+     printf("Num pixels in survey image: (ax1=%ld) * (ax2=%ld)\n", 
+     lpixel_i[0]-fpixel_i[0]+1, lpixel_i[1]-fpixel_i[1]+1);
+     printf("Num pixels in Cropped image: (ax1=%ld) * (ax2=%ld)\n", 
+     lpixel_c[0]-fpixel_c[0]+1, lpixel_c[1]-fpixel_c[1]+1);
+     scanf("%d", &junk);*/
+}
+
+
+
+
+
+/* Multiply the `size` pixels of the science image by those of the
+   weight image. */
+void
+multiplyweight(float *sci, float *wht, size_t size)
+{
+  float *sf=sci, *wf=wht, *wff=wht+size;
+  do *sf++ *= *wf; while(++wf<wff);
+}
+
+
+
+
+
+/* Return 1 if all the pixels in the central `chk_size` by `chk_size`
+   box of the `crop_side` by `crop_side` thumbnail are zero. */
+int
+centeriszero(float *cropped, long crop_side, long chk_size)
+{
+  long i, j, start=crop_side/2-chk_size/2;
+
+  if(chk_size<=0) return 0;
+  for(i=start;i<start+chk_size;++i)
+    for(j=start;j<start+chk_size;++j)
+      if(i>=0 && j>=0 && i<crop_side && j<crop_side
+	 && cropped[i*crop_side+j]!=0)
+	return 0;
+  return 1;
+}
+
+
+
+
+
+
+
+
+
+
+
+
+
+
+
+
+
+
+
+
+/******************************************************************/
+/****************      Stitching the pixels    ********************/
+/******************************************************************/
+/* The kernel for science pixels of type `stype` and weights of type
+   `wtype` (-1: no weight). With `sblank` (`wblank`), the blank
+   integers of the science pixels (weights) are found. */
+pixkernel
+pixgetkernel(int sblank, int wblank, int stype, int wtype)
+{
+  return pixkernels[(sblank!=0)|(wblank!=0)<<1][stype][wtype+1];
+}
+
+
+
+
+
+/* Put the pixels of `s` (multiplied by `wt` if it isn't NULL) in the
+   `fpixel_c` to `lpixel_c` (counting from 1) part of the `crop_side`
+   by `crop_side` thumbnail `out`. */
+void
+pixpaste(float *out, long crop_side, long *fpixel_c, long *lpixel_c,
+	 struct pixregion *s, struct pixregion *wt, float nulval)
+{
+  int sblank = s->blank!=PIX_NOBLANK;
+  int wblank = wt && wt->blank!=PIX_NOBLANK;
+
+  pixgetkernel(sblank, wblank, s->type, wt ? wt->type : -1)
+    (out+(fpixel_c[1]-1)*crop_side+fpixel_c[0]-1, crop_side,
+     lpixel_c[0]-fpixel_c[0]+1, lpixel_c[1]-fpixel_c[1]+1, s, wt, nulval);
+}
+
+
+
+
+
+
+
+
+
+
+
+
+
+
+
+
+
+
+
+
+/******************************************************************/
+/****************     Checksum of the pixels   ********************/
+/******************************************************************/
+/* The FITS data sum (the 32-bit ones' complement sum of the data in
+   big-endian 32-bit words) of the `n` pixels of `pix` (PIX_SHORT or
+   PIX_FLOAT) as they are written in a FITS file. Each word is the
+   bits of a float (or of two shorts), so no bytes are swapped and the
+   sums (in 64 bits) can be vectorized. The carries are folded into
+   the 32 bits at the end. The blanks that pad the data unit add
+   nothing. */
+unsigned long
+pixdatasum(int type, void *pix, size_t n)
+{
+  size_t i;
+  uint32_t w;
+  float *f=pix;
+  uint16_t *s=pix;
+  uint64_t sum=0, hi=0, lo=0;
+
+  if(type==PIX_FLOAT)
+    for(i=0;i<n;++i)
+      {
+	memcpy(&w, &f[i], sizeof w);
+	sum+=w;
+      }
+  else
+    {
+      for(i=0;i+1<n;i+=2)
+	{
+	  hi+=s[i];
+	  lo+=s[i+1];
+	}
+      if(n%2) hi+=s[n-1];
+      sum=(hi<<16)+lo;
+    }
+  while(sum>>32) sum=(sum&0xffffffff)+(sum>>32);
+  return sum;
+}
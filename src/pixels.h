@@ -0,0 +1,94 @@
+/*********************************************************************
+tifaa - Thumbnail images from astronomical archives
+A simple set of functions to crop thumbnails from astronomical archives.
+
+Copyright (C) 2013-2014 Mohammad Akhlaghi
+Tohoku University Astronomical Institute, Sendai, Japan.
+http://astr.tohoku.ac.jp/~akhlaghi/
+
+tifaa is free software: you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation, either version 3 of the License, or
+(at your option) any later version.
+
+tifaa is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with tifaa.  If not, see <http://www.gnu.org/licenses/>.
+**********************************************************************/
+#ifndef PIXELS_H
+#define PIXELS_H
+
+#include <limits.h>
+#include <fitsio.h>
+
+/* Types of pixels that are read (and stitched) without converting
+   them to floats first. */
+#define PIX_UCHAR         0     /* BYTE_IMG.                          */
+#define PIX_SHORT         1     /* SHORT_IMG.                         */
+#define PIX_INT           2     /* LONG_IMG.                          */
+#define PIX_FLOAT         3     /* FLOAT_IMG.                         */
+#define PIX_DOUBLE        4     /* DOUBLE_IMG.                        */
+#define PIX_NTYPES        5
+#define PIX_MAXBYTES      8     /* Bytes of the largest type.         */
+#define PIX_NOBLANK       LLONG_MIN /* `blank` without BLANK keyword. */
+
+/* The pixels of a region of a survey or weight image, in the type of
+   the image. Their value is `bscale*pix+bzero` and integer pixels
+   equal to `blank` are blank (floats are already `nulval`). */
+struct pixregion
+{
+  int             type;  /* PIX_* type of the pixels.                  */
+  void            *pix;  /* The pixels (at least PIX_MAXBYTES each).   */
+  double        bscale;  /* BSCALE of the image.                       */
+  double         bzero;  /* BZERO of the image.                        */
+  long long      blank;  /* BLANK of the image (or PIX_NOBLANK).       */
+};
+
+/* Put the `w` by `h` pixels of `s` (multiplied by those of `wt`) in
+   `out`, which has `stride` pixels in each row. */
+typedef void (*pixkernel)(float *out, long stride, long w, long h,
+			  struct pixregion *s, struct pixregion *wt,
+			  float nulval);
+
+int
+pixtype(int bitpix);
+
+void
+pixfloat(struct pixregion *r);
+
+int
+pixnative(fitsfile *fptr, int bitpix, struct pixregion *r, int *status);
+
+void
+pixread(fitsfile *fptr, long *fpixel, long *lpixel, struct pixregion *r,
+	float nulval, int *status);
+
+void 
+convert_double_to_long_in_FITS(const double a, long *b);
+
+void 
+find_desired_pixel_range(double *pixcrd, const long naxis1,
+        const long naxis2, const long crop_side, long *fpixel_i, 
+        long *lpixel_i, long *fpixel_c, long *lpixel_c);
+
+void
+multiplyweight(float *sci, float *wht, size_t size);
+
+int
+centeriszero(float *cropped, long crop_side, long chk_size);
+
+pixkernel
+pixgetkernel(int sblank, int wblank, int stype, int wtype);
+
+void
+pixpaste(float *out, long crop_side, long *fpixel_c, long *lpixel_c,
+	 struct pixregion *s, struct pixregion *wt, float nulval);
+
+unsigned long
+pixdatasum(int type, void *pix, size_t n);
+
+#endif
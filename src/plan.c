@@ -0,0 +1,395 @@
+/*********************************************************************
+tifaa - Thumbnail images from astronomical archives
+A simple set of functions to crop thumbnails from astronomical archives.
+
+Copyright (C) 2013-2014 Mohammad Akhlaghi
+Tohoku University Astronomical Institute, Sendai, Japan.
+http://astr.tohoku.ac.jp/~akhlaghi/
+
+tifaa is free software: you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation, either version 3 of the License, or
+(at your option) any later version.
+
+tifaa is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with tifaa.  If not, see <http://www.gnu.org/licenses/>.
+**********************************************************************/
+#include <stdio.h>
+#include <stdint.h>
+#include <inttypes.h>
+#include <stdlib.h>
+#include <string.h>
+#include <assert.h>
+
+#include "tifaa.h"
+#include "fitsfz.h"
+#include "libtifaa.h"
+#include "surveyimginfo.h"
+#include "survey.h"
+#include "plan.h"
+
+
+
+
+
+
+
+
+
+
+
+
+
+
+
+
+
+
+
+
+/******************************************************************/
+/****************          The report          ********************/
+/******************************************************************/
+/* Size of the file of survey image `name`, without the HDU (`[n]`)
+   that a manifest may have added. */
+size_t
+planfilesize(char *name)
+{
+  char *file;
+  size_t s, len=strlen(name);
+  char *c=strrchr(name, '[');
+
+  if(c==NULL || name[len-1]!=']') return filesize(name);
+  assert( (file=malloc(c-name+1))!=NULL );
+  memcpy(file, name, c-name);
+  file[c-name]='\0';
+  s=filesize(file);
+  free(file);
+  return s;
+}
+
+
+
+
+
+/* Print what cropping all the targets would need into `fp`: the
+   targets in the field (in one image or stitched), the survey images
+   that would be opened (and their size), the pixels that would be
+   read (an estimate from the size of each thumbnail, in all the
+   bands and weights) and the number of images of each target. */
+void
+planreport(FILE *fp, struct tifaaparams *p)
+{
+  unsigned char *used;
+  double pix, pixels=0;
+  size_t i, k, n, side, infield=0, stitched=0, nused=0, bytes=0;
+  size_t *hist, numimg=p->survglob.gl_pathc;
+
+  assert( (used=calloc(numimg, sizeof *used))!=NULL );
+  assert( (hist=calloc(p->wimax+1, sizeof *hist))!=NULL );
+  for(i=0;i<p->cs0;++i)
+    {
+      n=p->wioff[i+1]-p->wioff[i];
+      ++hist[n];
+      if(n==0) continue;
+      ++infield;
+      stitched += n>1;
+      side=cropside(targetpssize(p, i), p->res);
+      pixels += (double)side*side;
+      for(k=p->wioff[i];k<p->wioff[i+1];++k)
+	used[p->wiimg[k]]=1;
+    }
+  for(i=0;i<numimg;++i)
+    if(used[i])
+      {
+	++nused;
+	bytes+=planfilesize(p->survglob.gl_pathv[i]);
+      }
+  pix=pixels*sizeof(float)*p->numbands*(1+p->weightmultip);
+
+  fprintf(fp, "Plan for %lu target(s) on %lu survey image(s):\n",
+	  p->cs0, numimg);
+  fprintf(fp, "  In the field:         %lu\n", infield);
+  fprintf(fp, "    - In one image:     %lu\n", infield-stitched);
+  fprintf(fp, "    - Stitched:         %lu\n", stitched);
+  fprintf(fp, "  Not in the field:     %lu\n", p->cs0-infield);
+  fprintf(fp, "  Images to open:       %lu (%.1f MB in the first band)\n",
+	  nused, bytes/1048576.0f);
+  fprintf(fp, "  Pixels to read:       %.1f MB (%lu band(s)%s)\n",
+	  pix/1048576.0f, p->numbands, p->weightmultip ? " and weights" : "");
+  fprintf(fp, "  Images per target:\n");
+  for(i=0;i<=p->wimax;++i)
+    if(hist[i])
+      fprintf(fp, "    %5lu: %lu\n", i, hist[i]);
+
+  free(hist);
+  free(used);
+}
+
+
+
+
+
+
+
+
+
+
+
+
+
+
+
+
+
+
+
+
+/******************************************************************/
+/****************        The plan file         ********************/
+/******************************************************************/
+/* A 64-bit FNV-1a hash of the coordinates (and sizes, if they are
+   read from the catalog) of all the targets, so a plan is only used
+   with the catalog it was made for. */
+uint64_t
+plancatsum(struct tifaaparams *p)
+{
+  size_t i, j, c;
+  double v[3];
+  unsigned char *b;
+  uint64_t h=UINT64_C(14695981039346656037);
+
+  for(i=0;i<p->cs0;++i)
+    {
+      v[0]=p->cat[i*p->cs1+p->ra_col];
+      v[1]=p->cat[i*p->cs1+p->dec_col];
+      c=2;
+      if(p->size_col!=NONINDEX) v[c++]=p->cat[i*p->cs1+p->size_col];
+      b=(unsigned char *)v;
+      for(j=0;j<c*sizeof *v;++j)
+	h=(h^b[j])*UINT64_C(1099511628211);
+    }
+  return h;
+}
+
+
+
+
+
+void
+planwrite(struct tifaaparams *p)
+{
+  FILE *fp;
+  size_t i, k, numimg=p->survglob.gl_pathc;
+
+  if( (fp=fopen(p->plan_name, "w"))==NULL )
+    {
+      printf("\nError: Cannot open %s to write the plan. TIFAA "
+	     "aborted.\n\n", p->plan_name);
+      exit(EXIT_FAILURE);
+    }
+  fprintf(fp, "%s: %lu image(s), %lu target(s).\n", PLANHEADER,
+	  numimg, p->cs0);
+  fprintf(fp, "%lu %lu %.17g %.17g %lu %016"PRIx64"\n", numimg, p->cs0,
+	  p->ps_size, p->res, p->size_col, plancatsum(p));
+  for(i=0;i<numimg;++i)
+    fprintf(fp, "%s\n", p->survglob.gl_pathv[i]);
+  for(i=0;i<p->cs0;++i)
+    {
+      fprintf(fp, "%lu", p->wioff[i+1]-p->wioff[i]);
+      for(k=p->wioff[i];k<p->wioff[i+1];++k)
+	fprintf(fp, " %"PRIu32, p->wiimg[k]);
+      fprintf(fp, "\n");
+    }
+  fclose(fp);
+}
+
+
+
+
+
+void
+planerror(struct tifaaparams *p, char *message)
+{
+  printf("\nError: %s: %s. TIFAA aborted.\n\n", p->plan_name, message);
+  exit(EXIT_FAILURE);
+}
+
+
+
+
+
+/* Index the compression tiles of only the survey images that are used
+   in the plan (in all the bands). The WCS of the images isn't needed,
+   the images of each target are already known. */
+void
+planindex(struct tifaaparams *p)
+{
+  glob_t *g, *wg;
+  int err, onlyweights;
+  unsigned char *used;
+  struct fzindex *fz, *wfz;
+  char **names, **wnames;
+  size_t i, j, b, m, badimg, *list, n=p->survglob.gl_pathc;
+
+  assert( (used=calloc(n, sizeof *used))!=NULL );
+  for(i=0;i<p->wioff[p->cs0];++i)
+    used[p->wiimg[i]]=1;
+  for(m=i=0;i<n;++i) m+=used[i];
+  if(m==0) { free(used); return; }
+  assert( (list=malloc(m*sizeof *list))!=NULL );
+  assert( (names=malloc(m*sizeof *names))!=NULL );
+  assert( (wnames=malloc(m*sizeof *wnames))!=NULL );
+  assert( (fz=calloc(m, sizeof *fz))!=NULL );
+  assert( (wfz=calloc(m, sizeof *wfz))!=NULL );
+  for(j=i=0;i<n;++i)
+    if(used[i]) list[j++]=i;
+
+  for(b=0;b<p->numbands;++b)
+    {
+      g  = b ? &p->bandglob[b-1]  : &p->survglob;
+      wg = b ? &p->wbandglob[b-1] : &p->wsurvglob;
+      for(j=0;j<m;++j)
+	{
+	  names[j]=g->gl_pathv[list[j]];
+	  if(p->weightmultip) wnames[j]=wg->gl_pathv[list[j]];
+	}
+
+      /* With a manifest, the first band may already be indexed. */
+      onlyweights = b==0 && p->indexed;
+      if(onlyweights && p->weightmultip==0) continue;
+      if(onlyweights)
+	err=surveyimageinfo(wnames, NULL, m, p->res, p->numthrd, NULL,
+			    wfz, NULL, &badimg);
+      else
+	err=surveyimageinfo(names, p->weightmultip ? wnames : NULL, m,
+			    p->res, p->numthrd, NULL, fz,
+			    p->weightmultip ? wfz : NULL, &badimg);
+      if(err)
+	exitonerror(err, onlyweights ? wnames[badimg] : names[badimg],
+		    0, 0);
+      for(j=0;j<m;++j)
+	{
+	  if(onlyweights==0)  p->fzindex[b*n+list[j]]=fz[j];
+	  if(p->weightmultip) p->wfzindex[b*n+list[j]]=wfz[j];
+	}
+    }
+
+  free(wfz);
+  free(fz);
+  free(wnames);
+  free(names);
+  free(list);
+  free(used);
+}
+
+
+
+
+
+
+
+
+
+
+
+
+
+
+
+
+
+
+
+
+/******************************************************************/
+/****************       Outside functions      ********************/
+/******************************************************************/
+/* Only plan the crops (`-x`): report what they would need and (with
+   `-X`) write the plan so a later run can crop without finding the
+   images of each target again. */
+void
+tifaaplan(struct tifaaparams *p)
+{
+  planreport(stdout, p);
+  if(p->plan_name)
+    {
+      planwrite(p);
+      printf("The plan was written in %s.\n", p->plan_name);
+    }
+}
+
+
+
+
+
+/* Read the images of each target from the plan file (`-X` without
+   `-x`) instead of getsurveyimageinfo() and
+   whichimageforwhichtargets(). The survey, the catalog, the
+   resolution and the thumbnail sizes have to be the same as when the
+   plan was made. */
+void
+readplan(struct tifaaparams *p)
+{
+  FILE *fp;
+  uint32_t *wiimg;
+  char *line=NULL;
+  uint64_t catsum;
+  double ps_size, res;
+  size_t i, k, n, linesize=0, numimg, cs0, size_col, size=p->cs0+1;
+
+  if( (fp=fopen(p->plan_name, "r"))==NULL )
+    planerror(p, "can't be opened");
+  if(getline(&line, &linesize, fp)==-1
+     || strncmp(line, PLANHEADER, strlen(PLANHEADER))
+     || fscanf(fp, "%lu %lu %lg %lg %lu %"SCNx64"\n", &numimg, &cs0,
+	       &ps_size, &res, &size_col, &catsum)!=6)
+    planerror(p, "not a TIFAA plan");
+  if(numimg!=p->survglob.gl_pathc || cs0!=p->cs0)
+    planerror(p, "made for a different survey or catalog");
+  if(ps_size!=p->ps_size || res!=p->res || size_col!=p->size_col)
+    planerror(p, "made with a different resolution or thumbnail size");
+  if(catsum!=plancatsum(p))
+    planerror(p, "made for a different catalog");
+
+  /* The survey images have to be the same (in the same order). */
+  for(i=0;i<numimg;++i)
+    {
+      if( (n=getline(&line, &linesize, fp))==(size_t)-1 )
+	planerror(p, "not a TIFAA plan");
+      if(n && line[n-1]=='\n') line[n-1]='\0';
+      if(strcmp(line, p->survglob.gl_pathv[i]))
+	planerror(p, "made for a different survey");
+    }
+  free(line);
+
+  /* The images of each target. */
+  assert( (wiimg=malloc(size*sizeof *wiimg))!=NULL );
+  p->wimax=0;
+  p->wioff[0]=0;
+  for(i=0;i<cs0;++i)
+    {
+      if(fscanf(fp, "%lu", &n)!=1)
+	planerror(p, "not a TIFAA plan");
+      if(p->wioff[i]+n>size)
+	{
+	  for(size*=2;p->wioff[i]+n>size;size*=2);
+	  assert( (wiimg=realloc(wiimg, size*sizeof *wiimg))!=NULL );
+	}
+      for(k=p->wioff[i];k<p->wioff[i]+n;++k)
+	if(fscanf(fp, "%"SCNu32, &wiimg[k])!=1 || wiimg[k]>=numimg)
+	  planerror(p, "not a TIFAA plan");
+      p->wioff[i+1]=p->wioff[i]+n;
+      if(n>p->wimax) p->wimax=n;
+    }
+  fclose(fp);
+  free(p->wiimg);
+  p->wiimg=wiimg;
+
+  planindex(p);
+}
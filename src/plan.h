@@ -0,0 +1,47 @@
+/*********************************************************************
+tifaa - Thumbnail images from astronomical archives
+A simple set of functions to crop thumbnails from astronomical archives.
+
+Copyright (C) 2013-2014 Mohammad Akhlaghi
+Tohoku University Astronomical Institute, Sendai, Japan.
+http://astr.tohoku.ac.jp/~akhlaghi/
+
+tifaa is free software: you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation, either version 3 of the License, or
+(at your option) any later version.
+
+tifaa is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with tifaa.  If not, see <http://www.gnu.org/licenses/>.
+**********************************************************************/
+#ifndef PLAN_H
+#define PLAN_H
+
+#include <stdio.h>
+
+#define PLANHEADER        "# TIFAA plan"
+
+/* The plan file (`-x` with `-X`) is an ASCII file: after a comment
+   line starting with PLANHEADER, one line with the number of survey
+   images and targets, the thumbnail size, the resolution, the size
+   column and the hash of the catalog (see plancatsum()), then the
+   name of each survey image (one on each line, to check that a later
+   run uses the same survey) and
+   finally one line for each target: the number of its images and
+   their indexs (see `wioff` and `wiimg` in tifaa.h). */
+
+void
+planreport(FILE *fp, struct tifaaparams *p);
+
+void
+tifaaplan(struct tifaaparams *p);
+
+void
+readplan(struct tifaaparams *p);
+
+#endif
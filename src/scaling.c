@@ -0,0 +1,282 @@
+/*********************************************************************
+tifaa - Thumbnail images from astronomical archives
+A simple set of functions to crop thumbnails from astronomical archives.
+
+Copyright (C) 2013-2014 Mohammad Akhlaghi
+Tohoku University Astronomical Institute, Sendai, Japan.
+http://astr.tohoku.ac.jp/~akhlaghi/
+
+tifaa is free software: you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation, either version 3 of the License, or
+(at your option) any later version.
+
+tifaa is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with tifaa.  If not, see <http://www.gnu.org/licenses/>.
+**********************************************************************/
+#include <stdio.h>
+#include <stdlib.h>
+#include <assert.h>
+#include <string.h>
+#include <unistd.h>
+#include <pthread.h>
+#include <sys/stat.h>
+
+#include "tifaa.h"
+#include "timing.h"
+#include "scaling.h"
+
+
+
+
+
+/* Crop `n` targets from the `ns` targets in `sample` (repeating
+   them if `n>ns`) with `nthrd` threads using stitchandcrop(), exactly
+   like a normal run. A copy of the
+   parameters is made that only has these targets, so the numbers of
+   the thumbnails (and the rows of the result table in SCALINGDIR)
+   are their position in the sample, not in the catalog. The
+   thumbnails are deleted after the run. */
+void
+scalingrun(struct tifaaparams *p, size_t *sample, size_t ns, size_t n,
+	   size_t nthrd, struct scalingrun *r)
+{
+  FILE *fp;
+  size_t i, j, b, k;
+  struct timeval t1;
+  char name[10000];
+  struct tifaaparams sp=*p;
+
+  /* Only keep the targets in the sample. */
+  sp.cs0=n;
+  sp.verb=0;
+  sp.numthrd=nthrd;
+  sp.streamfp=NULL;
+  assert( (sp.cat=malloc(n*p->cs1*sizeof *sp.cat))!=NULL );
+  assert( (sp.wioff=malloc((n+1)*sizeof *sp.wioff))!=NULL );
+  assert( (sp.log=calloc(n*LOG_COLS, sizeof *sp.log))!=NULL );
+  sp.wioff[0]=0;
+  for(i=0;i<n;++i)
+    {
+      j=sample[i%ns];
+      memcpy(&sp.cat[i*p->cs1], &p->cat[j*p->cs1],
+	     p->cs1*sizeof *sp.cat);
+      sp.wioff[i+1]=sp.wioff[i]+p->wioff[j+1]-p->wioff[j];
+    }
+  assert( (sp.wiimg=malloc((sp.wioff[n]+1)*sizeof *sp.wiimg))!=NULL );
+  for(i=0;i<n;++i)
+    for(j=sample[i%ns],k=0;k<sp.wioff[i+1]-sp.wioff[i];++k)
+      sp.wiimg[sp.wioff[i]+k]=p->wiimg[p->wioff[j]+k];
+  assert( (sp.out_name=malloc(strlen(p->out_name)
+			      +strlen(SCALINGDIR)+1))!=NULL );
+  sprintf(sp.out_name, "%s%s", p->out_name, SCALINGDIR);
+
+  /* Crop them. */
+  makeshards(&sp);
+  fp=tifaastarttable(&sp);
+  gettimeofday(&t1, NULL);
+  stitchandcrop(&sp);
+  r->wall=mseclap(&t1);
+  writerfinish(&sp.table);
+  fclose(fp);
+
+  r->nthrd=nthrd;
+  r->ntarget=n;
+  r->stats=sp.stats;
+
+  /* Clean up. */
+  for(i=0;i<n;++i)
+    for(b=0;b<sp.numbands;++b)
+      {
+	thumbnailname(&sp, i, b, name);
+	unlink(name);
+      }
+  free(sp.cat);
+  free(sp.log);
+  free(sp.wioff);
+  free(sp.wiimg);
+  free(sp.out_name);
+}
+
+
+
+
+
+/* Find the first run where the efficiency is below EFFICIENCYLIMIT
+   and the step that took the most extra time (per target, on all the
+   threads) compared to the first run: that is where the threads are
+   waiting. */
+void
+scalingsaturation(FILE *fp, char *mode, struct scalingrun *r,
+		  double *eff, size_t nruns)
+{
+  size_t k;
+  char *names[4]={"waiting for the WCS mutex",
+		  "opening images and reading their WCS (I/O)",
+		  "reading the pixels (I/O)",
+		  "writing the thumbnails (I/O)"};
+  double now[4], first[4], ratio, maxratio=0;
+  int i, maxi=0;
+
+  for(k=1;k<nruns;++k)
+    if(eff[k]<EFFICIENCYLIMIT)
+      break;
+  if(k==nruns)
+    {
+      fprintf(fp, "# %s scaling: efficiency stays above %.0f%% up to "
+	      "%lu threads.\n", mode, EFFICIENCYLIMIT*100, r[nruns-1].nthrd);
+      return;
+    }
+
+  first[0]=r[0].stats.lockwait/r[0].ntarget;
+  first[1]=r[0].stats.headers/r[0].ntarget;
+  first[2]=r[0].stats.read/r[0].ntarget;
+  first[3]=r[0].stats.write/r[0].ntarget;
+  now[0]=r[k].stats.lockwait/r[k].ntarget;
+  now[1]=r[k].stats.headers/r[k].ntarget;
+  now[2]=r[k].stats.read/r[k].ntarget;
+  now[3]=r[k].stats.write/r[k].ntarget;
+  for(i=0;i<4;++i)
+    {
+      ratio = first[i]>0 ? now[i]/first[i] : (now[i]>0 ? 1e10 : 0);
+      if(ratio>maxratio) { maxratio=ratio; maxi=i; }
+    }
+
+  fprintf(fp, "# %s scaling: efficiency drops below %.0f%% at %lu "
+	  "threads,\n#     the largest increase (%.1f times per target) is "
+	  "in %s.\n", mode, EFFICIENCYLIMIT*100, r[k].nthrd, maxratio,
+	  names[maxi]);
+}
+
+
+
+
+
+/* Print the results of one mode. For strong scaling, the speedup is
+   T(1)/T(n) and for weak scaling (where n threads do n times more
+   work) it is n*T(1)/T(n). The efficiency is the speedup divided by
+   n. The last 4 columns are the percentage of the time of all the
+   threads spent in each step. */
+void
+scalingreport(FILE *fp, char *mode, struct scalingrun *r, size_t nruns,
+	      int weak)
+{
+  size_t k;
+  double speedup, *eff, thrdtime;
+
+  assert( (eff=malloc(nruns*sizeof *eff))!=NULL );
+  for(k=0;k<nruns;++k)
+    {
+      speedup = ( weak ? r[k].nthrd*r[0].wall/r[k].wall
+		  : r[0].wall/r[k].wall );
+      eff[k]=speedup/r[k].nthrd;
+      thrdtime=r[k].wall*r[k].nthrd/100;
+      fprintf(fp, "%-7s %-4lu %-8lu %-10.3f %-10.1f %-8.2f %-6.2f %-6.1f "
+	      "%-6.1f %-6.1f %-6.1f\n", mode, r[k].nthrd, r[k].ntarget,
+	      r[k].wall/1e3, r[k].ntarget/(r[k].wall/1e3), speedup, eff[k],
+	      r[k].stats.lockwait/thrdtime, r[k].stats.headers/thrdtime,
+	      r[k].stats.read/thrdtime, r[k].stats.write/thrdtime);
+    }
+  scalingsaturation(fp, mode, r, eff, nruns);
+  free(eff);
+}
+
+
+
+
+
+void
+scalingprint(FILE *fp, struct tifaaparams *p, struct scalingrun *strong,
+	     struct scalingrun *weak, size_t nruns, size_t ns)
+{
+  fprintf(fp,
+	  "# TIFAA %s scaling study on %lu targets (first %lu in the field).\n"
+	  "# Strong scaling: all the targets with every number of threads.\n"
+	  "# Weak scaling: %lu targets for each thread.\n"
+	  "# Col 0:  Mode (strong or weak).\n"
+	  "# Col 1:  Number of threads.\n"
+	  "# Col 2:  Number of targets.\n"
+	  "# Col 3:  Wall clock time (seconds).\n"
+	  "# Col 4:  Targets per second.\n"
+	  "# Col 5:  Speedup.\n"
+	  "# Col 6:  Efficiency (speedup/threads).\n"
+	  "# Col 7:  %% of thread time waiting for the WCS mutex.\n"
+	  "# Col 8:  %% of thread time opening images (including Col 7).\n"
+	  "# Col 9:  %% of thread time reading pixels.\n"
+	  "# Col 10: %% of thread time writing thumbnails.\n",
+	  TIFFAVERSION, ns, p->scalingn, weak[0].ntarget);
+  scalingreport(fp, "strong", strong, nruns, 0);
+  scalingreport(fp, "weak", weak, nruns, 1);
+}
+
+
+
+
+
+/* Crop a fixed sample of targets with 1, 2, 4, ... and finally
+   p->numthrd threads, once with the same total number of targets
+   (strong scaling) and once with a number of targets proportional
+   to the number of threads (weak scaling). The results are printed
+   and saved in tifaascaling.txt. */
+void
+scalingstudy(struct tifaaparams *p)
+{
+  FILE *fp;
+  char name[10000];
+  struct scalingrun *strong, *weak;
+  size_t i, n, ns, base, nruns, *sample, *nthrds;
+
+  /* The sample: the first p->scalingn targets that are in the field. */
+  assert( (sample=malloc(p->scalingn*sizeof *sample))!=NULL );
+  for(ns=i=0;i<p->cs0 && ns<p->scalingn;++i)
+    if(p->wioff[i+1]>p->wioff[i])
+      sample[ns++]=i;
+  if(ns==0)
+    {
+      printf("Error: No targets in the field for the scaling study.\n");
+      exit(EXIT_FAILURE);
+    }
+
+  /* The numbers of threads to use. */
+  assert( (nthrds=malloc((sizeof(size_t)*8+1)*sizeof *nthrds))!=NULL );
+  for(nruns=0, n=1; n<p->numthrd; n*=2)
+    nthrds[nruns++]=n;
+  nthrds[nruns++]=p->numthrd;
+  assert( (strong=malloc(nruns*sizeof *strong))!=NULL );
+  assert( (weak=malloc(nruns*sizeof *weak))!=NULL );
+
+  sprintf(name, "%s%s", p->out_name, SCALINGDIR);
+  mkdir(name, 0755);
+
+  /* One run before timing so all the runs see the same page cache. */
+  scalingrun(p, sample, ns, ns, p->numthrd, &strong[0]);
+
+  for(i=0;i<nruns;++i)
+    {
+      if(p->verb) printf("  - Strong scaling with %lu threads.\n", nthrds[i]);
+      scalingrun(p, sample, ns, ns, nthrds[i], &strong[i]);
+    }
+  base = ns/p->numthrd ? ns/p->numthrd : 1;
+  for(i=0;i<nruns;++i)
+    {
+      if(p->verb) printf("  - Weak scaling with %lu threads.\n", nthrds[i]);
+      scalingrun(p, sample, ns, base*nthrds[i], nthrds[i], &weak[i]);
+    }
+
+  /* Report the results. */
+  scalingprint(stdout, p, strong, weak, nruns, ns);
+  sprintf(name, "%stifaascaling.txt", p->out_name);
+  assert( (fp=fopen(name, "w"))!=NULL );
+  scalingprint(fp, p, strong, weak, nruns, ns);
+  fclose(fp);
+
+  free(weak);
+  free(strong);
+  free(sample);
+  free(nthrds);
+}
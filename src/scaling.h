@@ -0,0 +1,40 @@
+/*********************************************************************
+tifaa - Thumbnail images from astronomical archives
+A simple set of functions to crop thumbnails from astronomical archives.
+
+Copyright (C) 2013-2014 Mohammad Akhlaghi
+Tohoku University Astronomical Institute, Sendai, Japan.
+http://astr.tohoku.ac.jp/~akhlaghi/
+
+tifaa is free software: you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation, either version 3 of the License, or
+(at your option) any later version.
+
+tifaa is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with tifaa.  If not, see <http://www.gnu.org/licenses/>.
+**********************************************************************/
+#ifndef SCALING_H
+#define SCALING_H
+
+#define SCALINGDIR        "scaling/"
+#define EFFICIENCYLIMIT   0.8f
+
+/* Result of cropping a sample with one number of threads. */
+struct scalingrun
+{
+  size_t         nthrd;  /* Number of threads used.                     */
+  size_t       ntarget;  /* Number of targets cropped.                  */
+  double          wall;  /* Wall clock time (milliseconds).             */
+  struct cropstats stats; /* Time in each step (all threads).          */
+};
+
+void
+scalingstudy(struct tifaaparams *p);
+
+#endif
@@ -0,0 +1,333 @@
+/*********************************************************************
+tifaa - Thumbnail images from astronomical archives
+A simple set of functions to crop thumbnails from astronomical archives.
+
+Copyright (C) 2013-2014 Mohammad Akhlaghi
+Tohoku University Astronomical Institute, Sendai, Japan.
+http://astr.tohoku.ac.jp/~akhlaghi/
+
+tifaa is free software: you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation, either version 3 of the License, or
+(at your option) any later version.
+
+tifaa is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with tifaa.  If not, see <http://www.gnu.org/licenses/>.
+**********************************************************************/
+#include <stdio.h>
+#include <stdarg.h>
+#include <stdlib.h>
+#include <assert.h>
+#include <string.h>
+#include <unistd.h>
+#include <pthread.h>
+#include <sys/un.h>
+#include <sys/socket.h>
+
+#include "tifaa.h"
+#include "timing.h"
+#include "server.h"
+#include "libtifaa.h"
+#include "surveyimginfo.h"
+#include "survey.h"
+
+
+
+
+/******************************************************************/
+/****************        Connections          *********************/
+/******************************************************************/
+/* Send a formatted reply to the client. */
+void
+serverreply(int fd, char *fmt, ...)
+{
+  int len;
+  va_list ap;
+  char reply[SERVERNAMELEN+100];
+
+  va_start(ap, fmt);
+  len=vsnprintf(reply, sizeof reply, fmt, ap);
+  va_end(ap);
+  if(len>=(int)sizeof reply) len=sizeof reply - 1;
+  send(fd, reply, len, MSG_NOSIGNAL);
+}
+
+
+
+
+
+/* Send the contents of the thumbnail to the client after its size
+   and remove it. */
+void
+serversendfile(int fd, char *name, double latency, size_t numimg)
+{
+  FILE *fp;
+  size_t n, size;
+  char buf[BUFSIZ];
+
+  size=filesize(name);
+  if( (fp=fopen(name, "r"))==NULL )
+    {
+      serverreply(fd, "ERROR %.3f 0 Can't open %s\n", latency, name);
+      return;
+    }
+  serverreply(fd, "OK %.3f %lu %lu\n", latency, numimg, size);
+  while( (n=fread(buf, 1, sizeof buf, fp))>0 )
+    if(send(fd, buf, n, MSG_NOSIGNAL)<0)
+      break;
+  fclose(fp);
+  unlink(name);
+}
+
+
+
+
+
+/* Answer one line of a client. A request is:
+
+       RA DEC [SIZE] [name=NAME] [weight=0|1] [send]
+
+   SIZE is in arcseconds (the default is the value of `-p`), the
+   thumbnail is called NAME in the output folder (the default is
+   `r<request number><ext>`). With `send` the thumbnail itself is
+   sent after the reply and not kept. A line of `STOP` stops the
+   server. Return 1 if the server should stop. */
+int
+serverrequest(struct server *s, int fd, char *line)
+{
+  struct timeval t1;
+  struct tifaaparams *p=s->p;
+  size_t reqnum;
+  struct tifaacropinfo info;
+  double world[2], ps_size=p->ps_size, latency, val;
+  char name[SERVERNAMELEN], *tok, *tailptr, *given=NULL, *save;
+  int err, len, sendfile=0, weight=p->weightmultip, nread=0;
+  char fitserr[FLEN_STATUS];
+
+  gettimeofday(&t1, NULL);
+  if(strncmp(line, "STOP", 4)==0)
+    {
+      serverreply(fd, "OK 0.000 0 -\n");
+      return 1;
+    }
+
+  /* Read the request, the first (up to three) numbers are the RA,
+     Dec and size. */
+  for(tok=strtok_r(line, " \t\n", &save);tok;
+      tok=strtok_r(NULL, " \t\n", &save))
+    {
+      val=strtod(tok, &tailptr);
+      if(nread<3 && *tailptr=='\0')
+	{
+	  if(nread<2) world[nread]=val;
+	  else        ps_size=val;
+	  ++nread;
+	}
+      else if(strncmp(tok, "name=", 5)==0) given=tok+5;
+      else if(strncmp(tok, "weight=", 7)==0) weight=atoi(tok+7);
+      else if(strcmp(tok, "send")==0) sendfile=1;
+      else
+	{
+	  serverreply(fd, "ERROR %.3f 0 Unknown `%s`\n", mseclap(&t1), tok);
+	  return 0;
+	}
+    }
+  if(nread<2 || ps_size<=0 || (weight && p->weightmultip==0)
+     || (given && (strchr(given, '/') || strlen(given)>SERVERNAMELEN/2)))
+    {
+      serverreply(fd, "ERROR 0.000 0 Bad request (see `tifaa -h`)\n");
+      return 0;
+    }
+
+  /* Name of the output. */
+  pthread_mutex_lock(&s->m);
+  reqnum=++s->numreq;
+  pthread_mutex_unlock(&s->m);
+  if(given)
+    len=snprintf(name, sizeof name, "%s%s", p->out_name, given);
+  else
+    len=snprintf(name, sizeof name, "%sr%lu%s", p->out_name, reqnum,
+		 p->out_ext);
+  if(len<0 || (size_t)len>=sizeof name)
+    {
+      serverreply(fd, "ERROR 0.000 0 Bad request (see `tifaa -h`)\n");
+      return 0;
+    }
+
+  /* Crop it and reply. */
+  err=tifaacropfile(s->survey, world[0], world[1], ps_size, weight,
+		    p->chk_size, name, &info);
+  latency=mseclap(&t1);
+  if(err==TIFAA_EFITS)
+    {
+      fits_get_errstatus(info.fitsstatus, fitserr);
+      serverreply(fd, "ERROR %.3f %lu %s\n", latency, info.numimg, fitserr);
+    }
+  else if(err)
+    serverreply(fd, "ERROR %.3f %lu %s\n", latency, info.numimg,
+		tifaastrerror(err));
+  else if(info.flag==TIFAA_NOTINFIELD)
+    serverreply(fd, "NOTINFIELD %.3f 0 -\n", latency);
+  else if(info.flag==TIFAA_BLANK)
+    serverreply(fd, "BLANK %.3f %lu -\n", latency, info.numimg);
+  else if(sendfile)
+    serversendfile(fd, name, latency, info.numimg);
+  else
+    serverreply(fd, "OK %.3f %lu %s\n", latency, info.numimg, name);
+
+  if(p->verb)
+    printf("%5lu: (%f, %f) %lu image(s), flag %d, %.3f ms.\n", reqnum,
+	   world[0], world[1], info.numimg, err ? -1 : info.flag, latency);
+  return 0;
+}
+
+
+
+
+
+/* Each thread waits for a connection and answers all its requests
+   until the client closes it. */
+void *
+serverthread(void *inparam)
+{
+  FILE *in;
+  char *line=NULL;
+  size_t linelen=0;
+  int fd, stop=0;
+  struct server *s=(struct server *)inparam;
+
+  while(1)
+    {
+      fd=accept(s->sock, NULL, NULL);
+      pthread_mutex_lock(&s->m);
+      stop=s->stop;
+      pthread_mutex_unlock(&s->m);
+      if(stop) { if(fd>=0) close(fd); break; }
+      if(fd<0) continue;
+
+      assert( (in=fdopen(dup(fd), "r"))!=NULL );
+      while(stop==0 && getline(&line, &linelen, in)>0)
+	stop=serverrequest(s, fd, line);
+      fclose(in);
+      close(fd);
+
+      /* Wake up the other threads waiting in accept(). */
+      if(stop)
+	{
+	  pthread_mutex_lock(&s->m);
+	  s->stop=1;
+	  pthread_mutex_unlock(&s->m);
+	  shutdown(s->sock, SHUT_RDWR);
+	  break;
+	}
+    }
+  free(line);
+  return NULL;
+}
+
+
+
+
+
+
+
+
+
+
+
+
+
+
+
+
+
+
+
+
+/******************************************************************/
+/****************        Main function        *********************/
+/******************************************************************/
+/* Listen on the Unix socket `p->socket_name` and crop thumbnails for
+   the requests that come in. The survey image information is only
+   read once and the survey images are kept open with their WCS (see
+   libtifaa.c), so each request only has to read its pixels. */
+void
+tifaaserver(struct tifaaparams *p)
+{
+  int err;
+  size_t i, badimg;
+  struct server s;
+  pthread_t *t;
+  struct timeval t1;
+  struct sockaddr_un addr;
+  char report[100];
+
+  /* The output names (with the longest name a request can give)
+     have to fit in SERVERNAMELEN. */
+  if(strlen(p->out_name)+strlen(p->out_ext)+SERVERNAMELEN/2+30
+     >=SERVERNAMELEN)
+    {
+      fprintf(stderr, "Error: output name `%s` is too long for the "
+	      "server.\n", p->out_name);
+      exit(EXIT_FAILURE);
+    }
+
+  s.p=p; s.stop=0; s.numreq=0;
+  pthread_mutex_init(&s.m, NULL);
+
+  /* Read the survey. */
+  if(p->verb) gettimeofday(&t1, NULL);
+  err=tifaaopen(&s.survey, p->survglob.gl_pathv,
+		p->weightmultip ? p->wsurvglob.gl_pathv : NULL,
+		p->survglob.gl_pathc, p->res, p->numthrd, &badimg);
+  if(err==TIFAA_OK)
+    err=tifaasetcache(s.survey, p->cachemb*1024*1024);
+  if(err)
+    exitonerror(err, p->survglob.gl_pathv[badimg], 0, 0);
+  if(p->verb) 
+    {
+      sprintf(report, "WCS info of %lu image(s) has been read.", 
+	      (size_t)(p->survglob.gl_pathc));
+      reporttiming(&t1, report, 1);
+    }
+
+  /* Prepare the socket. */
+  memset(&addr, 0, sizeof addr);
+  addr.sun_family=AF_UNIX;
+  if(strlen(p->socket_name)>=sizeof addr.sun_path)
+    {
+      fprintf(stderr, "Error: socket name `%s` is too long.\n",
+	      p->socket_name);
+      exit(EXIT_FAILURE);
+    }
+  strcpy(addr.sun_path, p->socket_name);
+  unlink(p->socket_name);
+  assert( (s.sock=socket(AF_UNIX, SOCK_STREAM, 0))>=0 );
+  if( bind(s.sock, (struct sockaddr *)&addr, sizeof addr)
+      || listen(s.sock, SERVERLISTEN) )
+    {
+      perror(p->socket_name);
+      exit(EXIT_FAILURE);
+    }
+  printf("Listening on %s (%lu threads).\n", p->socket_name, p->numthrd);
+  fflush(stdout);
+
+  /* Answer the requests until one asks to stop. */
+  assert( (t=malloc(p->numthrd*sizeof *t))!=NULL );
+  for(i=0;i<p->numthrd;++i)
+    pthread_create(&t[i], NULL, serverthread, &s);
+  for(i=0;i<p->numthrd;++i)
+    pthread_join(t[i], NULL);
+  close(s.sock);
+  unlink(p->socket_name);
+  printf("%lu request(s) answered.\n", s.numreq);
+
+  tifaaclose(s.survey);
+  pthread_mutex_destroy(&s.m);
+  free(t);
+}
@@ -0,0 +1,43 @@
+/*********************************************************************
+tifaa - Thumbnail images from astronomical archives
+A simple set of functions to crop thumbnails from astronomical archives.
+
+Copyright (C) 2013-2014 Mohammad Akhlaghi
+Tohoku University Astronomical Institute, Sendai, Japan.
+http://astr.tohoku.ac.jp/~akhlaghi/
+
+tifaa is free software: you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation, either version 3 of the License, or
+(at your option) any later version.
+
+tifaa is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with tifaa.  If not, see <http://www.gnu.org/licenses/>.
+**********************************************************************/
+#ifndef SERVER_H
+#define SERVER_H
+
+#include <pthread.h>
+
+#define SERVERLISTEN      64    /* Queue of pending connections.      */
+#define SERVERNAMELEN     1000  /* Maximum length of output names.    */
+
+struct server
+{
+  struct tifaaparams   *p;  /* All the parameters.                      */
+  struct tifaasurvey *survey; /* The survey (see libtifaa.h).           */
+  int                sock;  /* The listening socket.                    */
+  int                stop;  /* ==1: A client asked the server to stop.  */
+  size_t           numreq;  /* Number of crop requests so far.          */
+  pthread_mutex_t       m;  /* Mutex for `stop` and `numreq`.           */
+};
+
+void
+tifaaserver(struct tifaaparams *p);
+
+#endif
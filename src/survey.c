@@ -0,0 +1,396 @@
+/*********************************************************************
+tifaa - Thumbnail images from astronomical archives
+A simple set of functions to crop thumbnails from astronomical archives.
+
+Copyright (C) 2013-2014 Mohammad Akhlaghi
+Tohoku University Astronomical Institute, Sendai, Japan.
+http://astr.tohoku.ac.jp/~akhlaghi/
+
+tifaa is free software: you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation, either version 3 of the License, or
+(at your option) any later version.
+
+tifaa is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with tifaa.  If not, see <http://www.gnu.org/licenses/>.
+**********************************************************************/
+#include <glob.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <assert.h>
+#include <string.h>
+#include <pthread.h>
+
+#include "tifaa.h"
+#include "fitsfz.h"
+#include "libtifaa.h"
+#include "walker.h"
+#include "surveyimginfo.h"
+#include "survey.h"
+
+
+
+
+
+
+
+
+
+
+
+
+
+
+
+
+
+
+
+
+/********************************************************************/
+/*****************            Errors           **********************/
+/********************************************************************/
+/* Report the error of prepare_fitswcs() (or any other function
+   returning the error codes of libtifaa.h) on image `name` and
+   abort. If the status of CFITSIO isn't known (zero), its messages
+   are printed. */
+void
+exitonerror(int err, char *name, int f_status, int w_status)
+{
+  char msg[FLEN_ERRMSG];
+
+  if(err==TIFAA_EFITS && f_status)
+    fits_report_error(stderr, f_status);
+  else if(err==TIFAA_EFITS)
+    while(fits_read_errmsg(msg))
+      fprintf(stderr, "%s\n", msg);
+  else if(err==TIFAA_EWCS)
+    fprintf(stderr, "WCSLIB ERROR %d: %s.\n", w_status,
+	    wcs_errmsg[w_status]);
+  fprintf(stderr, "%s: %s. TIFAA aborted.\n", name, tifaastrerror(err));
+  exit(EXIT_FAILURE);
+}
+
+
+
+
+
+
+
+
+
+
+
+
+
+
+
+
+
+
+
+
+/********************************************************************/
+/*****************     Images of the survey    **********************/
+/********************************************************************/
+/* Called by the directory walker (on its threads) for every image of
+   the first band as soon as it is found. */
+void
+discoveredimage(char *name, size_t id, void *arg)
+{
+  struct discoverparams *d=(struct discoverparams *)arg;
+  double row[NUM_IMAGEINFO_COLS], *rows;
+  struct fzindex fz, *fzs;
+  size_t size;
+  int err;
+
+  /* After the first error, the rest are only found. */
+  pthread_mutex_lock(&d->m);
+  err=d->err;
+  pthread_mutex_unlock(&d->m);
+  if(err) return;
+
+  memset(&fz, 0, sizeof fz);
+  err=get_imginfo(name, row, 0, d->res, &d->wm, &fz);
+
+  pthread_mutex_lock(&d->m);
+  if(err)
+    {
+      if(d->err==TIFAA_OK)
+	{
+	  d->err=err;
+	  assert( (d->badname=malloc(strlen(name)+1))!=NULL );
+	  strcpy(d->badname, name);
+	}
+      fzfreeindex(&fz);
+    }
+  else
+    {
+      if(id>=d->size)
+	{
+	  for(size=d->size;size<=id;size*=2);
+	  assert( (rows=realloc(d->rows, size*NUM_IMAGEINFO_COLS
+				*sizeof *rows))!=NULL );
+	  assert( (fzs=realloc(d->fz, size*sizeof *fzs))!=NULL );
+	  d->rows=rows;
+	  d->fz=fzs;
+	  d->size=size;
+	}
+      memcpy(&d->rows[id*NUM_IMAGEINFO_COLS], row, sizeof row);
+      d->fz[id]=fz;
+    }
+  pthread_mutex_unlock(&d->m);
+}
+
+
+
+
+
+/* Find the images of the first band (`wildcard`) and read their
+   information at the same time: the directories are read on all the
+   threads and each image is indexed as soon as it is found, so with
+   many directories (and many images) neither has to wait for the
+   other. `tp->survglob`, `tp->imginfo` and `tp->fzindex` (for all
+   the bands) are allocated and filled. The output is 0 or one of
+   glob()'s error codes (see walkglob()). */
+int
+discoversurvey(struct tifaaparams *tp, char *wildcard)
+{
+  int out;
+  size_t i, n, *ids;
+  struct discoverparams d;
+
+  d.res=tp->res;
+  d.size=WALKQUEUE;
+  d.err=TIFAA_OK;
+  d.badname=NULL;
+  assert( (d.rows=malloc(d.size*NUM_IMAGEINFO_COLS
+			 *sizeof *d.rows))!=NULL );
+  assert( (d.fz=malloc(d.size*sizeof *d.fz))!=NULL );
+  pthread_mutex_init(&d.m, NULL);
+  pthread_mutex_init(&d.wm, NULL);
+
+  out=walkglob(wildcard, tp->numthrd, discoveredimage, &d, &tp->survglob,
+	       &ids);
+  pthread_mutex_destroy(&d.m);
+  pthread_mutex_destroy(&d.wm);
+  if(out==0 && d.err)
+    exitonerror(d.err, d.badname, 0, 0);
+
+  /* Put the rows in the (sorted) order of the names. */
+  if(out==0)
+    {
+      n=tp->survglob.gl_pathc;
+      assert( (tp->imginfo=malloc(n*NUM_IMAGEINFO_COLS
+				  *sizeof *tp->imginfo))!=NULL );
+      assert( (tp->fzindex=calloc(tp->numbands*n,
+				  sizeof *tp->fzindex))!=NULL );
+      for(i=0;i<n;++i)
+	{
+	  memcpy(&tp->imginfo[i*NUM_IMAGEINFO_COLS],
+		 &d.rows[ids[i]*NUM_IMAGEINFO_COLS],
+		 NUM_IMAGEINFO_COLS*sizeof *tp->imginfo);
+	  tp->fzindex[i]=d.fz[ids[i]];
+	}
+      tp->indexed=1;
+      free(ids);
+    }
+  free(d.rows);
+  free(d.fz);
+  return out;
+}
+
+
+
+
+
+void
+getsurveyimageinfo(struct tifaaparams *tp)
+{
+  int err;
+  size_t b, badimg, n=tp->survglob.gl_pathc;
+
+  /* Without discoversurvey(), the first band is read here. Otherwise
+     only its weights have to be indexed. */
+  if(tp->indexed==0)
+    err=surveyimageinfo(tp->survglob.gl_pathv,
+			tp->weightmultip ? tp->wsurvglob.gl_pathv : NULL,
+			tp->survglob.gl_pathc, tp->res, tp->numthrd,
+			tp->imginfo, tp->fzindex,
+			tp->weightmultip ? tp->wfzindex : NULL, &badimg);
+  else if(tp->weightmultip)
+    err=surveyimageinfo(tp->wsurvglob.gl_pathv, NULL, n, tp->res,
+			tp->numthrd, NULL, tp->wfzindex, NULL, &badimg);
+  else
+    err=TIFAA_OK;
+  if(err)
+    exitonerror(err, tp->indexed ? tp->wsurvglob.gl_pathv[badimg]
+		: tp->survglob.gl_pathv[badimg], 0, 0);
+
+  /* The other bands use the WCS of the first, they are only
+     indexed. */
+  for(b=1;b<tp->numbands;++b)
+    {
+      err=surveyimageinfo(tp->bandglob[b-1].gl_pathv,
+			  tp->weightmultip ? tp->wbandglob[b-1].gl_pathv
+			  : NULL, n, tp->res, tp->numthrd, NULL,
+			  &tp->fzindex[b*n],
+			  tp->weightmultip ? &tp->wfzindex[b*n] : NULL,
+			  &badimg);
+      if(err)
+	exitonerror(err, tp->bandglob[b-1].gl_pathv[badimg], 0, 0);
+    }
+}
+
+
+
+
+
+
+
+
+
+
+
+
+
+
+
+
+
+
+
+
+/********************************************************************/
+/*****************    Images of each target    **********************/
+/********************************************************************/
+/* Find the images of the targets from `p->first` to `p->last`. Each
+   thread keeps the images of its targets in its own `p->imgs` (the
+   targets of a thread are contiguous, so they are later copied into
+   `wiimg` in one piece). The number of images of each target is put
+   in `wioff` (after it). */
+void *
+whichimgthreads(void *inparams)
+{
+  struct whichimgthreadparams *p=(struct whichimgthreadparams *)inparams;
+  struct tifaaparams *tp=p->tp;
+  size_t t, n, size=1024, cs1=tp->cs1;
+
+  assert( (p->imgs=malloc(size*sizeof *p->imgs))!=NULL );
+  p->nimgs=p->max=0;
+  for(t=p->first;t<p->last;++t)
+    {
+      while( (n=imagesforonetarget(tp->cat[t*cs1+tp->ra_col],
+				   tp->cat[t*cs1+tp->dec_col],
+				   cropside(targetpssize(tp, t),
+					    tp->res)/2.0,
+				   tp->imginfo, tp->survglob.gl_pathc,
+				   p->imgs+p->nimgs, size-p->nimgs))
+	     > size-p->nimgs )
+	{
+	  size*=2;
+	  assert( (p->imgs=realloc(p->imgs, size*sizeof *p->imgs))!=NULL );
+	}
+      tp->wioff[t+1]=n;
+      p->nimgs+=n;
+      if(n>p->max) p->max=n;
+    }
+
+  /* Increment the `done` counter and return. */
+  pthread_mutex_lock(p->m);
+  ++(*p->done);
+  pthread_cond_signal(p->c);
+  pthread_mutex_unlock(p->m);
+  return NULL;
+}
+
+
+
+
+
+/* Find the images that are needed for every target in the catalog
+   (on all the threads) and keep them in `wioff` and `wiimg` (a
+   compressed sparse row structure, see tifaa.h). Notice that the size
+   of each target (see targetpssize()) is in arcseconds, it is
+   converted to pixels like the thumbnail (see cropside()).*/
+void 
+whichimageforwhichtargets(struct tifaaparams *tp)
+{
+  pthread_t *t;
+  size_t i, nt=tp->numthrd;
+  pthread_cond_t cv;
+  pthread_attr_t attr;
+  pthread_mutex_t mtx;
+  size_t done, numactive;
+  struct whichimgthreadparams *p;
+
+  /* Threads/mutexs/condition variables initialization. */
+  pthread_attr_init(&attr);
+  pthread_cond_init(&cv, NULL);
+  pthread_mutex_init(&mtx, NULL);
+  assert( (t=malloc(nt*sizeof *t))!=NULL );
+  assert( (p=malloc(nt*sizeof *p))!=NULL );
+  pthread_attr_setdetachstate(&attr, PTHREAD_CREATE_DETACHED);
+
+  /* Each thread gets a contiguous range of targets. */
+  for(i=0;i<nt;++i)
+    {
+      p[i].id=i; p[i].tp=tp;
+      p[i].first=i*tp->cs0/nt; p[i].last=(i+1)*tp->cs0/nt;
+      p[i].imgs=NULL; p[i].nimgs=p[i].max=0;
+      p[i].c=&cv; p[i].m=&mtx; p[i].done=&done;
+    }
+
+  /* Spin off the threads and wait for them to finish: */
+  done=numactive=0;
+  for(i=0;i<nt;++i)
+    if(p[i].first<p[i].last)
+      {
+	++numactive;
+	pthread_create(&t[i], &attr, whichimgthreads, &p[i]);
+      }
+  pthread_mutex_lock(&mtx);
+  while(done<numactive)
+    pthread_cond_wait(&cv, &mtx);
+  pthread_mutex_unlock(&mtx);
+
+  /* The start of each target's images, then put the images of all
+     the threads in their place. */
+  tp->wioff[0]=0;
+  for(i=0;i<tp->cs0;++i)
+    tp->wioff[i+1]+=tp->wioff[i];
+  free(tp->wiimg);
+  assert( (tp->wiimg=malloc((tp->wioff[tp->cs0]+1)
+			    *sizeof *tp->wiimg))!=NULL );
+  tp->wimax=0;
+  for(i=0;i<nt;++i)
+    {
+      if(p[i].nimgs)
+	memcpy(&tp->wiimg[tp->wioff[p[i].first]], p[i].imgs,
+	       p[i].nimgs*sizeof *p[i].imgs);
+      if(p[i].max>tp->wimax) tp->wimax=p[i].max;
+      free(p[i].imgs);
+    }
+
+  free(p);
+  free(t);
+
+  /* In case you want to see the table: 
+  {
+    size_t j;
+    for(i=0;i<tp->cs0;i++)
+      {
+	printf("%lu: ", i);
+	for(j=tp->wioff[i];j<tp->wioff[i+1];j++)
+	  printf("%u, ", tp->wiimg[j]);
+	printf("\b\b.\n");
+      }
+    exit(0);
+  }
+  */
+}
@@ -0,0 +1,72 @@
+/*********************************************************************
+tifaa - Thumbnail images from astronomical archives
+A simple set of functions to crop thumbnails from astronomical archives.
+
+Copyright (C) 2013-2014 Mohammad Akhlaghi
+Tohoku University Astronomical Institute, Sendai, Japan.
+http://astr.tohoku.ac.jp/~akhlaghi/
+
+tifaa is free software: you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation, either version 3 of the License, or
+(at your option) any later version.
+
+tifaa is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with tifaa.  If not, see <http://www.gnu.org/licenses/>.
+**********************************************************************/
+#ifndef SURVEY_H
+#define SURVEY_H
+
+#include <stdint.h>
+#include <pthread.h>
+
+#include "fitsfz.h"
+
+/* Indexing the images of the first band while the directories are
+   still being walked (see discoversurvey()). */
+struct discoverparams
+{
+  double          res; /* Resolution of the image.                     */
+  double        *rows; /* imginfo of each image, in the order found.   */
+  struct fzindex  *fz; /* fzindex of each image, in the order found.   */
+  size_t         size; /* Allocated rows in `rows` and `fz`.           */
+  int             err; /* Error code of the first image that failed.   */
+  char       *badname; /* Name of that image.                          */
+  pthread_mutex_t   m; /* Mutex for everything above.                  */
+  pthread_mutex_t  wm; /* Mutex for the WCS functions.                 */
+};
+
+/* Finding the images of a range of targets (see
+   whichimageforwhichtargets()). */
+struct whichimgthreadparams
+{
+  size_t           id; /* Thread ID.                                   */
+  struct tifaaparams *tp; /* All the parameters.                       */
+  size_t        first; /* First target of this thread.                 */
+  size_t         last; /* One after the last target of this thread.    */
+  uint32_t      *imgs; /* Images of all the targets of this thread.    */
+  size_t        nimgs; /* Number of elements in `imgs`.                */
+  size_t          max; /* Most images of one target.                   */
+  size_t        *done; /* Pointer to number of complete threads.       */
+  pthread_cond_t   *c; /* Pointer to the general conditional variable. */
+  pthread_mutex_t  *m; /* Pointer to the general mutex variable.       */
+};
+
+void
+exitonerror(int err, char *name, int f_status, int w_status);
+
+int
+discoversurvey(struct tifaaparams *tp, char *wildcard);
+
+void
+getsurveyimageinfo(struct tifaaparams *tp);
+
+void 
+whichimageforwhichtargets(struct tifaaparams *tp);
+
+#endif
@@ -20,14 +20,15 @@ You should have received a copy of the GNU General Public License
 along with tifaa.  If not, see <http://www.gnu.org/licenses/>.
 **********************************************************************/
 #include <math.h>
-#include <glob.h>
 #include <stdio.h>
 #include <stdlib.h>
-#include <assert.h>
 #include <string.h>
 #include <pthread.h>
 
 #include "tifaa.h"
+#include "timing.h"
+#include "fitsfz.h"
+#include "libtifaa.h"
 #include "surveyimginfo.h"
 
 
@@ -36,15 +37,17 @@ along with tifaa.  If not, see <http://www.gnu.org/licenses/>.
    index to a thread such that the maximum difference between the
    number of images for each thread is 1. The results will be saved in
    a 2D array of `outlabthrdcols` columns and each row will finish
-   with a NONINDEX (see surveyimginfo.h). */
-void
+   with a NONINDEX (see surveyimginfo.h). The output is TIFAA_ENOMEM
+   if there wasn't enough memory (TIFAA_OK otherwise). */
+int
 prepindexsinthreads(size_t nindexs, size_t nthrds, size_t **outthrds,
 		    size_t *outthrdcols)
 {
   size_t *sp, *fp;
   size_t i, *thrds, thrdcols;
   *outthrdcols = thrdcols = nindexs/nthrds+2;
-  assert( (thrds=*outthrds=malloc(nthrds*thrdcols*sizeof *thrds))!=NULL );
+  if( (thrds=*outthrds=malloc(nthrds*thrdcols*sizeof *thrds))==NULL )
+    return TIFAA_ENOMEM;
   
   /* Initialize all the elements to NONINDEX. */
   fp=(sp=thrds)+nthrds*thrdcols;
@@ -66,36 +69,227 @@ prepindexsinthreads(size_t nindexs, size_t nthrds, size_t **outthrds,
     }
   exit(0);
   */
+  return TIFAA_OK;
+}
+
+
+
+
+
+/* 1 if the keyword of the header card `card` might be used by
+   wcspih() (or is one of the NAXIS keywords). COMMENT, HISTORY and
+   all the other keywords (thousands in some drizzled images) aren't
+   needed. */
+int
+iswcskey(char *card)
+{
+  size_t i;
+  static char *keys[]={"NAXIS", "WCSAXES", "CTYPE", "CRPIX", "CRVAL",
+		       "CDELT", "CUNIT", "CROTA", "CD", "PC", "PV", "PS",
+		       "CNAME", "CRDER", "CSYER", "LONPOLE", "LATPOLE",
+		       "RADESYS", "RADECSYS", "EQUINOX", "EPOCH", "MJD",
+		       "DATE", "WCSNAME", "RESTFR", "RESTWAV", "SPECSYS",
+		       "SSYS", "VELREF", "VELANGL", "ZSOURCE", "OBSGEO",
+		       "A_", "B_", "AP_", "BP_", "CPDIS", "CQDIS", "CPERR",
+		       "CQERR", "DP", "DQ", "DVERR", "TIMESYS", "TREF",
+		       NULL};
+
+  for(i=0;keys[i];++i)
+    if(strncmp(card, keys[i], strlen(keys[i]))==0)
+      return 1;
+  return 0;
+}
+
+
+
+
+
+/* Make sure `*header` (of `*hsize` bytes) has `need` bytes. The output
+   is 1 if there isn't enough memory. */
+int
+growheader(char **header, size_t *hsize, size_t need)
+{
+  if(need<=*hsize) return 0;
+  free(*header);
+  if( (*header=malloc(need))==NULL )
+    {
+      *hsize=0;
+      return 1;
+    }
+  *hsize=need;
+  return 0;
+}
+
+
+
+
+
+/* Read the header of the current HDU of `fptr` directly from the file
+   `name`: one pass over its 2880 byte blocks, keeping only the cards
+   of iswcskey() in `*header` (see readheaderinto()). This is only
+   possible for files that are on disk and not compressed as a whole
+   (CFITSIO decompresses those in memory), with an extension in
+   `name` or any other problem, the output is 0 and CFITSIO has to be
+   used. */
+int
+rawwcsheader(char *name, fitsfile *fptr, char **header, size_t *hsize,
+	     int *nkeys)
+{
+  FILE *fp;
+  int end=0, status=0;
+  char block[2880], *c, *h;
+  size_t i, len=strlen(name);
+  LONGLONG headstart, datastart, dataend;
+  static char *packed[]={".gz", ".Z", ".z", ".zip", ".bz2", NULL};
+
+  if(strchr(name, '[') || strstr(name, "://") || strcmp(name, "-")==0)
+    return 0;
+  for(i=0;packed[i];++i)
+    if(len>strlen(packed[i])
+       && strcmp(name+len-strlen(packed[i]), packed[i])==0)
+      return 0;
+
+  /* Where the header of this HDU is in the file. */
+  fits_get_hduaddrll(fptr, &headstart, &datastart, &dataend, &status);
+  if(status || datastart<=headstart
+     || growheader(header, hsize, datastart-headstart+81)
+     || (fp=fopen(name, "r"))==NULL)
+    return 0;
+  if(fseeko(fp, headstart, SEEK_SET))
+    {
+      fclose(fp);
+      return 0;
+    }
+
+  h=*header;
+  *nkeys=0;
+  while(!end && fread(block, 1, 2880, fp)==2880)
+    for(c=block;c<block+2880;c+=80)
+      {
+	if(strncmp(c, "END     ", 8)==0)
+	  {
+	    end=1;
+	    break;
+	  }
+	if(iswcskey(c))
+	  {
+	    memcpy(h, c, 80);
+	    h+=80;
+	    ++*nkeys;
+	  }
+      }
+  fclose(fp);
+  if(!end) return 0;
+
+  memcpy(h, "END", 3);
+  memset(h+3, ' ', 77);
+  h[80]='\0';
+  return 1;
 }
 
 
 
 
 
-/* This function will open a FITS file, read the header and output a
- prepared wcsprm
+/* Put the header of `fptr` (opened from `name`) in the `*hsize` bytes
+   of `*header`, like fits_convert_hdr2str() (80 characters for each
+   keyword), making it larger if necessary. Only the keywords that
+   WCSLIB might need are kept (see iswcskey()), read directly from
+   the file when possible (see rawwcsheader()), otherwise one by one
+   with CFITSIO. Compressed images still need fits_convert_hdr2str()
+   (to get the header of the image, not of its table). */
+void
+readheaderinto(char *name, fitsfile *fptr, char **header, size_t *hsize,
+	       int *nkeys, int *status)
+{
+  char card[FLEN_CARD], *tmp=NULL, *h;
+  int k, nall=0, compressed=fits_is_compressed_image(fptr, status);
+  size_t len;
+
+  if(*status) return;
+  if(compressed)
+    {
+      fits_convert_hdr2str(fptr, 1, NULL, 0, &tmp, nkeys, status);
+      if(*status) return;
+      if(growheader(header, hsize, strlen(tmp)+1))
+	*status=MEMORY_ALLOCATION;
+      else
+	memcpy(*header, tmp, strlen(tmp)+1);
+      free(tmp);
+      return;
+    }
+  if(rawwcsheader(name, fptr, header, hsize, nkeys))
+    return;
+
+  fits_get_hdrspace(fptr, &nall, NULL, status);
+  if(*status) return;
+  if(growheader(header, hsize, (size_t)(nall+1)*80+1))
+    {
+      *status=MEMORY_ALLOCATION;
+      return;
+    }
+  h=*header;
+  *nkeys=0;
+  for(k=1;k<=nall;++k)
+    {
+      fits_read_record(fptr, k, card, status);
+      if(!iswcskey(card)) continue;
+      len=strlen(card);
+      memcpy(h, card, len);
+      memset(h+len, ' ', 80-len);
+      h+=80;
+      ++*nkeys;
+    }
+  memcpy(h, "END", 3);
+  memset(h+3, ' ', 77);
+  h[80]='\0';
+}
+
+
+
+
+
+/* This function will open a FITS file (its first image HDU, which
+ might be tile compressed), read the header and output a prepared
+ wcsprm. If `lockwait!=NULL`, the time spent waiting for the
+ WCS mutex (in milliseconds) is added to it. The output is one of the
+ error codes in libtifaa.h, when it is not TIFAA_OK, nothing is left
+ open or allocated and `f_status` or `w_status` show the error.
+
+ If `hsize==NULL`, the full header is put in `*fullheader`, which is
+ allocated here and has to be freed after it. Otherwise it is a
+ buffer of `*hsize` bytes that is reused (and made larger when
+ needed) for many images and it is not freed here, only the keywords
+ that WCSLIB needs are put in it (see readheaderinto()).
                                          
  Don't forget to free the space after it: 
 
     status = wcsvfree(&nwcs,&wcs); */
-void 
+int
 prepare_fitswcs(char *fits_name, fitsfile **fptr, int *f_status, 
 		int *w_status, int *nwcs, struct wcsprm **wcs,
-		pthread_mutex_t *wm, char **fullheader)
+		pthread_mutex_t *wm, char **fullheader, size_t *hsize,
+		double *lockwait)
 {
   /* Declaratins: */
-  int nkeys=0, relax, ctrl, nreject;
+  struct timeval t1;
+  int nkeys=0, relax, ctrl, nreject, c_status=0;
 
   /********************************************
    ***********   CFITSIO functions:  **********
    ***********   To read the header  **********
    ********************************************/
-  fits_open_file(fptr, fits_name, READONLY, f_status);
-  fits_hdr2str(*fptr, 1, NULL, 0, fullheader, &nkeys, f_status);
+  if(hsize==NULL) *fullheader=NULL;
+  fits_open_image(fptr, fits_name, READONLY, f_status);
+  if(hsize)
+    readheaderinto(fits_name, *fptr, fullheader, hsize, &nkeys, f_status);
+  else
+    fits_convert_hdr2str(*fptr, 1, NULL, 0, fullheader, &nkeys, f_status);
   if (*f_status!=0)
     {
-      fits_report_error(stderr, *f_status);
-      exit(EXIT_FAILURE);
+      if(*fptr) fits_close_file(*fptr, &c_status);
+      *fptr=NULL;
+      return TIFAA_EFITS;
     }
  
   /********************************************
@@ -105,23 +299,92 @@ prepare_fitswcs(char *fits_name, fitsfile **fptr, int *f_status,
   relax    = WCSHDR_all; /* A macro, to use all informal WCS extensions. */
   ctrl     = 0;          /* Don't report why a keyword wasn't used. */
   nreject  = 0;          /* Number of keywords rejected for syntax. */
+  if(lockwait) gettimeofday(&t1, NULL);
   pthread_mutex_lock(wm);
+  if(lockwait) *lockwait+=mseclap(&t1);
   *w_status = wcspih(*fullheader, nkeys, relax, ctrl, &nreject, nwcs, wcs);
   pthread_mutex_unlock(wm);
+
+  /* Initialize the wcsprm struct */
+  if (*w_status==0 && (*w_status = wcsset(*wcs)))
+    wcsvfree(nwcs, wcs);
   if (*w_status!=0)
     {
-      fprintf(stderr, "wcspih ERROR %d: %s.\n", *w_status, 
-	      wcs_errmsg[*w_status]);
-      exit(EXIT_FAILURE);
+      if(hsize==NULL) free(*fullheader);
+      fits_close_file(*fptr, &c_status);
+      *fptr=NULL;
+      return TIFAA_EWCS;
     }
+  return TIFAA_OK;
+}
 
-  /* Initialize the wcsprm struct */
-  if ((*w_status = wcsset(*wcs))) 
+
+
+
+
+/* Angular distance (in degrees) between two points on the sky (in
+   degrees), with the haversine formula (accurate for the small
+   distances of tiles and thumbnails). */
+double
+angulardistance(double ra1, double dec1, double ra2, double dec2)
+{
+  double d2r=M_PI/180, a;
+  double sdd=sin((dec2-dec1)*d2r/2), sdr=sin((ra2-ra1)*d2r/2);
+
+  a=sdd*sdd+cos(dec1*d2r)*cos(dec2*d2r)*sdr*sdr;
+  return 2*asin(sqrt(a<1 ? a : 1))/d2r;
+}
+
+
+
+
+
+/* Fill the footprint columns of `row` (one row of imginfo, see
+   get_imginfo()) from the WCS of an image with `naxes` pixels. The
+   vertices are the corners of the image and the middle of its sides
+   (on the edges of the pixels), so a distorted (for example SIP)
+   side is also followed. The output is the status of wcsp2s(). */
+int
+imagefootprint(struct wcsprm *wcs, long *naxes, double *row)
+{
+  int i, w_status, stat[FP_VERTICES+1];
+  double n1=naxes[0], n2=naxes[1], *v=&row[4];
+  double phi[FP_VERTICES+1], theta[FP_VERTICES+1], d;
+  double pixcrd[2*(FP_VERTICES+1)], imgcrd[2*(FP_VERTICES+1)];
+  double world[2*(FP_VERTICES+1)];
+  double px[FP_VERTICES]={0.5, n1/2+0.5, n1+0.5, n1+0.5,
+			  n1+0.5, n1/2+0.5, 0.5, 0.5};
+  double py[FP_VERTICES]={0.5, 0.5, 0.5, n2/2+0.5,
+			  n2+0.5, n2+0.5, n2+0.5, n2/2+0.5};
+
+  /* The center (as before the footprints were added) and the
+     vertices (counter clockwise in the image) in one call. */
+  pixcrd[0]=naxes[0]/2; pixcrd[1]=naxes[1]/2;
+  for(i=0;i<FP_VERTICES;++i)
+    {
+      pixcrd[2*i+2]=px[i];
+      pixcrd[2*i+3]=py[i];
+    }
+  if( (w_status=wcsp2s(wcs, FP_VERTICES+1, 2, pixcrd, imgcrd, phi, theta,
+		       world, stat)) )
+    return w_status;
+
+  /* Column 2: Distance of the farthest vertex from the center, to
+     quickly reject far images. Column 3: The pixel scale, measured
+     on the bottom and left sides. */
+  row[0]=world[0];
+  row[1]=world[1];
+  row[2]=0;
+  for(i=0;i<FP_VERTICES;++i)
     {
-      fprintf(stderr, "wcsset ERROR %d: %s.\n", *w_status, 
-	      wcs_errmsg[*w_status]);
-      exit(EXIT_FAILURE);
+      v[2*i]=world[2*i+2];
+      v[2*i+1]=world[2*i+3];
+      d=angulardistance(row[0], row[1], v[2*i], v[2*i+1]);
+      if(d>row[2]) row[2]=d;
     }
+  row[3]=( angulardistance(v[0], v[1], v[4], v[5])/n1
+	   + angulardistance(v[0], v[1], v[12], v[13])/n2 )/2;
+  return 0;
 }
 
 
@@ -131,70 +394,43 @@ prepare_fitswcs(char *fits_name, fitsfile **fptr, int *f_status,
 /* This function will save the following information for all the images:
    Column 0: RA of image center.
    Column 1: Dec of image center.
-   Column 2: Half width of image (in RA).
-   Column 3: Half height of image (in Dec).*/
-void
+   Column 2: Radius of the footprint around the center (degrees).
+   Column 3: Size of each pixel (degrees).
+   Column 4 onwards: RA and Dec of the FP_VERTICES vertices of the
+                     footprint (see imagefootprint()).
+   If `fz!=NULL`, the compression tiles of the image are also indexed
+   (see fitsfz.h). The output is one of the error codes in
+   libtifaa.h.*/
+int
 get_imginfo(char *fits_name, double *imginfo, unsigned long zero_pos, 
-	    const double res, pthread_mutex_t *wm)
+	    const double res, pthread_mutex_t *wm, struct fzindex *fz)
 {
   fitsfile *fptr;
-  char *fullheader;
   struct wcsprm *wcs;
-  int nwcs=0, f_status=0, w_status=0;
-
-  /* For converting coordinates, note that here we just want to
-     convert one point, so ncoord=1, if you want more than one point,
-     change this to that number.*/
-  int stat[NWCSFIX];
-  double phi, theta, pixcrd[2], imgcrd[2], world[2];
-  int ncoord=1, nelem=2;
-
-  /* For this function */
-  double naxis1, naxis2;
-
-  /* Prepare wcsprm structure: */
-  prepare_fitswcs(fits_name, &fptr, &f_status, &w_status, &nwcs, 
-		  &wcs, wm, &fullheader);
-  fits_read_key(fptr, TDOUBLE, "NAXIS1", &naxis1, NULL, &f_status);
-  fits_read_key(fptr, TDOUBLE, "NAXIS2", &naxis2, NULL, &f_status);
-
-  /* Find the central position of the image: */
-  pixcrd[0]=naxis1/2; pixcrd[1]=naxis2/2;
-
-  /* Explanations about the parameters in wcsp2s: 
-
-     ncoord: Number of points you want to transform. 
-     nelem:  Number of axises for each point. 
-     imgcrd: Intermediate coordinates, keep it empty
-     phi, theta: Intermediate world coordinates
-     world: final world coordinates, 
-
-     keep all of these the same as the declarations as long as you want
-     a conversion for one point, for more than one point, just change
-     ncoord. */
-  w_status = wcsp2s(wcs, ncoord, nelem, pixcrd, imgcrd, 
-		    &phi, &theta, world, stat);
-  if (w_status!=0)
-    {
-      fprintf(stderr, "wcsp2s ERROR %d: %s.\n", 
-	      w_status, wcs_errmsg[w_status]);
-      exit(EXIT_FAILURE);
-    }
+  char *header=NULL;
+  size_t hsize=0;
+  int nwcs=0, f_status=0, w_status=0, err;
+  long naxes[2]={0,0};
 
-  /* Free the spaces: */
-  w_status = wcsvfree(&nwcs, &wcs);
-  fits_close_file(fptr, &f_status);
+  (void)res;   /* The pixel scale is found from the WCS. */
 
-  /* Save the results into the table. About the last two values: It
-     is important to know how far (in degrees) the sides of the images
-     are to their center. So here I find the angular distance of half
-     the width of the image in each axis (in degrees). */
-  imginfo[zero_pos  ] = world[0];
-  imginfo[zero_pos+1] = world[1];
-  imginfo[zero_pos+2] = naxis1/7200*res; /* 7200=2*3600! */
-  imginfo[zero_pos+3] = naxis2/7200*res;
+  /* Prepare wcsprm structure (only with the WCS keywords): */
+  err=prepare_fitswcs(fits_name, &fptr, &f_status, &w_status, &nwcs, &wcs,
+		      wm, &header, &hsize, NULL);
+  free(header);
+  if(err) return err;
+  fits_get_img_size(fptr, 2, naxes, &f_status);
+  if(fz) fzmakeindex(fptr, fz, &f_status);
 
-  free(fullheader);
+  /* The sky footprint of the image: */
+  if(f_status==0)
+    w_status=imagefootprint(wcs, naxes, &imginfo[zero_pos]);
+
+  /* Free the spaces: */
+  err = f_status ? TIFAA_EFITS : (w_status ? TIFAA_EWCS : TIFAA_OK);
+  wcsvfree(&nwcs, &wcs);
+  fits_close_file(fptr, &f_status);
+  return err;
 }
 
 
@@ -224,14 +460,32 @@ imginfothreads(void *inparams)
 {
   struct imginfothreadparams *p= (struct imginfothreadparams *)inparams;
   char **imgnames=p->imgnames;
+  int status;
   size_t i, *imgs;
 
   /* Pull out the row of image indexs for this thread. */
   imgs=&p->imgthrds[p->id*p->thrdcols];
 
+  /* Stop at the first image that can't be read. Without `imginfo`
+     (the other bands), the images are only indexed. */
   for(i=0;imgs[i]!=NONINDEX;++i)
-    get_imginfo(imgnames[imgs[i]], p->imginfo, 
-		imgs[i]*NUM_IMAGEINFO_COLS, p->res, p->wm);
+    {
+      status=0;
+      if(p->imginfo)
+	p->err=get_imginfo(imgnames[imgs[i]], p->imginfo, 
+			   imgs[i]*NUM_IMAGEINFO_COLS, p->res, p->wm,
+			   p->fz ? &p->fz[imgs[i]] : NULL);
+      else if(fzindexfile(imgnames[imgs[i]], &p->fz[imgs[i]], &status))
+	p->err=TIFAA_EFITS;
+      if(p->err==TIFAA_OK && p->wfz
+	 && fzindexfile(p->whtnames[imgs[i]], &p->wfz[imgs[i]], &status))
+	p->err=TIFAA_EFITS;
+      if(p->err)
+	{
+	  p->badimg=imgs[i];
+	  break;
+	}
+    }
 
   /* Increment the `done` counter and return. */
   pthread_mutex_lock(p->m);
@@ -245,39 +499,53 @@ imginfothreads(void *inparams)
 
 
 
-void
-getsurveyimageinfo(struct tifaaparams *tp)
+/* Fill `imginfo` (with NUM_IMAGEINFO_COLS columns) for the `nimgs`
+   images on `nt` threads. The output is one of the error codes in
+   libtifaa.h, if there was an error, `badimg` is the index of the
+   image that caused it. If `fz` (or `wfz`) isn't NULL, it is filled
+   with the fzindex of each image (or weight image in `whtnames`).
+   With `imginfo==NULL`, the images are only indexed (`fz` is then
+   necessary). */
+int
+surveyimageinfo(char **imgnames, char **whtnames, size_t nimgs,
+		double res, size_t nt, double *imginfo,
+		struct fzindex *fz, struct fzindex *wfz, size_t *badimg)
 {
+  int err=TIFAA_OK;
   size_t *imgthrds, thrdcols;
-  size_t nimgs=tp->survglob.gl_pathc;
-  char **imgnames=tp->survglob.gl_pathv;
 
   /* Parameters for parallel processing: */
   pthread_t *t;
+  size_t i;
   pthread_cond_t cv;
   pthread_attr_t attr;
   size_t done, numactive;
-  size_t i, nt=tp->numthrd;
   pthread_mutex_t mtx, wcsmtx;
   struct imginfothreadparams *p;
 
   /* Threads/mutexs/condition variables initialization. */
+  t=malloc(nt*sizeof *t);
+  p=malloc(nt*sizeof *p);
+  if(t==NULL || p==NULL
+     || prepindexsinthreads(nimgs, nt, &imgthrds, &thrdcols))
+    {
+      free(t);
+      free(p);
+      return TIFAA_ENOMEM;
+    }
   pthread_attr_init(&attr);
   pthread_cond_init(&cv, NULL);
   pthread_mutex_init(&mtx, NULL);
   pthread_mutex_init(&wcsmtx, NULL);
-  assert( (t=malloc(nt*sizeof *t))!=NULL );
-  assert( (p=malloc(nt*sizeof *p))!=NULL );
   pthread_attr_setdetachstate(&attr, PTHREAD_CREATE_DETACHED);
-  
-  prepindexsinthreads(nimgs, nt, &imgthrds, &thrdcols);
 
   for(i=0;i<nt;++i)
     {
       p[i].id=i; p[i].imgthrds=imgthrds; p[i].thrdcols=thrdcols;
-      p[i].imgnames=imgnames; p[i].imginfo=tp->imginfo;
-      p[i].res=tp->res; p[i].c=&cv; p[i].m=&mtx; p[i].done=&done;
-      p[i].wm=&wcsmtx;
+      p[i].imgnames=imgnames; p[i].imginfo=imginfo;
+      p[i].whtnames=whtnames; p[i].fz=fz; p[i].wfz=wfz;
+      p[i].res=res; p[i].c=&cv; p[i].m=&mtx; p[i].done=&done;
+      p[i].wm=&wcsmtx; p[i].err=TIFAA_OK;
     }
 
   /* Initalize `done` and `numactive` for this mesh type. */
@@ -297,6 +565,15 @@ getsurveyimageinfo(struct tifaaparams *tp)
     pthread_cond_wait(&cv, &mtx);
   pthread_mutex_unlock(&mtx);
 
+  /* Report the first error (if there was any). */
+  for(i=0;i<nt;++i)
+    if(p[i].err)
+      {
+	err=p[i].err;
+	if(badimg) *badimg=p[i].badimg;
+	break;
+      }
+
   free(p);
   free(t);
   free(imgthrds);
@@ -309,6 +586,7 @@ getsurveyimageinfo(struct tifaaparams *tp)
 	   p->imginfo[i*NUM_IMAGEINFO_COLS+2],
 	   p->imginfo[i*NUM_IMAGEINFO_COLS+3]);
   */
+  return err;
 }
 
 
@@ -333,97 +611,140 @@ getsurveyimageinfo(struct tifaaparams *tp)
 /********************************************************************/
 /*****************      Targets in images      **********************/
 /********************************************************************/
-/* This function will look at the 4 corners of a square that has been
-   identified by the user around the object's RA and Dec. It will then
-   find the images that contain at least one of those points.*/
-void 
-whichimageforwhichtargets(struct tifaaparams *p)
+/* Gnomonic (tangent plane) projection of (`ra`, `dec`) around
+   (`ra0`, `dec0`), all in degrees, `x` increases with RA. The output
+   is 1 if the point is too far to be projected. */
+int
+tangentplane(double ra0, double dec0, double ra, double dec, double *x,
+	     double *y)
 {
-  /* Declarations: */
-  size_t imindex;
-  double *cat=p->cat;
-  double hswr, hswd, decr, *po, *pof, *im, *imf;
-  double points[8], ra, dec, *imginfo=p->imginfo; 
-  size_t cs1=p->cs1, racol=p->ra_col, deccol=p->dec_col;
-  size_t i, j, *whichimg=p->whichimg, counter, cs0=p->cs0;
-
-  /* Set the half side width in degrees and radians, they are done
-     here to simplify the positioning step in the loop. Notice that
-     conf->ps_size was in arcseconds.*/
-  hswd=p->ps_size/7200;
-  hswr=hswd*M_PI/180; 
-  
-  /* To simplify the loop to check all images for a target. */
-  imf=imginfo+((size_t)(p->survglob.gl_pathc)*NUM_IMAGEINFO_COLS);
-  pof=points+8;
+  double d2r=M_PI/180, dra=(ra-ra0)*d2r, cosc;
+  double sd0=sin(dec0*d2r), cd0=cos(dec0*d2r);
+  double sd=sin(dec*d2r), cd=cos(dec*d2r);
+
+  cosc=sd0*sd+cd0*cd*cos(dra);
+  if(cosc<=0) return 1;
+  *x=cd*sin(dra)/cosc/d2r;
+  *y=(cd0*sd-sd0*cd*cos(dra))/cosc/d2r;
+  return 0;
+}
+
+
 
-  /* Go over all the objects and find the images that 
-     contain all or part of the desired region around it. */
-  for(i=0;i<cs0;++i)
+
+
+/* 1 if point `p` is inside the polygon with `n` vertices in `v` (x
+   and y of each vertex), using the crossing number. */
+int
+pointinpolygon(double *p, double *v, size_t n)
+{
+  int in=0;
+  size_t i, j;
+
+  for(i=0,j=n-1;i<n;j=i++)
+    if( (v[2*i+1]>p[1]) != (v[2*j+1]>p[1])
+	&& p[0] < ( (v[2*j]-v[2*i])*(p[1]-v[2*i+1])/(v[2*j+1]-v[2*i+1])
+		    + v[2*i] ) )
+      in=!in;
+  return in;
+}
+
+
+
+
+
+/* 1 if the segments from `a` to `b` and from `c` to `d` cross. */
+int
+segmentscross(double *a, double *b, double *c, double *d)
+{
+  double d1, d2, d3, d4;
+
+  d1=(d[0]-c[0])*(a[1]-c[1])-(d[1]-c[1])*(a[0]-c[0]);
+  d2=(d[0]-c[0])*(b[1]-c[1])-(d[1]-c[1])*(b[0]-c[0]);
+  d3=(b[0]-a[0])*(c[1]-a[1])-(b[1]-a[1])*(c[0]-a[0]);
+  d4=(b[0]-a[0])*(d[1]-a[1])-(b[1]-a[1])*(d[0]-a[0]);
+  return (d1>0)!=(d2>0) && (d3>0)!=(d4>0);
+}
+
+
+
+
+
+/* 1 if the polygons `p` (with `np` vertices) and `q` (with `nq`
+   vertices) overlap: one is inside the other or their sides
+   cross. */
+int
+polygonsoverlap(double *p, size_t np, double *q, size_t nq)
+{
+  size_t i, j;
+
+  if(pointinpolygon(p, q, nq) || pointinpolygon(q, p, np))
+    return 1;
+  for(i=0;i<np;++i)
+    for(j=0;j<nq;++j)
+      if(segmentscross(&p[2*i], &p[2*((i+1)%np)], &q[2*j],
+		       &q[2*((j+1)%nq)]))
+	return 1;
+  return 0;
+}
+
+
+
+
+
+/* Find the images whose footprint (see get_imginfo()) overlaps with
+   the thumbnail of a target at (`ra`,`dec`) and put their indexs in
+   `out` (only the first `maxout` are kept). The thumbnail has
+   `hwpix` pixels on each side of the target (half its width in
+   pixels) in the pixel grid of each image, so on the sky it is a
+   square along the axes of that image, with the size of its
+   pixels. Both are projected on the tangent plane of the target and
+   only the images that actually have pixels in the thumbnail are
+   kept (half a pixel more on each side, for the rounding of the
+   thumbnail's position to the pixel grid). The number of images
+   found is returned, if it is larger than `maxout`, `out` has to be
+   made larger and this function called again.*/
+size_t
+imagesforonetarget(double ra, double dec, double hwpix, double *imginfo,
+		   size_t numimg, uint32_t *out, size_t maxout)
+{
+  size_t i, counter=0;
+  double *im, hs, ux[2], uy[2], n;
+  double poly[2*FP_VERTICES], crop[8], *v;
+
+  for(im=imginfo;im<imginfo+numimg*NUM_IMAGEINFO_COLS;
+      im+=NUM_IMAGEINFO_COLS)
     {
-      /* For simplification of the points below: */
-      ra   = cat[i*cs1+racol];
-      dec  = cat[i*cs1+deccol];
-      decr = dec*M_PI/180;
-
-      /* Define the 4 surrounding points, in order they are:*/
-      points[0]=ra+hswd/cos(decr-hswr); points[1]=dec-hswd; /*Bottom left */
-      points[2]=ra-hswd/cos(decr-hswr); points[3]=dec-hswd; /*Bottom right*/
-      points[4]=ra+hswd/cos(decr+hswr); points[5]=dec+hswd; /*Top left    */
-      points[6]=ra-hswd/cos(decr+hswr); points[7]=dec+hswd; /*Top right   */
-
-      /* Each target has 4 points around it. See which images contains
-	 which point. NOTE: For each point: pRA=*po, pDec=*(po+1) */
-      counter=0;
-      po=points;
-      do
-        {
-	  /* NOTE: For each image (ic: image center): 
-	     icRA=*im, icDec=*(im+1), img_ax1_half_width=*(im+2), 
-	     img_ax2_half_width=*(im+3).*/
-	  im=imginfo;
-	  do
-            {
-	      /* First make sure declination is in range, then RA. 
-		 `im` is the row of imageinfo that we are now looking at.
-	         `po` is the two coordinates of each side.`*/
-	      if(    po[1] <= im[1]+im[3] 
-		  && po[1] >  im[1]-im[3] 
-		  && po[0] <= im[0]+im[2]/cos(po[1]*M_PI/180)
-		  && po[0] >  im[0]-im[2]/cos(po[1]*M_PI/180) )
-                {
-		  imindex=(im-imginfo)/NUM_IMAGEINFO_COLS;
-		  for(j=0;j<counter;++j)
-		    if(whichimg[i*WI_COLS+j]==imindex)
-		      break;
-		  if(j==counter) /* Image not yet assigned for target. */
-		    whichimg[i*WI_COLS+counter++]=imindex;
-
-		  /* Break out of the search, if there are no overlaps 
-		     then eachpoint can only be in one image, if there are
-		     overlaps then it doesn't matter! We have one image that
-		     some of the pixels are in, we don't need two!*/
-		  break;
-                }
-	      im+=NUM_IMAGEINFO_COLS;
-            }
-	  while(im<imf);
-	  po+=2;
-        }
-      while(po<pof);
+      /* Half the width of the thumbnail in the pixels of this image,
+	 reject the images that are too far. */
+      hs=(hwpix+0.5)*im[3];
+      if(angulardistance(ra, dec, im[0], im[1]) > im[2]+hs*M_SQRT2)
+	continue;
+
+      /* The footprint on the tangent plane of the target. */
+      v=&im[4];
+      for(i=0;i<FP_VERTICES;++i)
+	if(tangentplane(ra, dec, v[2*i], v[2*i+1], &poly[2*i],
+			&poly[2*i+1]))
+	  break;
+      if(i<FP_VERTICES) continue;
+
+      /* The directions of the first and second axes of the image are
+	 along its bottom and left sides. */
+      ux[0]=poly[4]-poly[0];  ux[1]=poly[5]-poly[1];
+      uy[0]=poly[12]-poly[0]; uy[1]=poly[13]-poly[1];
+      n=sqrt(ux[0]*ux[0]+ux[1]*ux[1]); ux[0]/=n; ux[1]/=n;
+      n=sqrt(uy[0]*uy[0]+uy[1]*uy[1]); uy[0]/=n; uy[1]/=n;
+
+      /* The corners of the thumbnail (in the same order). */
+      crop[0]=-hs*ux[0]-hs*uy[0];  crop[1]=-hs*ux[1]-hs*uy[1];
+      crop[2]= hs*ux[0]-hs*uy[0];  crop[3]= hs*ux[1]-hs*uy[1];
+      crop[4]= hs*ux[0]+hs*uy[0];  crop[5]= hs*ux[1]+hs*uy[1];
+      crop[6]=-hs*ux[0]+hs*uy[0];  crop[7]=-hs*ux[1]+hs*uy[1];
+
+      if(polygonsoverlap(crop, 4, poly, FP_VERTICES) && counter++<maxout)
+	out[counter-1]=(im-imginfo)/NUM_IMAGEINFO_COLS;
     }
 
-  /* In case you want to see the table: 
-  {
-    size_t j;
-    for(i=0;i<cs0;i++)
-      {
-	printf("%lu: ", i);
-	for(j=0;whichimg[i*WI_COLS+j]!=NONINDEX;j++)
-	  printf("%lu, ", whichimg[i*WI_COLS+j]);
-	printf("\b\b.\n");
-      }
-    exit(0);
-  }
-  */
+  return counter;
 }
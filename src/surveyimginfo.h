@@ -22,38 +22,60 @@ along with tifaa.  If not, see <http://www.gnu.org/licenses/>.
 #ifndef SURVEYIMGINFO_H
 #define SURVEYIMGINFO_H
 
+#include <stdint.h>
 #include <fitsio.h>
 #include <wcslib/wcshdr.h>
 #include <wcslib/wcsfix.h>
 #include <wcslib/wcs.h>
 
+#include "fitsfz.h"
+
 struct imginfothreadparams
 {
   size_t           id; /* Thread ID.                                   */
   size_t    *imgthrds; /* Image indexs for each thread.                */
   size_t     thrdcols; /* Number of columns in imgthrds.               */
   char     **imgnames; /* Array pointing to image names.               */
+  char     **whtnames; /* Weight image names (only used with `wfz`).   */
   double     *imginfo; /* Array to keep the information on each image. */
   double          res; /* Resolution of the image.                     */
+  struct fzindex  *fz; /* If !=NULL, index of each compressed image.   */
+  struct fzindex *wfz; /* If !=NULL, index of each weight image.       */
   size_t        *done; /* Pointer to number of complete threads.       */
   pthread_cond_t   *c; /* Pointer to the general conditional variable. */
   pthread_mutex_t  *m; /* Pointer to the general mutex variable.       */
   pthread_mutex_t *wm; /* Pointer to the general mutex variable.       */
+  int             err; /* Error code of the first image that failed.   */
+  size_t       badimg; /* Index of that image.                         */
 };
 
-void
+int
 prepindexsinthreads(size_t nindexs, size_t nthrds, size_t **outthrds,
 		    size_t *outthrdcols);
 
-void 
+int
 prepare_fitswcs(char *fits_name, fitsfile **fptr, int *f_status, 
 		int *w_status, int *nwcs, struct wcsprm **wcs,
-		pthread_mutex_t *wm, char **fullheader);
+		pthread_mutex_t *wm, char **fullheader, size_t *hsize,
+		double *lockwait);
+
+int
+get_imginfo(char *fits_name, double *imginfo, unsigned long zero_pos, 
+	    const double res, pthread_mutex_t *wm, struct fzindex *fz);
+
+int
+surveyimageinfo(char **imgnames, char **whtnames, size_t nimgs,
+		double res, size_t nt, double *imginfo,
+		struct fzindex *fz, struct fzindex *wfz, size_t *badimg);
+
+double
+angulardistance(double ra1, double dec1, double ra2, double dec2);
 
-void
-getsurveyimageinfo(struct tifaaparams *tp);
+int
+imagefootprint(struct wcsprm *wcs, long *naxes, double *row);
 
-void 
-whichimageforwhichtargets(struct tifaaparams *p);
+size_t
+imagesforonetarget(double ra, double dec, double hwpix, double *imginfo,
+		   size_t numimg, uint32_t *out, size_t maxout);
 
 #endif
@@ -19,17 +19,29 @@ GNU General Public License for more details.
 You should have received a copy of the GNU General Public License
 along with tifaa.  If not, see <http://www.gnu.org/licenses/>.
 **********************************************************************/
+#include <math.h>
 #include <time.h>
+#include <errno.h>
 #include <stdio.h>
+#include <limits.h>
+#include <stdint.h>
 #include <stdlib.h>
 #include <assert.h>
 #include <string.h>
 #include <unistd.h>
 #include <pthread.h>
+#include <sys/stat.h>
 
 #include "tifaa.h"
 #include "timing.h"
+#include "server.h"
+#include "scaling.h"
+#include "libtifaa.h"
+#include "blockcache.h"
+#include "topology.h"
 #include "surveyimginfo.h"
+#include "survey.h"
+#include "plan.h"
 
 
 
@@ -37,152 +49,252 @@ along with tifaa.  If not, see <http://www.gnu.org/licenses/>.
 /******************************************************************/
 /****************        Stich and crop       *********************/
 /******************************************************************/
-/* The FITS standard assumes that pixels are counted from their center
-   and in integer values. So the bottom left corner of a FITS image
-   (in a continues space) has coordinates: (0.5,0.5). In converting
-   from WCS to pixel, wcslib gives continues values, this function
-   converts that into actual array elements.  */
-void 
-convert_double_to_long_in_FITS(const double a, long *b)
+/* Size of the thumbnail of target `t` (in arcseconds): from its
+   row in the catalog if a size column was given, otherwise (or if
+   that value isn't positive) `-p`. */
+double
+targetpssize(struct tifaaparams *p, size_t t)
 {
-  /* Declarations: */
-  *b=(long)a;
-  if (a-(*b)>0.5) (*b)++;
+  double size;
+
+  if(p->size_col==NONINDEX)
+    return p->ps_size;
+  size=p->cat[t*p->cs1+p->size_col];
+  return size>0 ? size : p->ps_size;
 }
 
 
 
 
 
-/* Given the coordiantes of the object (of type double), this function
-   finds which pixels of the image correspond to which pixels in the
-   cropped image using the *pixel and *pixel_c arrays.
+/* Width (and height) in pixels of a thumbnail of `ps_size`
+   arcseconds. It is odd so the target is on the central pixel (and
+   at least one pixel). */
+size_t
+cropside(double ps_size, double res)
+{
+  size_t crop_side=ps_size/res;
+  if(crop_side%2==0)
+    crop_side = crop_side ? crop_side-1 : 1;
+  return crop_side;
+}
 
-   NOTE: I am going with the cfitsio standard here: the desired region
-         boundries are included.
 
-   The four long arrays are:
 
-   fpixel_i: First pixel in the input (large) image.
-   lpixel_i: Last pixel in the input (large) image.
-   fpixel_c: First pixel in the cropped image.
-   lpixel_c: Last pixel in the cropped image. 
-*/
-void 
-find_desired_pixel_range(double *pixcrd, const long naxis1,
-        const long naxis2, const long crop_side, long *fpixel_i, 
-        long *lpixel_i, long *fpixel_c, long *lpixel_c)
+
+
+/* Read the pixels from `fpixel_i` to `lpixel_i` of survey image
+   `index` (with `bitpix`) into `r->pix`. `layer` is `2*band` for the
+   images of a band (counting from 0) and `2*band+1` for their
+   weights. Through the block cache if there is one. Otherwise only
+   the pixels in this region are read: in their own type when
+   possible (see pixnative()), or as floats (see fzreadsubset() for
+   compressed images, it uses the buffers in `scratch`). */
+void
+readsurveysubset(struct tifaaparams *tp, size_t index, int layer,
+		 fitsfile *fptr, int bitpix, long *inaxes, long *fpixel_i,
+		 long *lpixel_i, float nulval, struct pixregion *r,
+		 struct fzscratch *scratch, int *status)
 {
-  /* Declarations: */
-  int hw;
-  long lpixcrd[2];
-  hw=crop_side/2;
-
-  /* Convert pixcrd from double to long based on the 
-     FITS standard: */
-  convert_double_to_long_in_FITS(pixcrd[0], &lpixcrd[0]);
-  convert_double_to_long_in_FITS(pixcrd[1], &lpixcrd[1]);
-
-  /* Set the initial values for the cropped array: */
-  fpixel_c[0]=1;          fpixel_c[1]=1;
-  lpixel_c[0]=crop_side;  lpixel_c[1]=crop_side;
-
-  /* Set the initial values for the actual image: */
-  fpixel_i[0]=lpixcrd[0]-hw; fpixel_i[1]=lpixcrd[1]-hw;
-  lpixel_i[0]=lpixcrd[0]+hw; lpixel_i[1]=lpixcrd[1]+hw;
-
-  /* Check the four corners to see if they should be adjusted:
-     To understand the first, look at this, suppose | separates pixels:
-     |-2|-1| 0|| 1| 2| 3| 4|  (survey image)
-     ||1 | 2| 3|  4| 5| 6| 7|  (crop image)
-     the || shows where the image actually begins. So when fpixel_i is
-     negative, e.g., fpixel_i=-2, then the pixel in the cropped image 
-     we want to begin with, that corresponds to 1 in the survey image is:
-     fpixel_c= 4 = 2 + -1*fpixel_i.*/
-  if (fpixel_i[0]<0) 
-    {    
-      fpixel_c[0]=-1*fpixel_i[0]+2;
-      fpixel_i[0]=1;
+  int anynul=0;
+  long inc[2]={1,1};
+  struct fzindex *fz = ( (layer%2 ? tp->wfzindex : tp->fzindex)
+			 + (layer/2)*tp->survglob.gl_pathc + index );
+
+  if(tp->cache==NULL && fz->rice==0 && pixnative(fptr, bitpix, r, status))
+    {
+      pixread(fptr, fpixel_i, lpixel_i, r, nulval, status);
+      return;
     }
-  if (fpixel_i[1]<0) 
+
+  pixfloat(r);
+  if(tp->cache)
+    bcread(tp->cache, index, layer, fptr, fz, inaxes, fpixel_i, lpixel_i,
+	   nulval, r->pix, lpixel_i[0]-fpixel_i[0]+1, status);
+  else if(!fzreadsubset(fptr, fz, fpixel_i, lpixel_i, nulval, r->pix,
+			scratch, status))
+    fits_read_subset_flt(fptr, 0, 2, inaxes, fpixel_i, lpixel_i, inc,
+			 nulval, r->pix, &anynul, status);
+}
+
+
+
+
+
+/* Read the pixels from `fpixel_i` to `lpixel_i` of image `index` of
+   `band` (not the first, whose images are opened with their WCS in
+   stitchcroponthread()) and put them in the `fpixel_c` to `lpixel_c`
+   part of its thumbnail, `out`. With weights, they are multiplied by
+   the same pixels of its weight image (read into the arena's
+   `wtmp`). The number of bytes read is added to `bread`. */
+void
+readbandsubset(struct tifaaparams *tp, size_t band, size_t index,
+	       long *inaxes, long *fpixel_i, long *lpixel_i, long crop_side,
+	       long *fpixel_c, long *lpixel_c, float nulval, float *out,
+	       struct croparena *a, size_t *bread)
+{
+  char *name;
+  fitsfile *fptr;
+  int w, status, bitpix=0;
+  long naxes[2]={0,0};
+  struct pixregion r[2];
+  size_t npix=(lpixel_i[0]-fpixel_i[0]+1)*(lpixel_i[1]-fpixel_i[1]+1);
+
+  for(w=0;w<=tp->weightmultip;++w)
     {
-      fpixel_c[1]=-1*fpixel_i[1]+2;
-      fpixel_i[1]=1; 
+      status=0;
+      r[w].pix = w ? a->wtmp : a->tmp;
+      name = (w ? tp->wbandglob : tp->bandglob)[band-1].gl_pathv[index];
+      fits_open_image(&fptr, name, READONLY, &status);
+      fits_get_img_size(fptr, 2, naxes, &status);
+      fits_get_img_type(fptr, &bitpix, &status);
+      if(status==0 && (naxes[0]!=inaxes[0] || naxes[1]!=inaxes[1]))
+	{
+	  fprintf(stderr, "%s: %ldx%ld pixels, but the image of the first "
+		  "band has %ldx%ld. All the bands must have the same pixel "
+		  "grid. TIFAA aborted.\n", name, naxes[0], naxes[1],
+		  inaxes[0], inaxes[1]);
+	  exit(EXIT_FAILURE);
+	}
+      readsurveysubset(tp, index, 2*band+w, fptr, bitpix, inaxes, fpixel_i,
+		       lpixel_i, nulval, &r[w], &a->fz, &status);
+      fits_close_file(fptr, &status);
+      if(status) exitonerror(TIFAA_EFITS, name, status, 0);
+      *bread+=npix*abs(bitpix)/8;
     }
-  /*The same principle applies to the end of an image. Take "s"
-    is the maximum size along a specific axis in the survey image 
-    and "c" is the size along the same axis on the cropped image.
-    Assume the the cropped region's last pixel in that axis will
-    be 2 pixels larger than s:
-    |1|.....|s-3|s-2|s-1|s  ||s+1|s+2| (survey image)
-    |c-3|c-2| c-1| c ||
-    So you see that if the outer pixel is n pixels away then in
-    the cropped image we should only look upto c-n.*/
-  if (lpixel_i[0]>naxis1) 
+
+  pixpaste(out, crop_side, fpixel_c, lpixel_c, &r[0],
+	   tp->weightmultip ? &r[1] : NULL, nulval);
+}
+
+
+
+
+
+/* Levels of subdirectories needed for `n` targets so no output
+   directory has more than SHARDSIZE entries (`-l`). */
+size_t
+shardlevels(size_t n)
+{
+  size_t levels=1, top=n/SHARDSIZE;
+
+  while(top>=SHARDSIZE)
     {
-      lpixel_c[0]=crop_side-(lpixel_i[0]-naxis1);
-      lpixel_i[0]=naxis1;
+      top/=SHARDSIZE;
+      ++levels;
     }
-  if (lpixel_i[1]>naxis2) 
+  return levels;
+}
+
+
+
+
+
+/* The subdirectory (in the output directory) of the thumbnail with
+   `id` (counting from 1), with `tp->shards` levels. Each level is
+   one group of SHARDSIZE of the level below, for example with two
+   levels target 12345 is in `000/012/`. */
+void
+sharddir(struct tifaaparams *tp, size_t id, char *dir)
+{
+  size_t l, k, div;
+
+  *dir='\0';
+  for(l=tp->shards;l>0;--l)
     {
-      lpixel_c[1]=crop_side-(lpixel_i[1]-naxis2);
-      lpixel_i[1]=naxis2;
+      for(div=1,k=0;k<l;++k) div*=SHARDSIZE;
+      dir+=sprintf(dir, "%03lu/", (id/div)%SHARDSIZE);
     }
+}
+
+
 
-  /* In case you wish to see the results (declare "junk"!).
-     The +1 in the final size section is because of the
-     cfitsio standard. An array of size 3 will have elements 
-     {1,2,3}, but the last element subtracted from the first is 
-     3-1=2, which doesn't show the number of pixels in it, it 
-     has to be increased by a unit! 
-     printf(" n1: %ld,  n2: %ld\n", naxis1, naxis2);
-     printf("if0: %ld, if1: %ld\n", fpixel_i[0], fpixel_i[1]);
-     printf("il0: %ld, il1: %ld\n", lpixel_i[0], lpixel_i[1]);
-     printf("cf0: %ld, cf1: %ld\n", fpixel_c[0], fpixel_c[1]);
-     printf("cl0: %ld, cl1: %ld\n", lpixel_c[0], lpixel_c[1]);
-     printf("\nThe sides of the desired region:\n");
-     printf("Num pixels in survey image: (ax1=%ld) * (ax2=%ld)\n", 
-     lpixel_i[0]-fpixel_i[0]+1, lpixel_i[1]-fpixel_i[1]+1);
-     printf("Num pixels in Cropped image: (ax1=%ld) * (ax2=%ld)\n", 
-     lpixel_c[0]-fpixel_c[0]+1, lpixel_c[1]-fpixel_c[1]+1);
-     scanf("%d", &junk);*/
+
+
+/* Make the subdirectories of the thumbnails of all the targets, once
+   before cropping, so the threads don't have to check them. */
+void
+makeshards(struct tifaaparams *tp)
+{
+  size_t id;
+  char name[10000], *c;
+
+  if(tp->shards==0) return;
+  for(id=0;id<=tp->cs0;id+=SHARDSIZE)
+    {
+      c=name+sprintf(name, "%s", tp->out_name);
+      sharddir(tp, id, c);
+      for(c=strchr(c, '/');c;c=strchr(c+1, '/'))
+	{
+	  *c='\0';
+	  if(mkdir(name, 0755) && errno!=EEXIST)
+	    {
+	      printf("\nError: Can't make the directory %s. TIFAA "
+		     "aborted.\n\n", name);
+	      exit(EXIT_FAILURE);
+	    }
+	  *c='/';
+	}
+    }
 }
 
 
 
 
 
-/* Check the central pixels of the finalized image to see if they
-   aren't zero, if they are, set the remove variable on (=1). Note
-   that hw+1 is the central pixel. */
+/* Name of the thumbnail of target `t` (counting from 0) in `band`.
+   With only one band, the band isn't in the name. */
 void
-check_center(fitsfile **write_fptr, long *onaxes, long chk_siz,
-	     int imagesdone, size_t *zero_flag, long crop_side, 
-	     int *wr_status)
+thumbnailname(struct tifaaparams *tp, size_t t, size_t band, char *name)
+{
+  char dir[100];
+
+  sharddir(tp, t+1, dir);
+  if(tp->numbands>1)
+    sprintf(name, "%s%s%lu_%lu%s", tp->out_name, dir, t+1, band+1,
+	    tp->out_ext);
+  else
+    sprintf(name, "%s%s%lu%s", tp->out_name, dir, t+1, tp->out_ext);
+}
+
+
+
+
+
+/* Quantize the `n` pixels of `in` to 16-bit integers in `out`, the
+   full range of the pixels is mapped to -32767 to 32767 (so QBLANK
+   is kept for blank pixels: NaN or `nulval`). The output is 1 if
+   there were blank pixels. */
+int
+quantizeshort(float *in, size_t n, float nulval, short *out,
+	      double *bscale, double *bzero)
 {
-  /* Declarations: */
-  long fpixel_ch[2], lpixel_ch[2], inc[2]={1,1}, ch_hw;
-  float *to_check, *ipt, nulval=-9999;
-  int group=0, naxis=2, hw, anynul=0;
-
-  /* Set the positions and array of the pixels to check: */
-  hw=crop_side/2; ch_hw=chk_siz/2;
-  fpixel_ch[0]=(hw+1)-ch_hw; fpixel_ch[1]=(hw+1)+ch_hw;
-  lpixel_ch[0]=(hw+1)-ch_hw; lpixel_ch[1]=(hw+1)+ch_hw;
-  assert( (to_check=calloc(chk_siz*chk_siz, sizeof *to_check) )!=NULL );
-
-  /* Get those pixels: */
-  fits_read_subset_flt(*write_fptr, group, naxis, onaxes, fpixel_ch, 
-		       lpixel_ch, inc, nulval, to_check, &anynul, wr_status);
-
-  /* Check them to see if they are zero or not: */
-  for(ipt=to_check;ipt<&to_check[chk_siz*chk_siz];ipt++)
-    if (*ipt!=0) break;
-  if (ipt==&to_check[chk_siz*chk_siz] && imagesdone>0) 
-    *zero_flag=1;
-
-  /* Free the allocated space: */
-  free(to_check);
+  double q;
+  int blank=0;
+  float *f, *ff=in+n, min=INFINITY, max=-INFINITY;
+
+  for(f=in;f<ff;++f)
+    if(!isnan(*f) && *f!=nulval)
+      {
+	if(*f<min) min=*f;
+	if(*f>max) max=*f;
+      }
+  if(min>max) min=max=0;
+  *bzero=((double)min+max)/2;
+  *bscale= max>min ? ((double)max-min)/65534 : 1;
+
+  for(f=in;f<ff;++f)
+    if(isnan(*f) || *f==nulval)
+      {
+	*out++=QBLANK;
+	blank=1;
+      }
+    else
+      {
+	q=nearbyint((*f-*bzero)/ *bscale);
+	*out++ = q<-32767 ? -32767 : (q>32767 ? 32767 : q);
+      }
+  return blank;
 }
 
 
@@ -228,83 +340,252 @@ report_prepare_end(int verb, size_t *log, size_t targetindex, int numimg,
 
 
 
+/* BLANK of the thumbnails of integer survey image `fptr` (with
+   `bitpix`) for OUT_INPUT: its own BLANK or, when it has none, the
+   smallest value of its type. */
+long long
+thumbnailblank(fitsfile *fptr, int bitpix, int *status)
+{
+  long long blank;
+
+  if(*status) return 0;
+  fits_read_key(fptr, TLONGLONG, "BLANK", &blank, NULL, status);
+  if(*status!=KEY_NO_EXIST) return blank;
+  *status=0;
+  switch(bitpix)
+    {
+    case BYTE_IMG:  return 0;
+    case SHORT_IMG: return SHRT_MIN;
+    case LONG_IMG:  return INT32_MIN;
+    default:        return LLONG_MIN;
+    }
+}
+
+
+
+
+
+/* Make the image of a `onaxes[0]` by `onaxes[1]` thumbnail in `fptr`
+   with the type of `outtype`. `inbitpix`, `inbscale`, `inbzero` and
+   `inblank` are of the survey image (for OUT_INPUT, see
+   thumbnailblank()). The data type and pixels that must be written
+   into the image (after the header) are put in `datatype` and
+   `data`: for OUT_SHORT, `pix` is quantized into `qbuf`, so its
+   values must be written without scaling. */
 void
-addheaderinfo(fitsfile *write_fptr, int *wr_status, struct wcsprm *wcs,
-	      long *fpixel_i, long *fpixel_c, double *world, 
-	      double ps_size, double res)
+createthumbnail(fitsfile *fptr, int outtype, int inbitpix,
+		double inbscale, double inbzero, long long inblank,
+		long *onaxes, float *pix, float nulval, short *qbuf,
+		int *datatype, void **data, int *status)
+{
+  int bitpix=FLOAT_IMG, blank=0;
+  double bscale=1, bzero=0;
+  long long blankval=QBLANK;
+
+  *datatype=TFLOAT;
+  *data=pix;
+  if(outtype==OUT_INPUT)
+    {
+      bitpix=inbitpix;
+      bscale=inbscale;
+      bzero=inbzero;
+      blank=1;
+      blankval=inblank;
+    }
+  else if(outtype==OUT_SHORT)
+    {
+      bitpix=SHORT_IMG;
+      blank=quantizeshort(pix, onaxes[0]*onaxes[1], nulval, qbuf, &bscale,
+			  &bzero);
+      *datatype=TSHORT;
+      *data=qbuf;
+    }
+
+  fits_create_img(fptr, bitpix, 2, onaxes, status);
+  if(bitpix<0) return;
+  if(bscale!=1 || bzero!=0)
+    {
+      fits_write_key_dbl(fptr, "BSCALE", bscale, -15,
+			 "Physical value = BZERO + BSCALE * array value.",
+			 status);
+      fits_write_key_dbl(fptr, "BZERO", bzero, -15,
+			 "Physical value = BZERO + BSCALE * array value.",
+			 status);
+    }
+  if(blank)
+    fits_write_key_lng(fptr, "BLANK", blankval, "Value of blank pixels.",
+		       status);
+}
+
+
+
+
+
+/* The header template of survey image `img` (see header.h). It is
+   made with its `wcs` by the first thread that needs it, NULL if
+   wcshdo() fails (addheaderinfo() is then used). */
+struct hdrtemplate *
+headertemplate(struct tifaaparams *tp, size_t img, struct wcsprm *wcs,
+	       pthread_mutex_t *m)
+{
+  struct hdrtemplate h, *out=&tp->headers[img];
+
+  pthread_mutex_lock(m);
+  if(out->cards)
+    {
+      pthread_mutex_unlock(m);
+      return out;
+    }
+  pthread_mutex_unlock(m);
+
+  /* Made without the mutex, if another thread made it meanwhile, its
+     template is used. */
+  if(hdrmake(&h, wcs)) return NULL;
+  pthread_mutex_lock(m);
+  if(out->cards==NULL) *out=h;
+  else                 hdrfree(&h);
+  pthread_mutex_unlock(m);
+  return out;
+}
+
+
+
+
+
+/* Size of a file in bytes, zero if it can't be found. */
+size_t
+filesize(char *name)
+{
+  struct stat st;
+  return stat(name, &st)==0 ? (size_t)st.st_size : 0;
+}
+
+
+
+
+
+/* Push the thumbnails of target `t` (in all the bands, `sizes[b]`
+   bytes of FITS in `mem[b]`) to the stream (`-O`), each after a line
+   of `TIFAA ID BAND BYTES`. They are pushed together, so the bands
+   of one target stay together in the stream. The output is the
+   number of FITS bytes. */
+size_t
+streamthumbnails(struct tifaaparams *tp, size_t t, void **mem,
+		 size_t *sizes)
 {
-  size_t i;
-  time_t rawtime;
-  int nkeyrec, h;
-  char comment[1000];
-  char startblank[]="                   / ";
-  char *wcsheader, *cp, *cpf, blankrec[80], titlerec[80];
-
-  time(&rawtime);
-
-  /* Set the last element of the blank array. */
-  cpf=blankrec+79;
-  *cpf='\0';
-  titlerec[79]='\0';
-  cp=blankrec; do *cp=' '; while(++cp<cpf);
-
-  /* Delete the comments that already exist: */
-  fits_delete_key(write_fptr, "COMMENT", wr_status);
-  fits_delete_key(write_fptr, "COMMENT", wr_status);
-
-  /* Add the WCS information: */
-  fits_write_record(write_fptr, blankrec, wr_status);
-  sprintf(titlerec, "%sWCS INFORMATION", startblank);
-  titlerec[strlen(titlerec)]=' ';
-  fits_write_record(write_fptr, titlerec, wr_status);
-  wcs->crpix[0] -= (fpixel_i[0]-1)+(fpixel_c[0]-1);
-  wcs->crpix[1] -= (fpixel_i[1]-1)+(fpixel_c[1]-1);
-  wcshdo(0, wcs, &nkeyrec, &wcsheader);
-  for(h=0;h<nkeyrec-1;++h)
+  char *buf, *c;
+  size_t b, len=0, fitsbytes=0;
+
+  for(b=0;b<tp->numbands;++b)
+    {
+      len+=snprintf(NULL, 0, "TIFAA %lu %lu %lu\n", t+1, b+1, sizes[b]);
+      len+=sizes[b];
+      fitsbytes+=sizes[b];
+    }
+  assert( (c=buf=malloc(len+1))!=NULL );
+  for(b=0;b<tp->numbands;++b)
     {
-      cp=&wcsheader[h*80];
-      wcsheader[(h+1)*80-1]='\0';
-      fits_write_record(write_fptr, cp, wr_status);
+      c+=sprintf(c, "TIFAA %lu %lu %lu\n", t+1, b+1, sizes[b]);
+      memcpy(c, mem[b], sizes[b]);
+      c+=sizes[b];
     }
-  free(wcsheader);
-
-  /*Print all the other information in the header:  */
-  fits_write_record(write_fptr, blankrec, wr_status);
-  sprintf(titlerec, "%sABOUT THIS THUMBNAIL", startblank);
-  for(i=strlen(titlerec);i<79;++i)
-    titlerec[i]=' ';
-  fits_write_record(write_fptr, titlerec, wr_status);  
-  sprintf(comment, "Created with TIFAA %s on %s.", 
-	  TIFFAVERSION, ctime(&rawtime));
-  fits_write_comment(write_fptr, comment, wr_status);
-  sprintf(comment, "RA  of thumbnail center: %13f", world[0]);
-  fits_write_comment(write_fptr, comment, wr_status);
-  sprintf(comment, "DEC of thumbnail center: %13f", world[1]);
-  fits_write_comment(write_fptr, comment, wr_status);
-  sprintf(comment, "Thumbnail is %.2f arcseconds across with %.3f "
-	  "arcsecond/pixel.", ps_size, res);
-  fits_write_comment(write_fptr, comment, wr_status);
-
-  /* Copyright information */
-  fits_write_record(write_fptr, blankrec, wr_status);
-  sprintf(titlerec, "%sABOUT TIFAA", startblank);
-  for(i=strlen(titlerec);i<79;++i)
-    titlerec[i]=' ';
-  fits_write_record(write_fptr, titlerec, wr_status);
-  sprintf(comment, "TIFAA is available under the GNU GPL v3+.");
-  fits_write_comment(write_fptr, comment, wr_status);
-  sprintf(comment, "https://github.com/makhlaghi/tifaa");
-  fits_write_comment(write_fptr, comment, wr_status);
-  sprintf(comment, "Copyright 2013-2014, Mohammad Akhlaghi.");
-  fits_write_comment(write_fptr, comment, wr_status);
-  sprintf(comment, "http://www.astr.tohoku.ac.jp/~akhlaghi/");
-  fits_write_comment(write_fptr, comment, wr_status);
+  writerpush(&tp->stream, buf, len);
+  return fitsbytes;
+}
+
+
+
+
+
+/* Push the rows of the result table for one target to its
+   writer. Each row is one image that was used for this target, so
+   targets that were stitched have more than one row. Targets that
+   were not in the field get one row with an image index of -1. All
+   the rows of one target are pushed together so they stay together
+   in the table. */
+void
+savetablerows(struct writer *w, char **imgnames, size_t target,
+	      size_t flag, size_t numimg, size_t *imgs, long *ranges,
+	      size_t *bread, size_t bwritten, double latency)
+{
+  FILE *fp;
+  size_t j, len;
+  char *buf=NULL;
+
+  assert( (fp=open_memstream(&buf, &len))!=NULL );
+  if(numimg==0)
+    fprintf(fp, "%-7lu %-4lu %-4d %-7d %-7d %-7d %-7d %-7d %-11d "
+	    "%-11lu %-10.3f -\n", target+1, flag, 0, -1, 0, 0, 0, 0, 0,
+	    bwritten, latency);
+  for(j=0;j<numimg;++j)
+    fprintf(fp, "%-7lu %-4lu %-4lu %-7lu %-7ld %-7ld %-7ld %-7ld %-11lu "
+	    "%-11lu %-10.3f %s\n", target+1, flag, numimg, imgs[j],
+	    ranges[j*4], ranges[j*4+1], ranges[j*4+2], ranges[j*4+3],
+	    bread[j], bwritten, latency, imgnames[imgs[j]]);
+  fclose(fp);
+
+  writerpush(w, buf, len);
 }
 
 
 
 
 
+/* For sorting the targets by their first image. */
+struct targetkey
+{
+  uint32_t   img;
+  size_t       t;
+};
+
+int
+comparetargetkeys(const void *a, const void *b)
+{
+  const struct targetkey *x=a, *y=b;
+  if(x->img!=y->img) return x->img<y->img ? -1 : 1;
+  return x->t<y->t ? -1 : (x->t>y->t);
+}
+
+
+
+
+
+/* Like prepindexsinthreads(), but each thread gets a contiguous
+   group of the targets, sorted by their first image. So the targets
+   of one image are mostly on one thread and (since neighboring
+   threads are on the same node, see topologycpu()) the survey
+   images are mostly used on one NUMA node. */
+void
+targetsbyimage(struct tifaaparams *tp, size_t nt, size_t **outthrds,
+	       size_t *outthrdcols)
+{
+  struct targetkey *keys;
+  size_t i, j, k, n=tp->cs0, *thrds, thrdcols;
+
+  assert( (keys=malloc(n*sizeof *keys))!=NULL );
+  for(i=0;i<n;++i)
+    {
+      keys[i].img = ( tp->wioff[i]<tp->wioff[i+1]
+		      ? tp->wiimg[tp->wioff[i]] : UINT32_MAX );
+      keys[i].t=i;
+    }
+  qsort(keys, n, sizeof *keys, comparetargetkeys);
+
+  *outthrdcols = thrdcols = n/nt+2;
+  assert( (thrds=*outthrds=malloc(nt*thrdcols*sizeof *thrds))!=NULL );
+  for(i=k=0;i<nt;++i)
+    {
+      for(j=0;k<(i+1)*n/nt;++j)
+	thrds[i*thrdcols+j]=keys[k++].t;
+      for(;j<thrdcols;++j)
+	thrds[i*thrdcols+j]=NONINDEX;
+    }
+  free(keys);
+}
+
+
+
+
 
 void *
 stitchcroponthread(void *inparam)
@@ -312,32 +593,60 @@ stitchcroponthread(void *inparam)
   struct stitchcropthread *p=(struct stitchcropthread *)inparam;
   struct tifaaparams *tp=p->tp;
 
-  int wwc_stat;
-  struct wcsprm *wcs;
+  struct wcsprm *wcs, *fwcs=NULL;
+  struct timeval t1, t2, tl;
+  int wwc_stat, bitpix, wbitpix, fbitpix=FLOAT_IMG, datatype, fnwcs=0;
+  size_t bwritten, k, img;
+  long npix;
   pthread_mutex_t *wcsmtxp=p->wm;
   char **whtnames=tp->wsurvglob.gl_pathv;
-  fitsfile *write_fptr, *read_fptr, *wread_fptr;
-  size_t racol=tp->ra_col, deccol=tp->dec_col, numimg;
-  int stat[NWCSFIX], verb=tp->verb, group=0, anynul=0;
+  fitsfile *write_fptr[MAXBANDS], *read_fptr, *wread_fptr;
+  void *mem[MAXBANDS], *data;
+  size_t memsize[MAXBANDS];
+  LONGLONG hstart, dstart, dend;
+  size_t racol=tp->ra_col, deccol=tp->dec_col, numimg, b;
+  int stat[NWCSFIX], verb=tp->verb, fused;
   char fitsname[1000], **imgnames=tp->survglob.gl_pathv;
-  size_t *t, *i, *whichimg=tp->whichimg, *log=tp->log, tmpsize;
-  int wr_status, fr_status, wc_status, nwcs, ncoord=1, nelem=2;
-  char *outname=tp->out_name, *outext=tp->out_ext, *fullheader;
-  float *cropped, *tmparray, nulval=-9999, *wtmp, *wf, *wff, *sf;
+  size_t *t, *wioff=tp->wioff, *log=tp->log;
+  uint32_t *wiimg=tp->wiimg;
+  int wr_status, fr_status, wc_status, nwcs, ncoord=1, nelem=2, err;
+  struct croparena a;
+  float nulval=-9999;
   double world[2], *cat=tp->cat, phi, theta, imgcrd[2], pixcrd[2];
-  size_t zero_flag, remove_flag, cs1=tp->cs1, crop_side=p->crop_side;
+  double fbscale=1, fbzero=0;
+  long long fblank=0;
+  size_t zero_flag, remove_flag, cs1=tp->cs1, crop_side;
   long onaxes[2], nelements, naxis=2, inaxes[2], chk_size=tp->chk_size;
-  long fpixel_c[2], lpixel_c[2], fpixel_i[2], lpixel_i[2], inc[2]={1,1};
-
-  /* Set the width of the output */
-  onaxes[0]=crop_side; onaxes[1]=crop_side;
-  nelements=crop_side*crop_side;
+  long fpixel_c[2], lpixel_c[2], fpixel_i[2], lpixel_i[2];
+  long ffpixel_i[2], ffpixel_c[2];
+  struct pixregion sr, wr;
+  struct hdrtemplate *hdr;
+  unsigned long datasum=0;
+  double ps_size;
+
+  /* All the buffers for the targets of this thread. When it is
+     pinned, they are made (and touched) after it is on its CPU, so
+     they are on its NUMA node. */
+  if(p->cpu>=0) topologypin(p->cpu);
+  arenainit(&a, p->crop_side, tp->numbands, tp->weightmultip,
+	    tp->outtype==OUT_SHORT, tp->wimax);
 
   t=&p->targetthrds[p->id*p->thrdcols];
   do
     {
-      /* In case this object doesn't exist in the image range, ignore it. */
-      if(whichimg[*t*WI_COLS]==NONINDEX) continue;
+      gettimeofday(&t1, NULL);
+
+      /* In case this object doesn't exist in the image range, ignore
+	 it. It still has to be reported in the log and result table.*/
+      if(wioff[*t]==wioff[*t+1])
+	{
+	  report_prepare_end(verb, log, *t, 0, 0, &remove_flag);
+	  log[*t*LOG_COLS]=*t+1;
+	  gettimeofday(&t2, NULL);
+	  savetablerows(&tp->table, imgnames, *t, 2, 0, NULL, NULL, NULL,
+			0, msecdiff(&t1, &t2));
+	  continue;
+	}
 
       /* Set the remove and zero flags to zero: */
       zero_flag=0; remove_flag=0;
@@ -346,27 +655,31 @@ stitchcroponthread(void *inparam)
       world[0]=cat[*t*cs1+racol];
       world[1]=cat[*t*cs1+deccol];
 
-      /* Create the fits image for the cropped array here: */
-      wr_status=0;
-      sprintf(fitsname, "%s%lu%s", outname, *t+1, outext);
-      assert( (cropped=calloc(nelements, sizeof *cropped))!=NULL );
-      fits_create_file(&write_fptr, fitsname, &wr_status);
-      fits_create_img(write_fptr, FLOAT_IMG, naxis, onaxes, &wr_status);
-      fits_write_img(write_fptr, TFLOAT, 1, nelements, cropped, &wr_status);
+      /* Set the width of the output (each target can have its own
+	 size, the arena is made for the largest). */
+      ps_size=targetpssize(tp, *t);
+      crop_side=cropside(ps_size, tp->res);
+      onaxes[0]=crop_side; onaxes[1]=crop_side;
+      nelements=crop_side*crop_side;
+
+      /* The thumbnails (of all the bands) are made in the arena
+	 and only written when they are complete. */
+      tl=t1;
+      memset(a.cropped, 0, tp->numbands*nelements*sizeof *a.cropped);
 
       /* Go over all the images for this object. */
       numimg=0;      
-      i=&whichimg[*t*WI_COLS];
-      do
+      for(k=wioff[*t];k<wioff[*t+1];++k)
 	{ 
+	  img=wiimg[k];
+
 	  /* Prepare wcsprm structure and read the image size.*/
 	  fr_status=0; wc_status=0; 
-	  prepare_fitswcs(imgnames[*i], &read_fptr, &fr_status, &wc_status, 
-			  &nwcs, &wcs, wcsmtxp, &fullheader);
-	  fits_read_key(read_fptr, TLONG, "NAXIS1", &inaxes[0], 
-			NULL, &fr_status);
-	  fits_read_key(read_fptr, TLONG, "NAXIS2", &inaxes[1], 
-			NULL, &fr_status);
+	  err=prepare_fitswcs(imgnames[img], &read_fptr, &fr_status,
+			      &wc_status, &nwcs, &wcs, wcsmtxp, &a.header,
+			      &a.hsize, &p->stats.lockwait);
+	  if(err) exitonerror(err, imgnames[img], fr_status, wc_status);
+	  fits_get_img_size(read_fptr, naxis, inaxes, &fr_status);
 	  /* Find the position of the object's RA and Dec: */
 	  wc_status = wcss2p(wcs, ncoord, nelem, world, &phi, 
 			     &theta, imgcrd, pixcrd, stat); 
@@ -376,82 +689,196 @@ stitchcroponthread(void *inparam)
 	  find_desired_pixel_range(pixcrd, inaxes[0], inaxes[1], crop_side,
 				   fpixel_i, lpixel_i, fpixel_c, lpixel_c);
 
+	  /* The footprint test (imagesforonetarget()) keeps half a
+	     pixel more around the thumbnail, so this image might not
+	     have any pixels in it. It is then not used for this
+	     target. */
+	  if(fpixel_i[0]>lpixel_i[0] || fpixel_i[1]>lpixel_i[1])
+	    {
+	      fits_close_file(read_fptr, &fr_status);
+	      wc_status = wcsvfree(&nwcs, &wcs);
+	      p->stats.headers+=mseclap(&tl);
+	      continue;
+	    }
+	  fits_get_img_type(read_fptr, &bitpix, &fr_status);
+	  npix=(lpixel_i[0]-fpixel_i[0]+1)*(lpixel_i[1]-fpixel_i[1]+1);
+	  a.imgs[numimg]=img;
+	  a.ranges[numimg*4  ]=fpixel_i[0]; a.ranges[numimg*4+1]=lpixel_i[0];
+	  a.ranges[numimg*4+2]=fpixel_i[1]; a.ranges[numimg*4+3]=lpixel_i[1];
+	  a.bread[numimg]=npix*abs(bitpix)/8;
+	  p->stats.headers+=mseclap(&tl);
+
+	  /* Read the pixels in the desired subset (never more than the
+	     arena's `tmp` can keep), in their own type if possible. */
+	  sr.pix=a.tmp;
+	  readsurveysubset(tp, img, 0, read_fptr, bitpix, inaxes, fpixel_i,
+			   lpixel_i, nulval, &sr, &a.fz, &fr_status);
+
 	  /* In case you want to multiply by the weight image: */
 	  if(tp->weightmultip)
-	    {			/* See the comments of what is in `else`. */
+	    {
 	      wwc_stat=0;
-	      fits_open_file(&wread_fptr, whtnames[*i], READONLY, &wwc_stat);
-	      tmpsize=(lpixel_i[0]-fpixel_i[0]+1)*(lpixel_i[1]-fpixel_i[1]+1);
-	      assert( (tmparray=malloc(tmpsize*sizeof *tmparray))!=NULL );
-	      assert( (wtmp=malloc(tmpsize*sizeof *wtmp))!=NULL );
-	      fits_read_subset_flt(read_fptr, group, naxis, inaxes, fpixel_i, 
-				   lpixel_i, inc, nulval, tmparray, &anynul, 
-				   &fr_status);
-	      fits_read_subset_flt(wread_fptr, group, naxis, inaxes,fpixel_i, 
-				   lpixel_i, inc, nulval, wtmp, &anynul, 
-				   &wwc_stat);
-	      sf=tmparray; wff=(wf=wtmp)+tmpsize; 
-	      do *sf++ *= *wf; while(++wf<wff);
+	      wr.pix=a.wtmp;
+	      fits_open_image(&wread_fptr, whtnames[img], READONLY, &wwc_stat);
+	      fits_get_img_type(wread_fptr, &wbitpix, &wwc_stat);
+	      a.bread[numimg]+=npix*abs(wbitpix)/8;
+	      readsurveysubset(tp, img, 1, wread_fptr, wbitpix, inaxes,
+			       fpixel_i, lpixel_i, nulval, &wr, &a.fz,
+			       &wwc_stat);
 	      fits_close_file(wread_fptr, &wwc_stat);
-	      free(wtmp);
-	    }
-	  else
-	    {
-	      /* Make the array to keep the section pixels. The +1
-		 on each axis is explained in the explanations of 
-		 find_desired_pixel_range().  */
-	      tmparray=malloc((lpixel_i[0]-fpixel_i[0]+1)
-			      *(lpixel_i[1]-fpixel_i[1]+1)* sizeof *tmparray);
-	      assert(tmparray!=NULL);
-
-	      /* Read the pixels in the desired subset: */
-	      fits_read_subset_flt(read_fptr, group, naxis, inaxes, fpixel_i, 
-				   lpixel_i, inc, nulval, tmparray, &anynul, 
-				   &fr_status);
 	    }
 
-	  /* Write that section */
-	  fits_write_subset_flt(write_fptr, group, naxis, onaxes, fpixel_c,
-				lpixel_c, tmparray, &wr_status);
+	  /* Put that section in the thumbnail (converted and multiplied
+	     by the weight in one pass). */
+	  p->stats.read+=mseclap(&tl);
+	  pixpaste(a.cropped, crop_side, fpixel_c, lpixel_c, &sr,
+		   tp->weightmultip ? &wr : NULL, nulval);
 
+	  /* The same section of the other bands. */
+	  for(b=1;b<tp->numbands;++b)
+	    {
+	      readbandsubset(tp, b, img, inaxes, fpixel_i, lpixel_i,
+			     crop_side, fpixel_c, lpixel_c, nulval,
+			     a.cropped+b*nelements, &a, &a.bread[numimg]);
+	      p->stats.read+=mseclap(&tl);
+	    }
 
-	  /* Add the WCS header information to the cropped image if
-	     this is the first stitch. */
+	  /* The WCS (and type) of the thumbnails are those of the
+	     first image, so it is kept until they are written. */
 	  if(numimg==0)
-	    addheaderinfo(write_fptr, &wr_status, wcs, fpixel_i, fpixel_c,
-			  world, tp->ps_size, tp->res);
+	    {
+	      fwcs=wcs; fnwcs=nwcs; fbitpix=bitpix;
+	      ffpixel_i[0]=fpixel_i[0]; ffpixel_i[1]=fpixel_i[1];
+	      ffpixel_c[0]=fpixel_c[0]; ffpixel_c[1]=fpixel_c[1];
+	      if(tp->outtype==OUT_INPUT)
+		{
+		  fbscale=1; fbzero=0;
+		  fits_read_key(read_fptr, TDOUBLE, "BSCALE", &fbscale, NULL,
+				&fr_status);
+		  if(fr_status==KEY_NO_EXIST) fr_status=0;
+		  fits_read_key(read_fptr, TDOUBLE, "BZERO", &fbzero, NULL,
+				&fr_status);
+		  if(fr_status==KEY_NO_EXIST) fr_status=0;
+		  if(bitpix>0)
+		    fblank=thumbnailblank(read_fptr, bitpix, &fr_status);
+		}
+	    }
+	  else
+	    wc_status = wcsvfree(&nwcs, &wcs);
 
-	  /* Free the spaces: */
-	  free(tmparray);
-	  free(fullheader);
+	  /* Free the spaces (the header stays in the arena): */
 	  fits_close_file(read_fptr, &fr_status);
-	  wc_status = wcsvfree(&nwcs, &wcs);
+	  p->stats.headers+=mseclap(&tl);
 	  ++numimg;
 	}
-      while(*(++i)!=NONINDEX);
  
       /* Save the necessary information in the process log */
       log[*t*LOG_COLS  ] = *t+1;
       log[*t*LOG_COLS+1] = numimg;
 
-      /* Check to see if the center of the image is empty or not. */
-      check_center(&write_fptr, onaxes, chk_size, numimg, 
-		   &zero_flag, crop_side, &wr_status);
+      /* Check to see if the center of the image is empty or not and
+	 report the results on stdout and in final_report: */
+      zero_flag = numimg>0 && centeriszero(a.cropped, crop_side, chk_size);
+      report_prepare_end(verb, log, *t, numimg, zero_flag, &remove_flag);
+
+      /* Write the thumbnails (in all the bands, the first band decides
+	 if they are removed). In memory, the FITS file ends with the
+	 (padded) data of its only HDU. */
+      bwritten=0;
+      wr_status=0;
+      hdr = remove_flag ? NULL : headertemplate(tp, a.imgs[0], fwcs, p->m);
+      for(b=0;b<tp->numbands && remove_flag==0;++b)
+	{
+	  if(tp->streamfp)
+	    {
+	      memsize[b]=(nelements*sizeof(float)/2880+4)*2880;
+	      assert( (mem[b]=malloc(memsize[b]))!=NULL );
+	      fits_create_memfile(&write_fptr[b], &mem[b], &memsize[b], 2880,
+				  realloc, &wr_status);
+	    }
+	  else
+	    {
+	      thumbnailname(tp, *t, b, fitsname);
+	      fits_create_file(&write_fptr[b], fitsname, &wr_status);
+	    }
+	  createthumbnail(write_fptr[b], tp->outtype, fbitpix, fbscale,
+			  fbzero, fblank, onaxes, a.cropped+b*nelements,
+			  nulval, a.qbuf, &datatype, &data, &wr_status);
+
+	  /* The header is read again after it is written, so the
+	     pixels are scaled with its BSCALE and BZERO (the quantized
+	     pixels are already scaled). */
+	  hdrwrite(write_fptr[b], hdr, fwcs, ffpixel_i, ffpixel_c, world,
+		   ps_size, tp->res, &wr_status);
+
+	  /* With `-C`, DATASUM is found from the pixels that are about
+	     to be written. Only the pixels that CFITSIO converts (`-T
+	     input` with integer or 64-bit survey images) are summed
+	     after they are written, with fits_write_chksum() (also used
+	     for all of them with HDR_NOFUSEDSUMENV, to compare the two
+	     in the regression tests). */
+	  fused = tp->checksum
+	    && (tp->outtype!=OUT_INPUT || fbitpix==FLOAT_IMG)
+	    && getenv(HDR_NOFUSEDSUMENV)==NULL;
+	  if(fused)
+	    {
+	      datasum=pixdatasum(datatype==TSHORT ? PIX_SHORT : PIX_FLOAT,
+				 data, nelements);
+	      hdrdatasum(write_fptr[b], datasum, &wr_status);
+	    }
+	  fits_set_hdustruc(write_fptr[b], &wr_status);
+	  if(tp->outtype==OUT_SHORT)
+	    fits_set_bscale(write_fptr[b], 1, 0, &wr_status);
+	  /* Integer thumbnails of `-T input` keep the blank pixels as
+	     BLANK. Pixels outside the range of their type are clipped
+	     by CFITSIO, the thumbnails where that happened are
+	     counted. */
+	  if(tp->outtype==OUT_INPUT && fbitpix>0)
+	    fits_write_imgnull(write_fptr[b], datatype, 1, nelements, data,
+			       &nulval, &wr_status);
+	  else
+	    fits_write_img(write_fptr[b], datatype, 1, nelements, data,
+			   &wr_status);
+	  if(wr_status==NUM_OVERFLOW)
+	    {
+	      ++p->overflows;
+	      wr_status=0;
+	    }
+	  if(fused)
+	    hdrchecksum(write_fptr[b], datasum, &wr_status);
+	  else if(tp->checksum)
+	    fits_write_chksum(write_fptr[b], &wr_status);
 
-      /* Close the FITS file and free the cropped space: */
-      fits_close_file(write_fptr, &wr_status);
+	  if(tp->streamfp)
+	    {
+	      fits_get_hduaddrll(write_fptr[b], &hstart, &dstart, &dend,
+				 &wr_status);
+	      memsize[b]=(dend+2879)/2880*2880;
+	    }
+	  fits_close_file(write_fptr[b], &wr_status);
+	  if(tp->streamfp==NULL)
+	    bwritten+=filesize(fitsname);
+	}
       fits_report_error(stderr, wr_status);
- 
-      /* Report the results on stdout and in final_report: */
-      report_prepare_end(verb, log, *t, numimg, zero_flag, &remove_flag);
+      if(tp->streamfp && remove_flag==0)
+	{
+	  bwritten=streamthumbnails(tp, *t, mem, memsize);
+	  for(b=0;b<tp->numbands;++b)
+	    free(mem[b]);
+	}
+      if(numimg)
+	wc_status = wcsvfree(&fnwcs, &fwcs);
 
-      /* If the image should be removed, do so: */
-      if(remove_flag)
-	assert(unlink(fitsname)==0);
+      p->stats.write+=mseclap(&tl);
 
-      free(cropped);
+      /* Add this target to the result table. */
+      gettimeofday(&t2, NULL);
+      savetablerows(&tp->table, imgnames, *t, log[*t*LOG_COLS+2], numimg,
+		    a.imgs, a.ranges, a.bread, bwritten,
+		    msecdiff(&t1, &t2));
     }
   while(*(++t)!=NONINDEX);
+  arenafree(&a);
 
   /* Increment the `done` counter and return. */
   pthread_mutex_lock(p->m);
@@ -465,26 +892,27 @@ stitchcroponthread(void *inparam)
 
 
 
-
-
-
 void
 stitchandcrop(struct tifaaparams *tp)
 {
+  struct topology topo;
   size_t *targetthrds, thrdcols, crop_side;
 
   /* Parameters for parallel processing: */
   pthread_t *t;
   pthread_cond_t cv;
   pthread_attr_t attr;
-  size_t done, numactive;
+  size_t done, numactive, overflows;
   size_t i, nt=tp->numthrd;
   pthread_mutex_t mtx, wcsmtx;
   struct stitchcropthread *p;
 
-  /* Find the size of the output images: */
-  crop_side=tp->ps_size / tp->res;
-  if (crop_side%2==0) crop_side-=1;
+  /* Find the size of the largest output image: */
+  crop_side=cropside(tp->ps_size, tp->res);
+  if(tp->size_col!=NONINDEX)
+    for(i=0;i<tp->cs0;++i)
+      if(cropside(targetpssize(tp, i), tp->res)>crop_side)
+	crop_side=cropside(targetpssize(tp, i), tp->res);
 
   /* Threads/mutexs/condition variables initialization. */
   pthread_attr_init(&attr);
@@ -496,14 +924,39 @@ stitchandcrop(struct tifaaparams *tp)
   pthread_attr_setstacksize(&attr, 10*crop_side*crop_side);
   pthread_attr_setdetachstate(&attr, PTHREAD_CREATE_DETACHED);
   
-  prepindexsinthreads(tp->cs0, nt, &targetthrds, &thrdcols);
+  /* With `-n` the threads are pinned to the CPUs of the NUMA nodes
+     and each gets a group of targets that share images. */
+  if(tp->numa)
+    {
+      topologyread(&topo);
+      targetsbyimage(tp, nt, &targetthrds, &thrdcols);
+      if(tp->verb)
+	printf("%lu thread(s) pinned on %lu NUMA node(s).\n", nt,
+	       topo.nnodes < nt ? topo.nnodes : nt);
+    }
+  else
+    assert( prepindexsinthreads(tp->cs0, nt, &targetthrds,
+				&thrdcols)==TIFAA_OK );
+
+  /* The cache of survey image blocks is shared by all the threads
+     (and only kept for this run). */
+  assert( bcinit(&tp->cache, tp->cachemb*1024*1024)==0 );
+
+  /* The header templates are made when a survey image is first used
+     for a thumbnail's WCS (see headertemplate()). */
+  assert( (tp->headers=calloc(tp->survglob.gl_pathc,
+			      sizeof *tp->headers))!=NULL );
 
   for(i=0;i<nt;++i)
     {
       p[i].id=i; p[i].targetthrds=targetthrds; p[i].thrdcols=thrdcols;
       p[i].tp=tp; p[i].c=&cv; p[i].m=&mtx; p[i].done=&done;
       p[i].wm=&wcsmtx; p[i].crop_side=crop_side;
+      p[i].cpu = tp->numa ? topologycpu(&topo, i, nt, NULL) : -1;
+      memset(&p[i].stats, 0, sizeof p[i].stats);
+      p[i].overflows=0;
     }
+  if(tp->numa) topologyfree(&topo);
 
   /* Initalize `done` and `numactive` for this mesh type. */
   done=numactive=0;
@@ -522,6 +975,30 @@ stitchandcrop(struct tifaaparams *tp)
     pthread_cond_wait(&cv, &mtx);
   pthread_mutex_unlock(&mtx);
 
+  /* Add the time spent in each step on all the threads. */
+  memset(&tp->stats, 0, sizeof tp->stats);
+  for(overflows=i=0;i<nt;++i)
+    {
+      tp->stats.lockwait += p[i].stats.lockwait;
+      tp->stats.headers  += p[i].stats.headers;
+      tp->stats.read     += p[i].stats.read;
+      tp->stats.write    += p[i].stats.write;
+      overflows          += p[i].overflows;
+    }
+  if(overflows)
+    printf("%lu thumbnail(s) had pixels outside the range of their "
+	   "type, they were clipped.\n", overflows);
+
+  if(tp->verb && tp->cache)
+    printf("Block cache: %lu block(s) read, %lu reused.\n",
+	   tp->cache->misses, tp->cache->hits);
+  bcfree(tp->cache);
+  tp->cache=NULL;
+  for(i=0;i<tp->survglob.gl_pathc;++i)
+    hdrfree(&tp->headers[i]);
+  free(tp->headers);
+  tp->headers=NULL;
+
   free(p);
   free(t);
   free(targetthrds);
@@ -553,7 +1030,7 @@ void
 tiffasavelog(struct tifaaparams *p)
 {
   FILE *fp;
-  char logname[1000];
+  char logname[1000], name[10000];
   size_t i, *log=p->log;
   
   sprintf(logname, "%stifaalog.txt", p->out_name);
@@ -565,10 +1042,17 @@ tiffasavelog(struct tifaaparams *p)
           "# Col 1: Number of images used for this object.\n"
 	  "# Col 2: Flag = 0 : No problem\n"
 	  "#             = 1 : The central region is zero\n"
-	  "#             = 2 : The object was not in the field.\n");
+	  "#             = 2 : The object was not in the field.\n"
+	  "# Col 3: Thumbnail (of the first band), relative to the\n"
+	  "#        output directory (`-`: no thumbnail or streamed).\n");
   for(i=0;i<p->cs0;++i)
-    fprintf(fp, "%-6lu %-5lu %-5lu\n", log[i*LOG_COLS], 
-	    log[i*LOG_COLS+1], log[i*LOG_COLS+2]);
+    {
+      thumbnailname(p, i, 0, name);
+      fprintf(fp, "%-6lu %-5lu %-5lu %s\n", log[i*LOG_COLS], 
+	      log[i*LOG_COLS+1], log[i*LOG_COLS+2],
+	      log[i*LOG_COLS+2] || p->streamfp ? "-"
+	      : name+strlen(p->out_name));
+    }
 
   fclose(fp);
 }
@@ -577,30 +1061,109 @@ tiffasavelog(struct tifaaparams *p)
 
 
 
+/* Open the per-target result table and write its header. The rows
+   are written by a separate thread as soon as each target is done
+   (see savetablerows()), so the table can be inspected while TIFAA
+   is running and is useful even if it doesn't finish. */
+FILE *
+tifaastarttable(struct tifaaparams *p)
+{
+  FILE *fp;
+  char tablename[1000];
+
+  sprintf(tablename, "%stifaatable.txt", p->out_name);
+  assert( (fp=fopen(tablename, "w"))!=NULL );
+
+  fprintf(fp,
+	  "# Result of cropping each object, one row for every image\n"
+	  "# used for that object:\n"
+	  "# Col 0:  Object ID (row in catalog, counting from 1).\n"
+	  "# Col 1:  Flag (see tifaalog.txt).\n"
+	  "# Col 2:  Number of images used for this object.\n"
+	  "# Col 3:  Index of this image (-1: not in field).\n"
+	  "# Col 4:  First pixel read from the image along axis 1.\n"
+	  "# Col 5:  Last pixel read from the image along axis 1.\n"
+	  "# Col 6:  First pixel read from the image along axis 2.\n"
+	  "# Col 7:  Last pixel read from the image along axis 2.\n"
+	  "# Col 8:  Bytes read from this image (and its weight).\n"
+	  "# Col 9:  Bytes written for this object.\n"
+	  "# Col 10: Time taken for this object (milliseconds).\n"
+	  "# Col 11: Name of this image.\n");
+
+  writerstart(&p->table, fp);
+  return fp;
+}
+
+
+
+
+
 void
 tifaa(struct tifaaparams *p)
 {
+  FILE *tablefp;
   char report[100];
   struct timeval t1;
 
-  /* Get the image information. */
-  if(p->verb) gettimeofday(&t1, NULL);
-  getsurveyimageinfo(p);
-  if(p->verb) 
+  /* As a server, the targets come from the clients, not the
+     catalog, and the server reads the survey itself. */
+  if(p->socket_name)
     {
-      sprintf(report, "WCS info of %lu image(s) has been read.", 
-	      (size_t)(p->survglob.gl_pathc));
-      reporttiming(&t1, report, 1);
+      tifaaserver(p);
+      return;
     }
 
-  /* Find which image is needed for which object. */
-  if(p->verb) gettimeofday(&t1, NULL);
-  whichimageforwhichtargets(p);
-  if(p->verb) reporttiming(&t1, "Target/image correspondance found.", 1);
+  /* The images of each target can come from a plan that was made
+     before (`-X` without `-x`). */
+  if(p->plan_name && p->planonly==0)
+    {
+      if(p->verb) gettimeofday(&t1, NULL);
+      readplan(p);
+      if(p->verb) reporttiming(&t1, "Plan read.", 1);
+    }
+  else
+    {
+      /* Get the image information. */
+      if(p->verb) gettimeofday(&t1, NULL);
+      getsurveyimageinfo(p);
+      if(p->verb) 
+	{
+	  sprintf(report, "WCS info of %lu image(s) has been read.", 
+		  (size_t)(p->survglob.gl_pathc));
+	  reporttiming(&t1, report, 1);
+	}
+
+      /* Find which image is needed for which object. */
+      if(p->verb) gettimeofday(&t1, NULL);
+      whichimageforwhichtargets(p);
+      if(p->verb)
+	reporttiming(&t1, "Target/image correspondance found.", 1);
+    }
+
+  /* Only the plan, no pixels are read. */
+  if(p->planonly)
+    {
+      tifaaplan(p);
+      return;
+    }
+
+  /* In a scaling study, only a sample of the targets is cropped
+     several times to measure the performance. */
+  if(p->scalingn)
+    {
+      scalingstudy(p);
+      return;
+    }
 
   /* Stitch or crop the targets out of the images. */
   if(p->verb) gettimeofday(&t1, NULL);
+  makeshards(p);
+  tablefp=tifaastarttable(p);
+  if(p->streamfp) writerstart(&p->stream, p->streamfp);
   stitchandcrop(p);
+  if(p->streamfp) writerfinish(&p->stream);
+  writerfinish(&p->table);
+  fclose(tablefp);
   if(p->verb) 
     {
       sprintf(report, "All %lu target(s) stitched or cropped.", p->cs0);
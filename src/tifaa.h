@@ -24,13 +24,44 @@ along with tifaa.  If not, see <http://www.gnu.org/licenses/>.
 #define TIFAA_H
 
 #include <glob.h>
+#include <stdint.h>
+#include <fitsio.h>
+#include <wcslib/wcs.h>
+
+#include "arena.h"
+#include "pixels.h"
+#include "header.h"
+#include "writer.h"
 
 #define TIFFAVERSION        "v0.3"
 
 #define NONINDEX            (size_t)(-1)
-#define NUM_IMAGEINFO_COLS  4
-#define WI_COLS             8
+#define FP_VERTICES         8   /* Vertices of each image footprint. */
+#define NUM_IMAGEINFO_COLS  (4+2*FP_VERTICES)
 #define LOG_COLS            3
+#define MAXBANDS            16
+#define SHARDSIZE           1000 /* Entries in each output directory. */
+
+/* Type of the thumbnails (`-T`). */
+#define OUT_FLOAT           0   /* 32-bit floating point.             */
+#define OUT_INPUT           1   /* BITPIX of the survey images.       */
+#define OUT_SHORT           2   /* Quantized to 16-bit integers.      */
+#define QBLANK              -32768 /* Null pixels of OUT_SHORT.       */
+
+
+
+
+
+/* Time spent (by all threads together) in each step of cropping, in
+   milliseconds. Opening the images includes waiting for the WCS
+   mutex. */
+struct cropstats
+{
+  double    lockwait;  /* Waiting for the WCS mutex.                    */
+  double     headers;  /* Opening images and reading their WCS.         */
+  double        read;  /* Reading (and weighting) the pixels.           */
+  double       write;  /* Making and writing the thumbnails.            */
+};
 
 
 
@@ -42,6 +73,17 @@ struct tifaaparams
   size_t    numthrd;  /* Number of threads to use.                      */
   int          verb;  /* ==1: report steps. ==0 don't.                  */
   int  weightmultip;  /* ==1: Multiply by weight. ==0, don't.           */
+  size_t   scalingn;  /* >0: Scaling study with this many targets.      */
+  char *socket_name;  /* !=NULL: Run as a server on this Unix socket.   */
+  size_t    cachemb;  /* Budget of the block cache (megabytes).         */
+  size_t   numbands;  /* Number of bands (`-s` options).                */
+  int          numa;  /* ==1: Pin threads on NUMA nodes (`-n`).         */
+  int      planonly;  /* ==1: Only report the plan, no crops (`-x`).    */
+  char   *plan_name;  /* Plan to write (with `-x`) or to crop (`-X`).   */
+  size_t     shards;  /* Levels of output subdirectories (0: flat).    */
+  FILE    *streamfp;  /* !=NULL: Stream the thumbnails here (`-O`).     */
+  int       outtype;  /* Type of the thumbnails: OUT_* above (`-T`).    */
+  int      checksum;  /* ==1: CHECKSUM and DATASUM keywords (`-C`).     */
 
   /* Details: */
   double       *cat;  /* Data of catalog.                               */
@@ -49,10 +91,13 @@ struct tifaaparams
   size_t        cs1;  /* Number of columns in the catalog.              */
   size_t     ra_col;  /* Catalog RA column                              */
   size_t    dec_col;  /* Catalog Dec column                             */
+  size_t   size_col;  /* Catalog size column (NONINDEX: use `ps_size`). */
   double        res;  /* Resolution in arcseconds                       */
   double    ps_size;  /* Postage stamp size (in arcseconds).            */
   glob_t   survglob;  /* glob structure of input images.                */
   glob_t  wsurvglob;  /* glob structure of weight images.               */
+  glob_t  *bandglob;  /* Images of the other bands (numbands-1).        */
+  glob_t *wbandglob;  /* Weight images of the other bands.              */
   char    *out_name;  /* Folder keeping the cropped images              */
   char     *out_ext;  /* Ending of output file name                     */
   long     chk_size;  /* width of a box to check for zeros              */
@@ -60,8 +105,19 @@ struct tifaaparams
 
   /* Internal parameters:  */
   double   *imginfo;  /* Necessary information for each image.          */
-  size_t  *whichimg;  /* Array saying which images for which target.    */
+  int       indexed;  /* ==1: `imginfo` filled when finding the images. */
+  struct fzindex *fzindex; /* Compression tiles of each image.          */
+  struct fzindex *wfzindex; /* Compression tiles of each weight image.  */
+  struct blockcache *cache; /* Decoded blocks (NULL: no cache).         */
+  struct hdrtemplate *headers; /* Header template of each image.       */
+  size_t     *wioff;  /* Images of target `t`: wiimg[wioff[t]] until    */
+                      /* wiimg[wioff[t+1]-1] (`cs0+1` elements).        */
+  uint32_t   *wiimg;  /* Images of all the targets (see above).         */
+  size_t      wimax;  /* Largest number of images for one target.       */
   size_t       *log;  /* Log for all the objects.                       */
+  struct writer table; /* Writer of the per-target result table.        */
+  struct writer stream; /* Writer of the streamed thumbnails.          */
+  struct cropstats stats; /* Time in each step of the last crop.        */
 };
 
 
@@ -73,16 +129,76 @@ struct stitchcropthread
   size_t              id; /* ID of thread.                            */
   size_t    *targetthrds; /* Which target for which thread.           */
   size_t        thrdcols; /* Number of columns in targetthrd.         */
-  size_t       crop_side; /* Side of the cropped region in pixels.    */
+  size_t       crop_side; /* Side of the largest cropped region.      */
+  int                cpu; /* CPU to run on (<0: any CPU).             */
   struct tifaaparams *tp; /* All available parameters.                */
 
   size_t           *done; /* Counter of number of compelted threads.  */
   pthread_mutex_t     *m; /* Thread mutex.                            */
   pthread_mutex_t    *wm; /* WCS mutex.                               */
+  struct cropstats stats; /* Time spent in each step on this thread.  */
+  size_t       overflows; /* Thumbnails with clipped pixels.          */
   pthread_cond_t      *c; /* Conditional variable.                    */
 };
 
 /* Function declarations: */
+double
+targetpssize(struct tifaaparams *p, size_t t);
+
+size_t
+cropside(double ps_size, double res);
+
+void
+readsurveysubset(struct tifaaparams *tp, size_t index, int layer,
+		 fitsfile *fptr, int bitpix, long *inaxes, long *fpixel_i,
+		 long *lpixel_i, float nulval, struct pixregion *r,
+		 struct fzscratch *scratch, int *status);
+
+void
+readbandsubset(struct tifaaparams *tp, size_t band, size_t index,
+	       long *inaxes, long *fpixel_i, long *lpixel_i, long crop_side,
+	       long *fpixel_c, long *lpixel_c, float nulval, float *out,
+	       struct croparena *a, size_t *bread);
+
+size_t
+shardlevels(size_t n);
+
+void
+makeshards(struct tifaaparams *tp);
+
+void
+thumbnailname(struct tifaaparams *tp, size_t t, size_t band, char *name);
+
+int
+quantizeshort(float *in, size_t n, float nulval, short *out,
+	      double *bscale, double *bzero);
+
+size_t
+filesize(char *name);
+
+long long
+thumbnailblank(fitsfile *fptr, int bitpix, int *status);
+
+void
+createthumbnail(fitsfile *fptr, int outtype, int inbitpix,
+		double inbscale, double inbzero, long long inblank,
+		long *onaxes, float *pix, float nulval, short *qbuf,
+		int *datatype, void **data, int *status);
+
+struct hdrtemplate *
+headertemplate(struct tifaaparams *tp, size_t img, struct wcsprm *wcs,
+	       pthread_mutex_t *m);
+
+FILE *
+tifaastarttable(struct tifaaparams *p);
+
+size_t
+streamthumbnails(struct tifaaparams *tp, size_t t, void **mem,
+		 size_t *sizes);
+
+void
+stitchandcrop(struct tifaaparams *tp);
+
 void 
 tifaa(struct tifaaparams *p);
 
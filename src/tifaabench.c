@@ -0,0 +1,713 @@
+/*********************************************************************
+tifaabench - Micro-benchmarks of the hot kernels in tifaa.
+A simple set of functions to crop thumbnails from astronomical archives.
+
+Copyright (C) 2013-2014 Mohammad Akhlaghi
+Tohoku University Astronomical Institute, Sendai, Japan.
+http://astr.tohoku.ac.jp/~akhlaghi/
+
+tifaa is free software: you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation, either version 3 of the License, or
+(at your option) any later version.
+
+tifaa is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with tifaa.  If not, see <http://www.gnu.org/licenses/>.
+**********************************************************************/
+#include <math.h>
+#include <time.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <assert.h>
+#include <string.h>
+#include <unistd.h>
+#include <pthread.h>
+
+#include "tifaa.h"
+#include "attaavv.h"
+#include "surveyimginfo.h"
+#include "survey.h"
+
+#define NUMPOINTS      1024     /* Number of points in each call.     */
+#define BENCHIMGSIDE   2048     /* Side of the benchmark image.       */
+#define BENCHCROPSIDE  101      /* Side of the benchmark crop.        */
+#define BENCHGRIDSIDE  16       /* Tiles along each side of the grid. */
+#define BENCHCATROWS   10000    /* Rows in the benchmark catalog.     */
+#define BENCHRES       0.2      /* Resolution (arcseconds/pixel).     */
+
+
+
+
+
+struct benchparams
+{
+  size_t      warmup;  /* Number of calls before timing.             */
+  size_t        reps;  /* Number of timed calls.                     */
+  char         *only;  /* Only run kernels with this in their name.  */
+  char      *tmp_dir;  /* Directory to keep temporary files.         */
+};
+
+
+
+
+
+/* Everything that the kernels need. They are prepared once before
+   the timings start so only the kernel itself is timed. */
+struct benchdata
+{
+  double         *world;  /* RA and Dec of NUMPOINTS points.          */
+  double        *pixcrd;  /* Pixel positions of NUMPOINTS points.     */
+  double       *imginfo;  /* Image information of the grid of tiles.  */
+  size_t          ntile;  /* Number of tiles in imginfo.              */
+  struct wcsprm    *wcs;  /* WCS of the benchmark image.              */
+  struct hdrtemplate hdr; /* Header template made with `wcs`.         */
+  float          *image;  /* The benchmark image in memory.           */
+  float           *crop;  /* Space for one crop.                      */
+  float         *weight;  /* Weight of one crop.                      */
+  short          *scrop;  /* One crop as 16-bit integers.             */
+  fitsfile        *fptr;  /* Benchmark image, opened.                 */
+  char      *imagename;  /* Name of the benchmark image.              */
+  char        *catname;  /* Name of the benchmark catalog.            */
+  char         *header;  /* Reused header (WCS keywords only).       */
+  size_t         hsize;  /* Allocated bytes in `header`.             */
+  long          counter;  /* To change the position in each call.     */
+  double           sink;  /* To keep the results from being ignored.  */
+};
+
+
+
+
+
+
+
+
+
+
+
+
+
+
+
+
+
+
+
+
+/*************************************************************/
+/******************        Timing         ********************/
+/*************************************************************/
+double
+nsecnow(void)
+{
+  struct timespec ts;
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return ts.tv_sec*1e9+ts.tv_nsec;
+}
+
+
+
+
+
+int
+comparedoubles(const void *a, const void *b)
+{
+  double da=*(double *)a, db=*(double *)b;
+  return da<db ? -1 : (da>db ? 1 : 0);
+}
+
+
+
+
+
+/* Call `kernel` bp->warmup times without timing, then bp->reps times
+   while timing each call. Each call does `nops` operations, so the
+   reported times are per operation, in nanoseconds. */
+void
+runkernel(struct benchparams *bp, struct benchdata *bd, char *name,
+	  void (*kernel)(struct benchdata *), size_t nops)
+{
+  size_t i;
+  double t0, *times;
+
+  if(bp->only && strstr(name, bp->only)==NULL) return;
+
+  for(i=0;i<bp->warmup;++i)
+    kernel(bd);
+
+  assert( (times=malloc(bp->reps*sizeof *times))!=NULL );
+  for(i=0;i<bp->reps;++i)
+    {
+      t0=nsecnow();
+      kernel(bd);
+      times[i]=(nsecnow()-t0)/nops;
+    }
+  qsort(times, bp->reps, sizeof *times, comparedoubles);
+
+  printf("%-32s %-6lu %-12.1f %-12.1f %-12.1f %-12.1f %-12.1f\n", name,
+	 nops, times[0], times[bp->reps/2], times[bp->reps*9/10],
+	 times[bp->reps*99/100], times[bp->reps-1]);
+  free(times);
+}
+
+
+
+
+
+
+
+
+
+
+
+
+
+
+
+
+
+
+
+
+/*************************************************************/
+/******************        Kernels        ********************/
+/*************************************************************/
+void
+kernelconvert(struct benchdata *bd)
+{
+  long out;
+  size_t i;
+  for(i=0;i<NUMPOINTS;++i)
+    {
+      convert_double_to_long_in_FITS(bd->pixcrd[i*2], &out);
+      bd->sink+=out;
+    }
+}
+
+
+
+
+
+void
+kernelpixelrange(struct benchdata *bd)
+{
+  size_t i;
+  long fpixel_i[2], lpixel_i[2], fpixel_c[2], lpixel_c[2];
+  for(i=0;i<NUMPOINTS;++i)
+    {
+      find_desired_pixel_range(&bd->pixcrd[i*2], BENCHIMGSIDE,
+			       BENCHIMGSIDE, BENCHCROPSIDE, fpixel_i,
+			       lpixel_i, fpixel_c, lpixel_c);
+      bd->sink+=fpixel_i[0]+lpixel_c[1];
+    }
+}
+
+
+
+
+
+void
+kernelfootprint(struct benchdata *bd)
+{
+  size_t i;
+  uint32_t out[BENCHGRIDSIDE*BENCHGRIDSIDE];
+  for(i=0;i<NUMPOINTS;++i)
+    bd->sink+=imagesforonetarget(bd->world[i*2], bd->world[i*2+1],
+				 BENCHCROPSIDE/2.0, bd->imginfo, bd->ntile,
+				 out, BENCHGRIDSIDE*BENCHGRIDSIDE);
+}
+
+
+
+
+
+void
+kernelwcss2psingle(struct benchdata *bd)
+{
+  size_t i;
+  int stat[1];
+  double phi, theta, imgcrd[2], pixcrd[2];
+  for(i=0;i<NUMPOINTS;++i)
+    {
+      wcss2p(bd->wcs, 1, 2, &bd->world[i*2], &phi, &theta, imgcrd,
+	     pixcrd, stat);
+      bd->sink+=pixcrd[0];
+    }
+}
+
+
+
+
+
+void
+kernelwcss2pbatch(struct benchdata *bd)
+{
+  int stat[NUMPOINTS];
+  double phi[NUMPOINTS], theta[NUMPOINTS];
+  double imgcrd[2*NUMPOINTS], pixcrd[2*NUMPOINTS];
+  wcss2p(bd->wcs, NUMPOINTS, 2, bd->world, phi, theta, imgcrd,
+	 pixcrd, stat);
+  bd->sink+=pixcrd[0];
+}
+
+
+
+
+
+/* The position of the crop is changed on every call so the same
+   pixels aren't always read. */
+void
+cropposition(struct benchdata *bd, long *fpixel, long *lpixel)
+{
+  bd->counter=(bd->counter+7919)%(BENCHIMGSIDE-BENCHCROPSIDE);
+  fpixel[0]=bd->counter+1;
+  fpixel[1]=(bd->counter*31)%(BENCHIMGSIDE-BENCHCROPSIDE)+1;
+  lpixel[0]=fpixel[0]+BENCHCROPSIDE-1;
+  lpixel[1]=fpixel[1]+BENCHCROPSIDE-1;
+}
+
+
+
+
+
+void
+kernelreadsubset(struct benchdata *bd)
+{
+  int status=0, anynul;
+  long fpixel[2], lpixel[2], naxes[2]={BENCHIMGSIDE, BENCHIMGSIDE};
+  long inc[2]={1,1};
+  cropposition(bd, fpixel, lpixel);
+  fits_read_subset_flt(bd->fptr, 0, 2, naxes, fpixel, lpixel, inc, -9999,
+		       bd->crop, &anynul, &status);
+  bd->sink+=bd->crop[0];
+}
+
+
+
+
+
+void
+kernelrawcopy(struct benchdata *bd)
+{
+  long y, fpixel[2], lpixel[2];
+  cropposition(bd, fpixel, lpixel);
+  for(y=fpixel[1];y<=lpixel[1];++y)
+    memcpy(&bd->crop[(y-fpixel[1])*BENCHCROPSIDE],
+	   &bd->image[(y-1)*BENCHIMGSIDE+fpixel[0]-1],
+	   BENCHCROPSIDE*sizeof *bd->crop);
+  bd->sink+=bd->crop[0];
+}
+
+
+
+
+
+/* What is done for every image of every target before reading. */
+void
+kernelprepwcs(struct benchdata *bd)
+{
+  fitsfile *fptr;
+  char *fullheader;
+  struct wcsprm *wcs;
+  pthread_mutex_t wm=PTHREAD_MUTEX_INITIALIZER;
+  int nwcs, f_status=0, w_status=0, err;
+
+  if( (err=prepare_fitswcs(bd->imagename, &fptr, &f_status, &w_status,
+			   &nwcs, &wcs, &wm, &fullheader, NULL, NULL)) )
+    exitonerror(err, bd->imagename, f_status, w_status);
+  bd->sink+=wcs->crpix[0];
+  wcsvfree(&nwcs, &wcs);
+  free(fullheader);
+  fits_close_file(fptr, &f_status);
+}
+
+
+
+
+
+/* Like kernelprepwcs(), but with the WCS keywords only, read into a
+   reused buffer (as in stitchcroponthread()). */
+void
+kernelprepwcstrim(struct benchdata *bd)
+{
+  fitsfile *fptr;
+  struct wcsprm *wcs;
+  pthread_mutex_t wm=PTHREAD_MUTEX_INITIALIZER;
+  int nwcs, f_status=0, w_status=0, err;
+
+  if( (err=prepare_fitswcs(bd->imagename, &fptr, &f_status, &w_status,
+			   &nwcs, &wcs, &wm, &bd->header, &bd->hsize,
+			   NULL)) )
+    exitonerror(err, bd->imagename, f_status, w_status);
+  bd->sink+=wcs->crpix[0];
+  wcsvfree(&nwcs, &wcs);
+  fits_close_file(fptr, &f_status);
+}
+
+
+
+
+
+void
+kernelweight(struct benchdata *bd)
+{
+  multiplyweight(bd->crop, bd->weight, BENCHCROPSIDE*BENCHCROPSIDE);
+  bd->sink+=bd->crop[0];
+}
+
+
+
+
+
+/* 16-bit pixels converted, multiplied by their weights and put in the
+   thumbnail in one pass (with a BLANK, as in stitchcroponthread()). */
+void
+kernelpixpaste(struct benchdata *bd)
+{
+  long fpixel[2]={1,1}, lpixel[2]={BENCHCROPSIDE, BENCHCROPSIDE};
+  struct pixregion s={PIX_SHORT, bd->scrop, 1, 0, -32768};
+  struct pixregion w={PIX_FLOAT, bd->weight, 1, 0, PIX_NOBLANK};
+
+  pixpaste(bd->crop, BENCHCROPSIDE, fpixel, lpixel, &s, &w, -9999);
+  bd->sink+=bd->crop[0];
+}
+
+
+
+
+
+/* DATASUM of a thumbnail (with `-C`). */
+void
+kerneldatasum(struct benchdata *bd)
+{
+  bd->sink+=pixdatasum(PIX_FLOAT, bd->crop, BENCHCROPSIDE*BENCHCROPSIDE);
+}
+
+
+
+
+
+/* Making the file and image are also timed here, so they are timed
+   alone in kernelnoheader() for comparison. */
+void
+kernelnoheader(struct benchdata *bd)
+{
+  fitsfile *fptr;
+  int status=0;
+  long naxes[2]={BENCHCROPSIDE, BENCHCROPSIDE};
+  fits_create_file(&fptr, "mem://", &status);
+  fits_create_img(fptr, FLOAT_IMG, 2, naxes, &status);
+  fits_close_file(fptr, &status);
+  bd->sink+=status;
+}
+
+
+
+
+
+void
+kerneladdheader(struct benchdata *bd)
+{
+  fitsfile *fptr;
+  int status=0;
+  double crpix[2];
+  long fpixel_i[2]={500,700}, fpixel_c[2]={1,1};
+  long naxes[2]={BENCHCROPSIDE, BENCHCROPSIDE};
+
+  crpix[0]=bd->wcs->crpix[0]; crpix[1]=bd->wcs->crpix[1];
+  fits_create_file(&fptr, "mem://", &status);
+  fits_create_img(fptr, FLOAT_IMG, 2, naxes, &status);
+  addheaderinfo(fptr, &status, bd->wcs, fpixel_i, fpixel_c, bd->world,
+		BENCHCROPSIDE*BENCHRES, BENCHRES);
+  fits_close_file(fptr, &status);
+  bd->wcs->crpix[0]=crpix[0]; bd->wcs->crpix[1]=crpix[1];
+}
+
+
+
+
+
+/* The same header as kerneladdheader(), from the template. */
+void
+kernelhdrtemplate(struct benchdata *bd)
+{
+  fitsfile *fptr;
+  int status=0;
+  long fpixel_i[2]={500,700}, fpixel_c[2]={1,1};
+  long naxes[2]={BENCHCROPSIDE, BENCHCROPSIDE};
+
+  fits_create_file(&fptr, "mem://", &status);
+  fits_create_img(fptr, FLOAT_IMG, 2, naxes, &status);
+  hdrwrite(fptr, &bd->hdr, bd->wcs, fpixel_i, fpixel_c, bd->world,
+	   BENCHCROPSIDE*BENCHRES, BENCHRES, &status);
+  fits_close_file(fptr, &status);
+  bd->sink+=status;
+}
+
+
+
+
+
+void
+kernelreadcatalog(struct benchdata *bd)
+{
+  struct ArrayInfo ai;
+  readasciitable(bd->catname, &ai);
+  bd->sink+=ai.d[0];
+  freeasciitable(&ai);
+}
+
+
+
+
+
+
+
+
+
+
+
+
+
+
+
+
+
+
+
+
+/*************************************************************/
+/******************      Preparations     ********************/
+/*************************************************************/
+void
+preparebenchdata(struct benchparams *bp, struct benchdata *bd)
+{
+  FILE *fp;
+  size_t i, j;
+  int status=0, stat[NUMPOINTS];
+  double *im, fx[FP_VERTICES]={1,0,-1,-1,-1,0,1,1};
+  double fy[FP_VERTICES]={-1,-1,-1,0,1,1,1,0};
+  long naxes[2]={BENCHIMGSIDE, BENCHIMGSIDE};
+  double phi[NUMPOINTS], theta[NUMPOINTS], imgcrd[2*NUMPOINTS];
+  double tilewidth=BENCHIMGSIDE*BENCHRES/3600;
+
+  /* A TAN projection WCS for the benchmark image. */
+  assert( (bd->wcs=malloc(sizeof *bd->wcs))!=NULL );
+  bd->wcs->flag=-1;
+  assert( wcsini(1, 2, bd->wcs)==0 );
+  strcpy(bd->wcs->ctype[0], "RA---TAN");
+  strcpy(bd->wcs->ctype[1], "DEC--TAN");
+  bd->wcs->crval[0]=150.0f;        bd->wcs->crval[1]=2.0f;
+  bd->wcs->crpix[0]=BENCHIMGSIDE/2; bd->wcs->crpix[1]=BENCHIMGSIDE/2;
+  bd->wcs->cdelt[0]=-1*BENCHRES/3600; bd->wcs->cdelt[1]=BENCHRES/3600;
+  assert( wcsset(bd->wcs)==0 );
+  assert( hdrmake(&bd->hdr, bd->wcs)==0 );
+
+  /* Pixel positions in and around the image, and their RA and Dec. */
+  assert( (bd->pixcrd=malloc(2*NUMPOINTS*sizeof *bd->pixcrd))!=NULL );
+  assert( (bd->world=malloc(2*NUMPOINTS*sizeof *bd->world))!=NULL );
+  for(i=0;i<2*NUMPOINTS;++i)
+    bd->pixcrd[i]=(double)((i*7919)%(BENCHIMGSIDE+200))-100+0.37f;
+  assert( wcsp2s(bd->wcs, NUMPOINTS, 2, bd->pixcrd, imgcrd, phi, theta,
+		 bd->world, stat)==0 );
+
+  /* Image information for a grid of tiles around the points (with the
+     same columns as getsurveyimageinfo()). */
+  bd->ntile=BENCHGRIDSIDE*BENCHGRIDSIDE;
+  assert( (bd->imginfo=malloc(bd->ntile*NUM_IMAGEINFO_COLS
+			      *sizeof *bd->imginfo))!=NULL );
+  for(i=0;i<bd->ntile;++i)
+    {
+      im=&bd->imginfo[i*NUM_IMAGEINFO_COLS];
+      im[0]= ( 150.0f - tilewidth
+	       * ((double)(i%BENCHGRIDSIDE)-BENCHGRIDSIDE/2.0f+0.5f) );
+      im[1]= ( 2.0f + tilewidth
+	       * ((double)(i/BENCHGRIDSIDE)-BENCHGRIDSIDE/2.0f+0.5f) );
+      im[2]=tilewidth/2*M_SQRT2/cos((fabs(im[1])+tilewidth/2)*M_PI/180);
+      im[3]=BENCHRES/3600;
+      for(j=0;j<FP_VERTICES;++j)
+	{
+	  im[4+2*j]=im[0]+fx[j]*tilewidth/2/cos(im[1]*M_PI/180);
+	  im[5+2*j]=im[1]+fy[j]*tilewidth/2;
+	}
+    }
+
+  /* The benchmark image, in memory and on disk. */
+  assert( (bd->image=malloc(BENCHIMGSIDE*BENCHIMGSIDE
+			    *sizeof *bd->image))!=NULL );
+  for(i=0;i<BENCHIMGSIDE*BENCHIMGSIDE;++i)
+    bd->image[i]=i%1000;
+  assert( (bd->crop=malloc(BENCHCROPSIDE*BENCHCROPSIDE
+			   *sizeof *bd->crop))!=NULL );
+  assert( (bd->weight=malloc(BENCHCROPSIDE*BENCHCROPSIDE
+			     *sizeof *bd->weight))!=NULL );
+  assert( (bd->scrop=malloc(BENCHCROPSIDE*BENCHCROPSIDE
+			    *sizeof *bd->scrop))!=NULL );
+  for(i=0;i<BENCHCROPSIDE*BENCHCROPSIDE;++i)
+    {
+      bd->crop[i]=bd->weight[i]=1.0f;
+      bd->scrop[i]=i%1000;
+    }
+
+  assert( (bd->imagename=malloc(strlen(bp->tmp_dir)+50))!=NULL );
+  sprintf(bd->imagename, "%stifaabench_%d.fits", bp->tmp_dir, getpid());
+  fits_create_file(&bd->fptr, bd->imagename, &status);
+  fits_create_img(bd->fptr, FLOAT_IMG, 2, naxes, &status);
+  fits_write_img(bd->fptr, TFLOAT, 1, BENCHIMGSIDE*BENCHIMGSIDE,
+		 bd->image, &status);
+  fits_write_key(bd->fptr, TSTRING, "CTYPE1", "RA---TAN", NULL, &status);
+  fits_write_key(bd->fptr, TSTRING, "CTYPE2", "DEC--TAN", NULL, &status);
+  fits_write_key(bd->fptr, TDOUBLE, "CRPIX1", &bd->wcs->crpix[0], NULL,
+		 &status);
+  fits_write_key(bd->fptr, TDOUBLE, "CRPIX2", &bd->wcs->crpix[1], NULL,
+		 &status);
+  fits_write_key(bd->fptr, TDOUBLE, "CRVAL1", &bd->wcs->crval[0], NULL,
+		 &status);
+  fits_write_key(bd->fptr, TDOUBLE, "CRVAL2", &bd->wcs->crval[1], NULL,
+		 &status);
+  fits_write_key(bd->fptr, TDOUBLE, "CDELT1", &bd->wcs->cdelt[0], NULL,
+		 &status);
+  fits_write_key(bd->fptr, TDOUBLE, "CDELT2", &bd->wcs->cdelt[1], NULL,
+		 &status);
+  fits_close_file(bd->fptr, &status);
+  fits_open_file(&bd->fptr, bd->imagename, READONLY, &status);
+  if(status)
+    {
+      fits_report_error(stderr, status);
+      exit(EXIT_FAILURE);
+    }
+
+  /* The benchmark catalog. */
+  assert( (bd->catname=malloc(strlen(bp->tmp_dir)+50))!=NULL );
+  sprintf(bd->catname, "%stifaabench_%d.txt", bp->tmp_dir, getpid());
+  assert( (fp=fopen(bd->catname, "w"))!=NULL );
+  fprintf(fp, "# Benchmark catalog.\n");
+  for(i=0;i<BENCHCATROWS;++i)
+    fprintf(fp, "%-8lu %-15.10f %-15.10f\n", i+1,
+	    bd->world[(i%NUMPOINTS)*2], bd->world[(i%NUMPOINTS)*2+1]);
+  fclose(fp);
+
+  bd->counter=0;
+  bd->sink=0;
+  bd->header=NULL;
+  bd->hsize=0;
+}
+
+
+
+
+
+void
+freebenchdata(struct benchdata *bd)
+{
+  int status=0;
+  fits_close_file(bd->fptr, &status);
+  unlink(bd->imagename);
+  unlink(bd->catname);
+  hdrfree(&bd->hdr);
+  wcsfree(bd->wcs);
+  free(bd->wcs);
+  free(bd->crop);
+  free(bd->world);
+  free(bd->image);
+  free(bd->pixcrd);
+  free(bd->weight);
+  free(bd->scrop);
+  free(bd->catname);
+  free(bd->imginfo);
+  free(bd->header);
+  free(bd->imagename);
+}
+
+
+
+
+
+void
+setbenchparams(int argc, char *argv[], struct benchparams *bp)
+{
+  int c;
+  char *tailptr;
+
+  bp->warmup=10;  bp->reps=200;
+  bp->only=NULL;  bp->tmp_dir="/tmp/";
+
+  while( (c=getopt(argc, argv, "hw:n:k:d:")) != -1 )
+    switch(c)
+      {
+      case 'h':
+	printf("\n\ntifaabench: micro-benchmarks of the TIFAA kernels.\n\n"
+	       " -h:\n\tPrint this help message.\n\n"
+	       "-w INTEGER:\n\tDEFAULT: %lu\n"
+	       "\tNumber of (untimed) warm-up calls of each kernel.\n\n"
+	       "-n INTEGER:\n\tDEFAULT: %lu\n"
+	       "\tNumber of timed calls of each kernel.\n\n"
+	       "-k STRING:\n\tOnly run the kernels with this in their name.\n\n"
+	       "-d STRING:\n\tDEFAULT: `%s`\n"
+	       "\tDirectory to keep the temporary files (ending in `/`).\n\n",
+	       bp->warmup, bp->reps, bp->tmp_dir);
+	exit(EXIT_SUCCESS);
+      case 'w': bp->warmup=strtoul(optarg, &tailptr, 0); break;
+      case 'n': bp->reps=strtoul(optarg, &tailptr, 0);   break;
+      case 'k': bp->only=optarg;                         break;
+      case 'd': bp->tmp_dir=optarg;                      break;
+      case '?':
+	fprintf(stderr, "Unknown option: '-%c'.\n\n", optopt);
+	exit(EXIT_FAILURE);
+      default:
+	abort();
+      }
+  if(bp->reps==0)
+    {
+      fprintf(stderr, "tifaabench: `-n` has to be larger than zero.\n");
+      exit(EXIT_FAILURE);
+    }
+}
+
+
+
+
+
+int
+main(int argc, char *argv[])
+{
+  struct benchdata bd;
+  struct benchparams bp;
+
+  setbenchparams(argc, argv, &bp);
+  preparebenchdata(&bp, &bd);
+
+  printf("# TIFAA %s kernel benchmarks: %lu warm-up and %lu timed calls.\n"
+	 "# Crops are %dx%d pixels from a %dx%d image.\n"
+	 "# Col 0: Kernel.\n"
+	 "# Col 1: Operations in each call.\n"
+	 "# Col 2-6: Minimum, median, 90%%, 99%% and maximum time of one\n"
+	 "#          operation (nanoseconds).\n", TIFFAVERSION, bp.warmup,
+	 bp.reps, BENCHCROPSIDE, BENCHCROPSIDE, BENCHIMGSIDE, BENCHIMGSIDE);
+
+  runkernel(&bp, &bd, "convert_double_to_long_in_FITS", kernelconvert,
+	    NUMPOINTS);
+  runkernel(&bp, &bd, "find_desired_pixel_range", kernelpixelrange,
+	    NUMPOINTS);
+  runkernel(&bp, &bd, "footprint", kernelfootprint, NUMPOINTS);
+  runkernel(&bp, &bd, "wcss2p_single", kernelwcss2psingle, NUMPOINTS);
+  runkernel(&bp, &bd, "wcss2p_batch", kernelwcss2pbatch, NUMPOINTS);
+  runkernel(&bp, &bd, "prepare_fitswcs", kernelprepwcs, 1);
+  runkernel(&bp, &bd, "prepare_fitswcs_trim", kernelprepwcstrim, 1);
+  runkernel(&bp, &bd, "read_subset", kernelreadsubset, 1);
+  runkernel(&bp, &bd, "raw_copy", kernelrawcopy, 1);
+  runkernel(&bp, &bd, "multiplyweight", kernelweight, 1);
+  runkernel(&bp, &bd, "pixpaste_short_float", kernelpixpaste, 1);
+  runkernel(&bp, &bd, "pixdatasum_float", kerneldatasum, 1);
+  runkernel(&bp, &bd, "create_file", kernelnoheader, 1);
+  runkernel(&bp, &bd, "create_file_addheaderinfo", kerneladdheader, 1);
+  runkernel(&bp, &bd, "create_file_hdrtemplate", kernelhdrtemplate, 1);
+  runkernel(&bp, &bd, "readasciitable", kernelreadcatalog, BENCHCATROWS);
+
+  freebenchdata(&bd);
+  return bd.sink==0.12345 ? 1 : 0; /* So `sink` is always used. */
+}
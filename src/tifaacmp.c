@@ -0,0 +1,307 @@
+/*********************************************************************
+tifaacmp - Check if two thumbnails made by tifaa are identical.
+A simple set of functions to crop thumbnails from astronomical archives.
+
+Copyright (C) 2013-2014 Mohammad Akhlaghi
+Tohoku University Astronomical Institute, Sendai, Japan.
+http://astr.tohoku.ac.jp/~akhlaghi/
+
+tifaa is free software: you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation, either version 3 of the License, or
+(at your option) any later version.
+
+tifaa is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with tifaa.  If not, see <http://www.gnu.org/licenses/>.
+**********************************************************************/
+#include <stdio.h>
+#include <stdlib.h>
+#include <assert.h>
+#include <string.h>
+
+#include <fitsio.h>
+
+/* Header cards starting with these are not compared: the time the
+   thumbnail was made and the checksum, which includes the time. Only
+   the value of DATASUM is compared (CFITSIO puts the time in its
+   comment), see comparedatasum(). */
+#define TIMESTAMPCOMMENT  "COMMENT Created with TIFAA"
+#define CHECKSUMKEY       "CHECKSUM"
+#define DATASUMKEY        "DATASUM "
+
+
+
+
+
+/* Read all the header cards of the current HDU except those that
+   are not compared, the output is an array of `*nkeys` 80 character
+   cards (without the trailing '\0'). */
+char *
+readcards(fitsfile *fptr, int *nkeys, int *status)
+{
+  char *cards;
+  int i, n, more;
+  char card[FLEN_CARD];
+
+  fits_get_hdrspace(fptr, &n, &more, status);
+  assert( (cards=malloc(n*80+1))!=NULL );
+  *nkeys=0;
+  for(i=1;i<=n;++i)
+    {
+      fits_read_record(fptr, i, card, status);
+      if( !strncmp(card, TIMESTAMPCOMMENT, strlen(TIMESTAMPCOMMENT))
+	  || !strncmp(card, CHECKSUMKEY, strlen(CHECKSUMKEY))
+	  || !strncmp(card, DATASUMKEY, strlen(DATASUMKEY)) )
+	continue;
+      sprintf(&cards[*nkeys*80], "%-80s", card);
+      ++*nkeys;
+    }
+  return cards;
+}
+
+
+
+
+
+/* Compare the header cards. Since the WCS is written in the header
+   by addheaderinfo(), all the cards (not only the WCS keywords) are
+   compared so any change in formatting is also caught. */
+int
+compareheaders(fitsfile *a, fitsfile *b, char *name, int *status)
+{
+  char *ca, *cb;
+  int i, na, nb, ndiff=0;
+
+  ca=readcards(a, &na, status);
+  cb=readcards(b, &nb, status);
+
+  for(i=0;i<na || i<nb;++i)
+    if(i>=na || i>=nb || strncmp(&ca[i*80], &cb[i*80], 80))
+      {
+	if(ndiff++==0)
+	  printf("%s: header differs:\n", name);
+	printf("  card %d\n    < %.80s\n    > %.80s\n", i+1,
+	       i<na ? &ca[i*80] : "(none)", i<nb ? &cb[i*80] : "(none)");
+      }
+
+  free(ca);
+  free(cb);
+  return ndiff;
+}
+
+
+
+
+
+/* Compare the values of DATASUM (both files must have it or not).
+   When the new file has CHECKSUM, it must be the checksum of its HDU
+   and DATASUM that of its data, so a CHECKSUM that TIFAA found
+   without reading the thumbnail again (`-C`) is the same as that of
+   fits_write_chksum(). */
+int
+comparedatasum(fitsfile *a, fitsfile *b, char *name, int *status)
+{
+  int i, has[2], dataok, hduok;
+  char sum[2][FLEN_VALUE];
+  fitsfile *f[2]={a, b};
+
+  if(*status) return 1;
+  for(i=0;i<2;++i)
+    {
+      fits_read_key(f[i], TSTRING, "DATASUM", sum[i], NULL, status);
+      has[i] = *status!=KEY_NO_EXIST;
+      if(*status==KEY_NO_EXIST) *status=0;
+    }
+  if(has[0]!=has[1] || (has[0] && strcmp(sum[0], sum[1])))
+    {
+      printf("%s: DATASUM differs (%s, %s).\n", name,
+	     has[0] ? sum[0] : "none", has[1] ? sum[1] : "none");
+      return 1;
+    }
+
+  fits_read_key(b, TSTRING, "CHECKSUM", sum[1], NULL, status);
+  if(*status==KEY_NO_EXIST)
+    {
+      *status=0;
+      return 0;
+    }
+  fits_verify_chksum(b, &dataok, &hduok, status);
+  if(*status) return 1;
+  if(dataok!=1 || hduok!=1)
+    {
+      printf("%s: CHECKSUM or DATASUM doesn't match the HDU.\n", name);
+      return 1;
+    }
+  return 0;
+}
+
+
+
+
+
+/* Split `stream` (the thumbnails streamed with `-O`) into the files
+   that TIFAA would have written in `dir` (ending with `/`): `ID.fits`
+   or, with several bands, `ID_BAND.fits`. */
+int
+splitstream(char *stream, char *dir)
+{
+  FILE *in, *out;
+  char *buf=NULL, name[5000];
+  size_t id, band, bytes, maxband=0, size=0;
+
+  if( (in=fopen(stream, "r"))==NULL )
+    {
+      printf("%s: can't be opened.\n", stream);
+      return EXIT_FAILURE;
+    }
+
+  /* The number of bands, then the thumbnails. */
+  while(fscanf(in, "TIFAA %lu %lu %lu\n", &id, &band, &bytes)==3)
+    {
+      if(band>maxband) maxband=band;
+      if(fseek(in, bytes, SEEK_CUR)) break;
+    }
+  rewind(in);
+  while(fscanf(in, "TIFAA %lu %lu %lu\n", &id, &band, &bytes)==3)
+    {
+      if(bytes>size)
+	assert( (buf=realloc(buf, size=bytes))!=NULL );
+      if(fread(buf, 1, bytes, in)!=bytes)
+	{
+	  printf("%s: thumbnail %lu is incomplete.\n", stream, id);
+	  return EXIT_FAILURE;
+	}
+      if(maxband>1) sprintf(name, "%s%lu_%lu.fits", dir, id, band);
+      else          sprintf(name, "%s%lu.fits", dir, id);
+      assert( (out=fopen(name, "w"))!=NULL );
+      assert( fwrite(buf, 1, bytes, out)==bytes );
+      fclose(out);
+    }
+  if(!feof(in) && fgetc(in)!=EOF)
+    {
+      printf("%s: not a TIFAA stream.\n", stream);
+      return EXIT_FAILURE;
+    }
+
+  free(buf);
+  fclose(in);
+  return EXIT_SUCCESS;
+}
+
+
+
+
+
+/* Compare the raw bytes of the pixels. The scaling is turned off so
+   integer images are compared as they are stored. */
+int
+comparepixels(fitsfile *a, fitsfile *b, char *name, int *status)
+{
+  size_t i, n;
+  int bitpix[2], naxis[2], datatype, bytes, anynul;
+  long naxes[2][9]={{1,1,1,1,1,1,1,1,1},{1,1,1,1,1,1,1,1,1}};
+  unsigned char *pa, *pb;
+
+  fits_get_img_type(a, &bitpix[0], status);
+  fits_get_img_type(b, &bitpix[1], status);
+  fits_read_key(a, TINT, "NAXIS", &naxis[0], NULL, status);
+  fits_read_key(b, TINT, "NAXIS", &naxis[1], NULL, status);
+  if(*status) return 1;
+  if(bitpix[0]!=bitpix[1] || naxis[0]!=naxis[1] || naxis[0]>9)
+    {
+      printf("%s: BITPIX or NAXIS differ.\n", name);
+      return 1;
+    }
+  fits_get_img_size(a, naxis[0], naxes[0], status);
+  fits_get_img_size(b, naxis[1], naxes[1], status);
+  for(n=1,i=0;i<(size_t)naxis[0];++i)
+    {
+      if(naxes[0][i]!=naxes[1][i])
+	{
+	  printf("%s: NAXIS%lu differs.\n", name, i+1);
+	  return 1;
+	}
+      n*=naxes[0][i];
+    }
+  if(naxis[0]==0) return 0;
+
+  switch(bitpix[0])
+    {
+    case BYTE_IMG:     datatype=TBYTE;     bytes=1; break;
+    case SHORT_IMG:    datatype=TSHORT;    bytes=2; break;
+    case LONG_IMG:     datatype=TINT;      bytes=4; break;
+    case LONGLONG_IMG: datatype=TLONGLONG; bytes=8; break;
+    case FLOAT_IMG:    datatype=TFLOAT;    bytes=4; break;
+    default:           datatype=TDOUBLE;   bytes=8;
+    }
+  assert( (pa=malloc(n*bytes))!=NULL );
+  assert( (pb=malloc(n*bytes))!=NULL );
+  fits_set_bscale(a, 1.0f, 0.0f, status);
+  fits_set_bscale(b, 1.0f, 0.0f, status);
+  fits_read_img(a, datatype, 1, n, NULL, pa, &anynul, status);
+  fits_read_img(b, datatype, 1, n, NULL, pb, &anynul, status);
+
+  for(i=0;i<n;++i)
+    if(memcmp(&pa[i*bytes], &pb[i*bytes], bytes))
+      break;
+  if(i<n)
+    printf("%s: pixels differ, first at pixel %lu (counting from 1).\n",
+	   name, i+1);
+
+  free(pa);
+  free(pb);
+  return i<n;
+}
+
+
+
+
+
+int
+main(int argc, char *argv[])
+{
+  fitsfile *a, *b;
+  int status=0, ndiff;
+
+  if(argc==4 && strcmp(argv[1], "-s")==0)
+    return splitstream(argv[2], argv[3]);
+  if(argc!=3)
+    {
+      printf("Usage: tifaacmp GOLDEN.fits NEW.fits\n"
+	     "Exits with 0 only if the pixels (bit by bit) and header\n"
+	     "cards of the two files are identical. The comment with the\n"
+	     "time of creation and the CHECKSUM keyword are ignored, only\n"
+	     "the value of DATASUM is compared and, if NEW.fits has\n"
+	     "CHECKSUM, it must match its HDU.\n\n"
+	     "       tifaacmp -s STREAM DIR/\n"
+	     "Split the thumbnails streamed by `tifaa -O STREAM` into the\n"
+	     "files `tifaa` would have written in DIR/.\n");
+      return EXIT_FAILURE;
+    }
+
+  fits_open_image(&a, argv[1], READONLY, &status);
+  fits_open_image(&b, argv[2], READONLY, &status);
+  if(status)
+    {
+      fits_report_error(stderr, status);
+      return EXIT_FAILURE;
+    }
+
+  ndiff  = compareheaders(a, b, argv[2], &status);
+  ndiff += comparedatasum(a, b, argv[2], &status);
+  ndiff += comparepixels(a, b, argv[2], &status);
+
+  fits_close_file(a, &status);
+  fits_close_file(b, &status);
+  if(status)
+    {
+      fits_report_error(stderr, status);
+      return EXIT_FAILURE;
+    }
+  return ndiff ? EXIT_FAILURE : EXIT_SUCCESS;
+}
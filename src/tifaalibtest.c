@@ -0,0 +1,169 @@
+/*********************************************************************
+tifaalibtest - Test of the TIFAA library on a synthetic survey.
+A simple set of functions to crop thumbnails from astronomical archives.
+
+Copyright (C) 2013-2014 Mohammad Akhlaghi
+Tohoku University Astronomical Institute, Sendai, Japan.
+http://astr.tohoku.ac.jp/~akhlaghi/
+
+tifaa is free software: you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation, either version 3 of the License, or
+(at your option) any later version.
+
+tifaa is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with tifaa.  If not, see <http://www.gnu.org/licenses/>.
+**********************************************************************/
+#include <stdio.h>
+#include <stdlib.h>
+#include <assert.h>
+
+#include <fitsio.h>
+#include <wcslib/wcs.h>
+#include <wcslib/wcshdr.h>
+
+#include "libtifaa.h"
+
+#define RES        0.2   /* Resolution of the survey (mksurvey -a).  */
+#define PSSIZE     20.0  /* Size of the thumbnails (arcseconds).     */
+#define NPROBES    5     /* Targets checked on each image.           */
+
+
+
+
+
+/* Put the RA and Dec of `NPROBES` targets of image `name` in `ra`
+   and `dec`: its center and just outside each of its sides, where
+   the thumbnail (of `side` pixels) is in the half pixel margin of
+   the footprint test, but doesn't have any pixel of the image. */
+int
+probes(char *name, size_t side, double *ra, double *dec)
+{
+  fitsfile *fptr;
+  char *header;
+  long naxes[2];
+  struct wcsprm *wcs;
+  int i, nkeys, nwcs, nreject=0, status=0, stat[NPROBES];
+  double hw=side/2, n1, n2, phi[NPROBES], theta[NPROBES];
+  double pixcrd[2*NPROBES], imgcrd[2*NPROBES], world[2*NPROBES];
+
+  fits_open_image(&fptr, name, READONLY, &status);
+  fits_get_img_size(fptr, 2, naxes, &status);
+  fits_hdr2str(fptr, 1, NULL, 0, &header, &nkeys, &status);
+  fits_close_file(fptr, &status);
+  if(status)
+    {
+      fits_report_error(stderr, status);
+      return 1;
+    }
+  if( wcspih(header, nkeys, WCSHDR_all, 0, &nreject, &nwcs, &wcs)
+      || wcsset(wcs) )
+    {
+      printf("%s: WCS can't be read.\n", name);
+      return 1;
+    }
+  free(header);
+
+  /* The pixel of the target is rounded (find_desired_pixel_range()),
+     so 0.3 pixels more than the half width is outside the image. */
+  n1=naxes[0]; n2=naxes[1];
+  pixcrd[0]=n1/2;        pixcrd[1]=n2/2;
+  pixcrd[2]=-hw-0.3;     pixcrd[3]=n2/2;
+  pixcrd[4]=n1+hw+1.3;   pixcrd[5]=n2/2;
+  pixcrd[6]=n1/2;        pixcrd[7]=-hw-0.3;
+  pixcrd[8]=n1/2;        pixcrd[9]=n2+hw+1.3;
+  if( wcsp2s(wcs, NPROBES, 2, pixcrd, imgcrd, phi, theta, world, stat) )
+    {
+      printf("%s: wcsp2s failed.\n", name);
+      wcsvfree(&nwcs, &wcs);
+      return 1;
+    }
+  for(i=0;i<NPROBES;++i)
+    {
+      ra[i]=world[2*i];
+      dec[i]=world[2*i+1];
+    }
+  wcsvfree(&nwcs, &wcs);
+  return 0;
+}
+
+
+
+
+
+/* Crop the probes of every image with tifaacrop() and check that
+   the information of each thumbnail is consistent: a thumbnail
+   without any image is TIFAA_NOTINFIELD (and the opposite), the
+   others have the index of the image the WCS comes from. The center
+   of each image must be covered and the outer sides of the survey
+   must give at least one TIFAA_NOTINFIELD. */
+int
+main(int argc, char *argv[])
+{
+  float *out;
+  size_t i, j, n, side, badimg, notinfield=0;
+  int err, fail=0;
+  double *ra, *dec;
+  struct tifaasurvey *s;
+  struct tifaacropinfo *info, *in;
+
+  if(argc<2)
+    {
+      printf("Usage: tifaalibtest IMAGE.fits ...\n"
+	     "Exits with 0 only if the TIFAA library gives consistent\n"
+	     "results for targets on and just outside the images of a\n"
+	     "survey made by `mksurvey -a 0.2`.\n");
+      return EXIT_FAILURE;
+    }
+
+  n=argc-1;
+  if( (err=tifaaopen(&s, argv+1, NULL, n, RES, 1, &badimg)) )
+    {
+      printf("%s: %s\n", argv[1+badimg], tifaastrerror(err));
+      return EXIT_FAILURE;
+    }
+  side=tifaacropside(s, PSSIZE);
+  assert( (ra=malloc(n*NPROBES*sizeof *ra))!=NULL );
+  assert( (dec=malloc(n*NPROBES*sizeof *dec))!=NULL );
+  assert( (info=malloc(n*NPROBES*sizeof *info))!=NULL );
+  assert( (out=malloc(n*NPROBES*side*side*sizeof *out))!=NULL );
+  for(i=0;i<n;++i)
+    if(probes(argv[1+i], side, &ra[i*NPROBES], &dec[i*NPROBES]))
+      return EXIT_FAILURE;
+
+  if( (err=tifaacrop(s, n*NPROBES, ra, dec, PSSIZE, 0, 3, out, info)) )
+    {
+      printf("tifaacrop: %s\n", tifaastrerror(err));
+      return EXIT_FAILURE;
+    }
+
+  for(i=0;i<n;++i)
+    for(j=0;j<NPROBES;++j)
+      {
+	in=&info[i*NPROBES+j];
+	if( (in->flag==TIFAA_NOTINFIELD) != (in->numimg==0)
+	    || (in->numimg && in->firstimg>=n)
+	    || (j==0 && in->flag==TIFAA_NOTINFIELD) )
+	  {
+	    printf("%s: target %lu: flag %d with %lu image(s), first "
+		   "image %ld.\n", argv[1+i], j, in->flag, in->numimg,
+		   (long)in->firstimg);
+	    fail=1;
+	  }
+	notinfield += in->flag==TIFAA_NOTINFIELD;
+      }
+  if(notinfield==0)
+    {
+      printf("No target outside the survey is TIFAA_NOTINFIELD.\n");
+      fail=1;
+    }
+
+  tifaaclose(s);
+  free(ra); free(dec); free(info); free(out);
+  return fail ? EXIT_FAILURE : EXIT_SUCCESS;
+}
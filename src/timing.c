@@ -46,3 +46,33 @@ reporttiming(struct timeval *t1, char *jobname, size_t level)
     printf("  ---- %s\n", jobname);
 }
 
+
+
+
+
+
+/* Time between t1 and t2 in milliseconds. */
+double
+msecdiff(struct timeval *t1, struct timeval *t2)
+{
+  return ( ((double)t2->tv_sec-(double)t1->tv_sec)*1e3 +
+	   ((double)t2->tv_usec-(double)t1->tv_usec)/1e3 );
+}
+
+
+
+
+
+/* Time since `t` in milliseconds, `t` is then set to the current
+   time so the next call gives the time of the next step. */
+double
+mseclap(struct timeval *t)
+{
+  double dt;
+  struct timeval t2;
+
+  gettimeofday(&t2, NULL);
+  dt=msecdiff(t, &t2);
+  *t=t2;
+  return dt;
+}
@@ -27,4 +27,10 @@ along with timing. If not, see <http://www.gnu.org/licenses/>.
 void
 reporttiming(struct timeval *t1, char *jobname, size_t level);
 
+double
+msecdiff(struct timeval *t1, struct timeval *t2);
+
+double
+mseclap(struct timeval *t);
+
 #endif
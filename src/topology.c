@@ -0,0 +1,166 @@
+/*********************************************************************
+tifaa - Thumbnail images from astronomical archives
+A simple set of functions to crop thumbnails from astronomical archives.
+
+Copyright (C) 2013-2014 Mohammad Akhlaghi
+Tohoku University Astronomical Institute, Sendai, Japan.
+http://astr.tohoku.ac.jp/~akhlaghi/
+
+tifaa is free software: you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation, either version 3 of the License, or
+(at your option) any later version.
+
+tifaa is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with tifaa.  If not, see <http://www.gnu.org/licenses/>.
+**********************************************************************/
+#define _GNU_SOURCE
+#include <stdio.h>
+#include <sched.h>
+#include <assert.h>
+#include <stdlib.h>
+#include <string.h>
+#include <dirent.h>
+#include <pthread.h>
+
+#include "topology.h"
+
+#define NODEDIR "/sys/devices/system/node/"
+
+
+
+
+
+/* Add the CPUs in the `cpulist` file `name` (for example `0-7,16-23`)
+   that are also in `allowed` to `t`. */
+void
+topologyaddnode(struct topology *t, char *name, cpu_set_t *allowed)
+{
+  FILE *fp;
+  int a, b, c, n=0;
+
+  if( (fp=fopen(name, "r"))==NULL ) return;
+  while(fscanf(fp, "%d", &a)==1)
+    {
+      b=a;
+      if( (c=fgetc(fp))=='-' )
+	{
+	  if(fscanf(fp, "%d", &b)!=1) break;
+	  c=fgetc(fp);
+	}
+      for(;a<=b;++a)
+	if(a<CPU_SETSIZE && CPU_ISSET(a, allowed))
+	  {
+	    t->cpus[t->ncpus++]=a;
+	    ++n;
+	  }
+      if(c!=',') break;
+    }
+  fclose(fp);
+
+  if(n)
+    t->nodestart[++t->nnodes]=t->ncpus;
+}
+
+
+
+
+
+/* Fill `t` with the CPUs this process is allowed to use (see
+   sched_getaffinity(), so `taskset` and cgroups are followed) on each
+   NUMA node. */
+void
+topologyread(struct topology *t)
+{
+  DIR *d;
+  int c, maxnode=-1, node;
+  cpu_set_t allowed;
+  struct dirent *e;
+  char name[sizeof NODEDIR+64];
+
+  CPU_ZERO(&allowed);
+  assert( sched_getaffinity(0, sizeof allowed, &allowed)==0 );
+  assert( (t->cpus=malloc(CPU_SETSIZE*sizeof *t->cpus))!=NULL );
+  assert( (t->nodestart=malloc((CPU_SETSIZE+1)*sizeof *t->nodestart))
+	  !=NULL );
+  t->nnodes=t->ncpus=0;
+  t->nodestart[0]=0;
+
+  /* The largest node number. */
+  if( (d=opendir(NODEDIR)) )
+    {
+      while( (e=readdir(d)) )
+	if(sscanf(e->d_name, "node%d", &node)==1 && node>maxnode)
+	  maxnode=node;
+      closedir(d);
+    }
+
+  /* The CPUs of each node (in the order of the nodes). */
+  for(node=0;node<=maxnode && node<CPU_SETSIZE;++node)
+    {
+      sprintf(name, "%snode%d/cpulist", NODEDIR, node);
+      topologyaddnode(t, name, &allowed);
+    }
+
+  /* Without NUMA information, all the CPUs are one node. */
+  if(t->ncpus==0)
+    {
+      for(c=0;c<CPU_SETSIZE;++c)
+	if(CPU_ISSET(c, &allowed))
+	  t->cpus[t->ncpus++]=c;
+      t->nodestart[t->nnodes=1]=t->ncpus;
+    }
+}
+
+
+
+
+
+/* The CPU for thread `i` (counting from 0) of `nt` threads. The
+   threads are divided between the nodes in contiguous groups (so
+   neighboring threads are on the same node) and in each node they
+   go over its CPUs. The node is put in `node`. */
+int
+topologycpu(struct topology *t, size_t i, size_t nt, size_t *node)
+{
+  size_t n=i*t->nnodes/nt, first, ncpus;
+
+  /* The first thread on node `n`. */
+  first=(n*nt+t->nnodes-1)/t->nnodes;
+  ncpus=t->nodestart[n+1]-t->nodestart[n];
+  if(node) *node=n;
+  return t->cpus[ t->nodestart[n] + (i-first)%ncpus ];
+}
+
+
+
+
+
+/* Only run the calling thread on `cpu`. Memory it touches for the
+   first time after this is then (by the kernel's default policy)
+   taken from the node of that CPU. */
+void
+topologypin(int cpu)
+{
+  cpu_set_t set;
+
+  CPU_ZERO(&set);
+  CPU_SET(cpu, &set);
+  pthread_setaffinity_np(pthread_self(), sizeof set, &set);
+}
+
+
+
+
+
+void
+topologyfree(struct topology *t)
+{
+  free(t->cpus);
+  free(t->nodestart);
+}
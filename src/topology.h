@@ -0,0 +1,51 @@
+/*********************************************************************
+tifaa - Thumbnail images from astronomical archives
+A simple set of functions to crop thumbnails from astronomical archives.
+
+Copyright (C) 2013-2014 Mohammad Akhlaghi
+Tohoku University Astronomical Institute, Sendai, Japan.
+http://astr.tohoku.ac.jp/~akhlaghi/
+
+tifaa is free software: you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation, either version 3 of the License, or
+(at your option) any later version.
+
+tifaa is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with tifaa.  If not, see <http://www.gnu.org/licenses/>.
+**********************************************************************/
+#ifndef TOPOLOGY_H
+#define TOPOLOGY_H
+
+#include <stddef.h>
+
+/* The CPUs that this process may use, grouped by their NUMA node
+   (socket). Found from /sys/devices/system/node/, without it all the
+   CPUs are one node. */
+struct topology
+{
+  size_t        nnodes;  /* Number of nodes with usable CPUs.          */
+  size_t         ncpus;  /* Number of usable CPUs.                     */
+  int            *cpus;  /* The CPUs of all nodes, node by node.       */
+  size_t    *nodestart;  /* CPUs of node `n`: from cpus[nodestart[n]]  */
+                         /* until cpus[nodestart[n+1]-1].              */
+};
+
+void
+topologyread(struct topology *t);
+
+int
+topologycpu(struct topology *t, size_t i, size_t nt, size_t *node);
+
+void
+topologypin(int cpu);
+
+void
+topologyfree(struct topology *t);
+
+#endif
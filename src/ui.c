@@ -24,11 +24,18 @@ along with tifaa.  If not, see <http://www.gnu.org/licenses/>.
 #include <stdlib.h>
 #include <dirent.h>
 #include <string.h>
+#include <signal.h>
 #include <unistd.h>
 #include <assert.h>
 
 #include "attaavv.h"
 #include "tifaa.h"
+#include "fitsfz.h"
+#include "blockcache.h"
+#include "walker.h"
+#include "surveyimginfo.h"
+#include "survey.h"
+#include "manifest.h"
 #include "ui.h"
 
 
@@ -90,7 +97,29 @@ printhelp(struct tifaaparams *p)
 	 "########### By default these are off.\n"
 	 " -e:\n\tVerbose mode, reporting every step.\n\n"
 
-	 " -g:\n\tDelete existing postage stamp folder (if exists).\n\n");
+	 " -g:\n\tDelete existing postage stamp folder (if exists).\n\n"
+
+	 " -n:\n\tPin each thread to a CPU, the threads are divided between\n"
+	 "\tthe NUMA nodes (sockets) and each thread gets the targets of\n"
+	 "\ta group of survey images, so the images and the buffers of\n"
+	 "\ta thread are used on one node.\n\n"
+
+	 " -l:\n\tKeep the thumbnails in subdirectories of the output\n"
+	 "\tdirectory, with at most %d entries in each directory (for\n"
+	 "\texample `PS/000/012/12345.fits`). The path of each\n"
+	 "\tthumbnail is in `tifaalog.txt`.\n\n"
+
+	 " -x:\n\tOnly plan the crops: find the images of every target,\n"
+	 "\treport the targets in the field (in one image or stitched),\n"
+	 "\tthe images and pixels that would be read and the number of\n"
+	 "\timages of each target, without reading any pixels. With\n"
+	 "\t`-X`, the plan is also written.\n\n"
+
+	 " -C:\n\tWrite the CHECKSUM and DATASUM keywords in every\n"
+	 "\tthumbnail. The data sum is found from the pixels before they\n"
+	 "\tare written, so the thumbnails aren't read again (except\n"
+	 "\twith `-T input` for integer or 64-bit survey images).\n\n",
+	 SHARDSIZE);
 
 
   printf("\n########### Mandatory options with arguments:\n"
@@ -109,7 +138,13 @@ printhelp(struct tifaaparams *p)
 	 "\t`/SURVEY/` and all your survey images end in `sci.fits`\n"
 	 "\tthen the value for this option would be: `/SURVEY/\\*sci.fits`.\n"
 	 "\tNote that there should be a backslash (`\\`) before the `*` so the\n"
-	 "\tshell doesn't expand it before TIFAA sees it.\n\n");
+	 "\tshell doesn't expand it before TIFAA sees it.\n"
+	 "\tGive `-s` once for each band (at most %d) to crop several\n"
+	 "\tbands with identical pixel grids in one run. The WCS, the\n"
+	 "\timages of each target and the pixel ranges are found with\n"
+	 "\tthe first band and used for all. The thumbnail of target ID\n"
+	 "\tin band B (counting from 1) is then `ID_B` (with `-f`).\n\n",
+	 MAXBANDS);
 
 
   printf("\n########### Optional options with arguments:\n"
@@ -118,7 +153,8 @@ printhelp(struct tifaaparams *p)
 	 "\tthen TIFAA will multiply the cropped regions from the\n"
 	 "\timages in this wildcard to those provided in `-s`. If you want\n"
 	 "\ta crop of the weight images only, give their wild card\n"
-	 "\trepresentation to `-s` alone.\n\n"
+	 "\trepresentation to `-s` alone. With several bands, give\n"
+	 "\tone `-w` for each `-s` (in the same order).\n\n"
 
 	 "-t INTEGER:\n\tDEFAULT: %lu\n"
 	 "\tThe number of threads you want TIFAA to use. Unfortunately,\n"
@@ -150,6 +186,75 @@ printhelp(struct tifaaparams *p)
 	 "\tsuch regions. If so, you can specify a check size in the\n"
 	 "\tcentral pixels of each postage stamp to see if it is blank or\n"
          "\tnot.\n\n", p->numthrd, p->out_name, p->out_ext, p->chk_size);
+
+  printf("-S INTEGER:\n"
+	 "\tScaling study: Instead of cropping all the targets, crop the\n"
+	 "\tfirst INTEGER targets that are in the field with 1, 2, 4, ...\n"
+	 "\tthreads until the value of `-t`. Once with the same targets\n"
+	 "\tfor all the threads (strong scaling) and once with a number\n"
+	 "\tof targets proportional to the number of threads (weak\n"
+	 "\tscaling). The speedup, efficiency and time spent in each step\n"
+	 "\tare printed and saved in `tifaascaling.txt` in the output\n"
+	 "\tfolder. The thumbnails are not kept.\n\n"
+
+	 "-P INTEGER:\n"
+	 "\tColumn of the size of each target's thumbnail (in\n"
+	 "\tarcseconds, counting from 0). Each thumbnail then has its\n"
+	 "\town size and only the images it overlaps are used. For rows\n"
+	 "\twhere this value isn't positive, `-p` is used.\n\n"
+
+	 "-m INTEGER:\n\tDEFAULT: %lu\n"
+	 "\tMegabytes of memory for the cache of survey image blocks\n"
+	 "\t(of %dx%d pixels). All the threads share the cache, so when\n"
+	 "\ttargets are close to each other, the pixels they share are\n"
+	 "\tonly read (and decompressed) once. `0`: no cache, the\n"
+	 "\tpixels of uncompressed images are then read in their own\n"
+	 "\ttype (not converted to floats by CFITSIO).\n\n"
+
+	 "-D STRING:\n"
+	 "\tRun as a server listening on the Unix socket STRING. The\n"
+	 "\tsurvey images are only read once and kept open, `-c`, `-r`\n"
+	 "\tand `-d` are not needed. Each line sent by a client is one\n"
+	 "\trequest: `RA DEC [SIZE] [name=NAME] [weight=0|1] [send]`.\n"
+	 "\tSIZE is in arcseconds (default: `-p`), NAME is the name of\n"
+	 "\tthe thumbnail in `-o` and with `send` the thumbnail is sent\n"
+	 "\tback and not kept. The reply is one line: `STATUS LATENCY\n"
+	 "\tNUMIMG PATH` (STATUS: OK, NOTINFIELD, BLANK or ERROR, LATENCY\n"
+	 "\tin milliseconds, with `send` PATH is the number of bytes\n"
+	 "\tthat follow). A `STOP` line stops the server.\n\n"
+
+	 "-M STRING:\n"
+	 "\tManifest of the images of the first band, instead of `-s`\n"
+	 "\t(every `-s` is then another band). Each line is one image:\n"
+	 "\t`PATH WEIGHT HDU [FOOTPRINT]`. WEIGHT is its weight image\n"
+	 "\t(`-` for none, for all the images or none), HDU counts from\n"
+	 "\t0 (`-`: the first image; `HDU,WHDU` if the weight is in\n"
+	 "\tanother HDU than the image) and FOOTPRINT is the %d values of\n"
+	 "\tits footprint (center RA and Dec, radius, pixel scale in\n"
+	 "\tdegrees and %d vertices). Only the images without a\n"
+	 "\tfootprint have their WCS read (the others are only\n"
+	 "\tindexed for the Rice decoder).\n\n"
+
+	 "-X STRING:\n"
+	 "\tPlan file. With `-x` the plan is written in it, otherwise\n"
+	 "\tthe targets are cropped with the images in it (the survey\n"
+	 "\tand the catalog have to be the same as when it was made), so\n"
+	 "\tthe survey's WCS isn't read again.\n\n"
+
+	 "-O STRING:\n"
+	 "\tStream the thumbnails into this file or named pipe (`-`:\n"
+	 "\tthe standard output, the messages then go to the standard\n"
+	 "\terror) instead of writing them in `-o`. Each thumbnail is\n"
+	 "\tits FITS file (with the WCS) after a line of `TIFAA ID BAND\n"
+	 "\tBYTES`.\n\n"
+
+	 "-T STRING:\n\tDEFAULT: `float`\n"
+	 "\tType of the thumbnails: `float` (32-bit floating point),\n"
+	 "\t`input` (the BITPIX, BSCALE and BZERO of the first survey\n"
+	 "\timage of each target) or `short` (16-bit integers, the\n"
+	 "\trange of each thumbnail is kept with its own BSCALE and\n"
+	 "\tBZERO, blank pixels are BLANK).\n\n",
+	 p->cachemb, BC_SIDE, BC_SIDE, NUM_IMAGEINFO_COLS, FP_VERTICES);
 }
 
 
@@ -179,21 +284,21 @@ checkifparamtersset(struct tifaaparams *p, struct uiparams *up)
 {
   int numargmissing=0;
 
-  if(up->cat_name == DEFAULTPOINTER)
+  if(up->cat_name == DEFAULTPOINTER && p->socket_name==NULL)
     { 
       if(numargmissing==0)
 	{printversioninfo(); printf("Option(s) not set:\n");}
       printf("\t`-c` (catalog name).\n"); 
       ++numargmissing; 
     }
-  if(p->ra_col == DEFAULTINDEX)
+  if(p->ra_col == DEFAULTINDEX && up->cat_name != DEFAULTPOINTER)
     { 
       if(numargmissing==0)
 	{printversioninfo(); printf("Option(s) not set:\n");}
       printf("\t`-r` (RA column).\n"); 
       ++numargmissing; 
     }
-  if(p->dec_col == DEFAULTINDEX)
+  if(p->dec_col == DEFAULTINDEX && up->cat_name != DEFAULTPOINTER)
     { 
       if(numargmissing==0)
 	{printversioninfo(); printf("Option(s) not set:\n");}
@@ -214,12 +319,20 @@ checkifparamtersset(struct tifaaparams *p, struct uiparams *up)
       printf("\t`-p` (postage stamp size) not set.\n"); 
       ++numargmissing; 
     } 
-  if(up->surv_name == DEFAULTPOINTER)
+  if(up->surv_name == DEFAULTPOINTER && up->manifest == DEFAULTPOINTER)
     { 
       if(numargmissing==0)
 	{printversioninfo(); printf("Option not set:\n");}
       printf("\t`-s` (wild card of survey images).\n"); 
       ++numargmissing; 
+    }
+  if(p->weightmultip && up->manifest == DEFAULTPOINTER
+     && up->numwbands!=p->numbands)
+    {
+      printf("\nError: %lu band(s) given with `-s` but %lu with `-w`, "
+	     "each band needs its weight images. TIFAA aborted.\n\n",
+	     p->numbands, up->numwbands);
+      exit(EXIT_FAILURE);
     } 
   if(numargmissing)
     {
@@ -241,8 +354,11 @@ checkfilesanddirectories(struct tifaaparams *p, struct uiparams *up)
   FILE *fp;
   char command[10000];
 
-  /* Check if the input catalog exists. */
-  if( ( fp=fopen(up->cat_name, "r") )==NULL)
+  /* Check if the input catalog exists (it is optional for a
+     server). */
+  if(up->cat_name == DEFAULTPOINTER)
+    ;
+  else if( ( fp=fopen(up->cat_name, "r") )==NULL)
     {
       printf("Error: Cannot open provided catalog file: %s\n\n", 
 	     up->cat_name);
@@ -251,6 +367,27 @@ checkfilesanddirectories(struct tifaaparams *p, struct uiparams *up)
   else
     fclose(fp);
 
+  /* The stream of thumbnails (`-O`). On the standard output, every
+     message is then printed on the standard error so they don't get
+     mixed with the thumbnails. A named pipe blocks until a reader
+     opens it. When the reader goes away, the writer reports EPIPE
+     (SIGPIPE would kill TIFAA without a message). */
+  if(up->stream_name == DEFAULTPOINTER)
+    p->streamfp=NULL;
+  else if(strcmp(up->stream_name, "-")==0)
+    {
+      assert( (p->streamfp=fdopen(dup(STDOUT_FILENO), "w"))!=NULL );
+      fflush(stdout);
+      dup2(STDERR_FILENO, STDOUT_FILENO);
+    }
+  else if( (p->streamfp=fopen(up->stream_name, "w"))==NULL )
+    {
+      printf("Error: Cannot open %s to stream the thumbnails.\n\n",
+	     up->stream_name);
+      exit(EXIT_FAILURE);
+    }
+  if(p->streamfp) signal(SIGPIPE, SIG_IGN);
+
   /* Check the postage stamp directory. If it is asked to delete it,
      then do so, if not, just make sure it is there and everything is
      fine. If it is not there, make it. */
@@ -277,19 +414,74 @@ checkfilesanddirectories(struct tifaaparams *p, struct uiparams *up)
 
 
 
+/* Expand the wild card of one band other than the first. Since the
+   bands are cropped with the pixel ranges of the first, there have to
+   be as many images as in the first band (in the same order). */
+void
+globband(char *wildcard, glob_t *g, struct tifaaparams *p,
+	 struct uiparams *up)
+{
+  int globout;
+
+  globout=walkglob(wildcard, p->numthrd, NULL, NULL, g, NULL);
+  if(globout)
+    {
+      printf("\n\nError in expanding the given wildcard:\n%s\n", 
+	     wildcard);
+      if (globout==GLOB_ABORTED)
+	printf("----The directory could not be opened.");
+      else if(globout==GLOB_NOMATCH)
+	printf("----There were no matches\n\n");
+      else if (globout==GLOB_NOSPACE)
+	printf("----Not enough space to allocate the names.\n\n");
+      exit(EXIT_FAILURE);
+    } 
+  if(p->survglob.gl_pathc != g->gl_pathc)
+    {
+      printf("Error: The number of wildcard matches in `%s` (%lu) and"
+	     "`%s` (%lu) are not equal. TIFAA aborted.\n\n",
+	     up->surv_name, p->survglob.gl_pathc, wildcard, g->gl_pathc);
+      exit(EXIT_FAILURE);
+    }
+}
+
+
+
+
+
 void
 readinputcatalogandimgnames(struct tifaaparams *p, struct uiparams *up)
 {
+  size_t i;
   int globout;
   struct ArrayInfo ai;
   
-  readasciitable(up->cat_name, &ai);
+  if(up->cat_name == DEFAULTPOINTER)
+    {
+      p->cat=NULL;
+      p->cs0=p->cs1=0;
+    }
+  else
+    {
+      readasciitable(up->cat_name, &ai);
+      p->cat=ai.d;
+      p->cs0=ai.s0;
+      p->cs1=ai.s1;
+      assert( (ai.d=malloc(10*sizeof *ai.d))!=NULL );
+      freeasciitable(&ai);
+      if(p->size_col!=NONINDEX && p->size_col>=p->cs1)
+	{
+	  printf("\nError: The size column (`-P`) is %lu, but `%s` only "
+		 "has %lu columns. TIFAA aborted.\n\n", p->size_col,
+		 up->cat_name, p->cs1);
+	  exit(EXIT_FAILURE);
+	}
+    }
 
-  p->cat=ai.d;
-  p->cs0=ai.s0;
-  p->cs1=ai.s1;
-  assert( (ai.d=malloc(10*sizeof *ai.d))!=NULL );
-  freeasciitable(&ai);
+  /* With `-l`, enough levels of subdirectories for all the
+     targets. */
+  if(p->shards)
+    p->shards=shardlevels(p->cs0);
 
   /* In case you want to check the read array:
   {
@@ -304,8 +496,20 @@ readinputcatalogandimgnames(struct tifaaparams *p, struct uiparams *up)
   */
 
   /* Successful result will be zero, so if it is not successful, it
-     will output a non-zero value. */
-  globout=glob(up->surv_name, 0, NULL, &p->survglob);
+     will output a non-zero value. Unless it is a server (where the
+     survey is read by tifaaopen()) or a plan is cropped (where it
+     isn't needed), the images of the first band are also read as
+     they are found. */
+  if(up->manifest)
+    {
+      readmanifest(p, up->manifest);
+      globout=0;
+    }
+  else if(p->socket_name || (p->plan_name && p->planonly==0))
+    globout=walkglob(up->surv_name, p->numthrd, NULL, NULL, &p->survglob,
+		     NULL);
+  else
+    globout=discoversurvey(p, up->surv_name);
   if(globout)
     {
       printf("\n\nError in expanding the given wildcard:\n%s\n", 
@@ -329,11 +533,22 @@ readinputcatalogandimgnames(struct tifaaparams *p, struct uiparams *up)
   */
  
 
+  /* With a manifest, its weights (if any) are the first band's and
+     every `-w` is for one of the other bands. */
+  if(up->manifest && p->weightmultip && up->numwbands!=p->numbands-1)
+    {
+      printf("\nError: %lu band(s) given with `-s` but %lu with `-w`, "
+	     "each band needs its weight images. TIFAA aborted.\n\n",
+	     p->numbands-1, up->numwbands);
+      exit(EXIT_FAILURE);
+    }
+
   /* If it is desired to multiply the weight images, get the glob
      information here. */
-  if(p->weightmultip)
+  if(p->weightmultip && up->manifest==NULL)
     {
-      globout=glob(up->wsurv_name, 0, NULL, &p->wsurvglob);
+      globout=walkglob(up->wsurv_name, p->numthrd, NULL, NULL,
+		       &p->wsurvglob, NULL);
       if(globout)
 	{
 	  printf("\n\nError in expanding the weight images wildcard:\n%s\n", 
@@ -366,6 +581,21 @@ readinputcatalogandimgnames(struct tifaaparams *p, struct uiparams *up)
 	 }    
       */
     }
+
+  /* The other bands (and their weights). */
+  if(p->numbands>1)
+    {
+      assert( (p->bandglob=malloc((p->numbands-1)
+				  *sizeof *p->bandglob))!=NULL );
+      assert( (p->wbandglob=malloc((p->numbands-1)
+				   *sizeof *p->wbandglob))!=NULL );
+      for(i=1;i<p->numbands;++i)
+	{
+	  globband(up->band_names[i-1], &p->bandglob[i-1], p, up);
+	  if(p->weightmultip)
+	    globband(up->wband_names[i-1], &p->wbandglob[i-1], p, up);
+	}
+    }
 }
 
 
@@ -375,24 +605,43 @@ readinputcatalogandimgnames(struct tifaaparams *p, struct uiparams *up)
 void
 allocateinternalarrays(struct tifaaparams *p)
 {
-  size_t numimg, *sp, *fp;
+  size_t numimg;
 
-  /* Allocate the array to keep all the image information. */
+  /* Allocate the array to keep all the image information. The
+     images of each target are kept as 32-bit integers. */
   numimg=p->survglob.gl_pathc;
-  p->imginfo=malloc(numimg*NUM_IMAGEINFO_COLS*sizeof *p->imginfo);
-  assert(p->imginfo!=NULL);
+  if(numimg>=UINT32_MAX)
+    {
+      printf("Error: %lu survey images, at most %lu can be used. "
+	     "TIFAA aborted.\n\n", numimg, (size_t)UINT32_MAX-1);
+      exit(EXIT_FAILURE);
+    }
+
+  /* The image information and the index of the compression tiles
+     of each image (and weight image) in all the bands, filled in
+     getsurveyimageinfo(). When the first band was read as it was
+     found (discoversurvey()), `imginfo` and `fzindex` already
+     exist. */
+  if(p->indexed==0)
+    {
+      p->imginfo=malloc(numimg*NUM_IMAGEINFO_COLS*sizeof *p->imginfo);
+      p->fzindex=calloc(p->numbands*numimg, sizeof *p->fzindex);
+      assert(p->imginfo!=NULL && p->fzindex!=NULL);
+    }
+  p->wfzindex=calloc(p->numbands*numimg, sizeof *p->wfzindex);
+  assert(p->wfzindex!=NULL);
 
-  /* Allocate and initialize the array to keep the image indexs that
-     are needed for every target in the catalog (so it has to have the
-     same number of rows as the catalog, but with WI_COLS columns. */
-  p->whichimg=malloc(p->cs0*WI_COLS*sizeof *p->whichimg);
-  assert(p->whichimg!=NULL);
-  fp=(sp=p->whichimg)+p->cs0*WI_COLS;
-  do *sp=NONINDEX; while(++sp<fp);
+  /* The start of the images that are needed for every target in the
+     catalog (one more than the number of targets). The images
+     themselves are only allocated when they are found (see
+     whichimageforwhichtargets()). */
+  assert( (p->wioff=calloc(p->cs0+1, sizeof *p->wioff))!=NULL );
+  p->wiimg=NULL;
+  p->wimax=0;
 
   /* Allocate space for the log table (showing the final status of
      each target's postage stamp. */
-  assert( ( p->log=calloc(p->cs0*LOG_COLS, sizeof *p->log) )!=NULL );
+  assert( ( p->log=calloc((p->cs0+1)*LOG_COLS, sizeof *p->log) )!=NULL );
 }
 
 
@@ -455,6 +704,7 @@ checkiflzero(char *optarg, int *var, int opt)
 void
 setparams(int argc, char *argv[], struct tifaaparams *p)
 {
+  size_t i;
   int c, tmp;
   char *tailptr;
   struct uiparams up;
@@ -467,9 +717,16 @@ setparams(int argc, char *argv[], struct tifaaparams *p)
   up.delpsfolder = 0;                  p->weightmultip = 0;
   p->out_name    = "./PS/";            p->out_ext      = ".fits";          
   p->chk_size    = 3;                  p->info_name    = "psinfo.txt";
-  p->numthrd     = 1;                  
-
-  while( (c=getopt(argc, argv, "hegva:c:d:f:k:m:o:p:r:s:t:w:")) 
+  p->numthrd     = 1;                  p->scalingn     = 0;
+  p->socket_name = NULL;                p->cachemb      = BC_DEFAULTMB;
+  p->numbands    = 0;                   up.numwbands    = 0;
+  p->size_col    = NONINDEX;           p->numa         = 0;
+  p->indexed     = 0;                  up.manifest     = DEFAULTPOINTER;
+  p->planonly    = 0;                  p->plan_name    = NULL;
+  p->shards      = 0;                  up.stream_name  = DEFAULTPOINTER;
+  p->outtype     = OUT_FLOAT;          p->checksum     = 0;
+
+  while( (c=getopt(argc, argv, "hegnlvxCa:c:d:f:k:m:o:p:r:s:t:w:D:M:O:P:S:T:X:")) 
 	 != -1 )
     switch(c)
       {
@@ -490,6 +747,18 @@ setparams(int argc, char *argv[], struct tifaaparams *p)
       case 'g':			/* Delete existing output folder?     */
 	up.delpsfolder=1;
 	break;
+      case 'n':			/* Pin threads on NUMA nodes.         */
+	p->numa=1;
+	break;
+      case 'x':			/* Only plan the crops.               */
+	p->planonly=1;
+	break;
+      case 'l':			/* Thumbnails in subdirectories.      */
+	p->shards=1;
+	break;
+      case 'C':			/* CHECKSUM and DATASUM keywords.     */
+	p->checksum=1;
+	break;
 
       /* Mandatory options with arguments: */
       case 'c':	                /* Input catalog name                 */
@@ -510,13 +779,33 @@ setparams(int argc, char *argv[], struct tifaaparams *p)
 	p->ps_size=strtof(optarg, &tailptr);
 	break;
       case 's':			/* Wild card of images to use.        */
-	up.surv_name=optarg;
+	if(p->numbands==MAXBANDS)
+	  {
+	    fprintf(stderr, "At most %d bands (`-s`) can be used.\n\n",
+		    MAXBANDS);
+	    exit(EXIT_FAILURE);
+	  }
+	if(p->numbands==0)
+	  up.surv_name=optarg;
+	else
+	  up.band_names[p->numbands-1]=optarg;
+	++p->numbands;
 	break;
 
       /* Optional options with arguments: */
       case 'w':			/* Wild card of weight images to use. */
+	if(up.numwbands==MAXBANDS)
+	  {
+	    fprintf(stderr, "At most %d bands (`-w`) can be used.\n\n",
+		    MAXBANDS);
+	    exit(EXIT_FAILURE);
+	  }
 	p->weightmultip=1;
-	up.wsurv_name=optarg;
+	if(up.numwbands==0)
+	  up.wsurv_name=optarg;
+	else
+	  up.wband_names[up.numwbands-1]=optarg;
+	++up.numwbands;
 	break;
       case 't':			/* Number of threads to use.          */
 	checkiflzero(optarg, &tmp, c);
@@ -532,6 +821,41 @@ setparams(int argc, char *argv[], struct tifaaparams *p)
 	checkifelzero(optarg, &tmp, c);	
 	p->chk_size=tmp;
 	break;
+      case 'D':			/* Run as a server on this socket.    */
+	p->socket_name=optarg;
+	break;
+      case 'S':			/* Scaling study on this many targets. */
+	checkiflzero(optarg, &tmp, c);
+	p->scalingn=tmp;
+	break;
+      case 'P':			/* Column of thumbnail sizes.         */
+	checkifelzero(optarg, &tmp, c);	
+	p->size_col=tmp;
+	break;
+      case 'm':			/* Memory for the block cache (MB).   */
+	checkifelzero(optarg, &tmp, c);
+	p->cachemb=tmp;
+	break;
+      case 'M':			/* Manifest of the first band.        */
+	up.manifest=optarg;
+	break;
+      case 'X':			/* Plan file (written with `-x`).     */
+	p->plan_name=optarg;
+	break;
+      case 'O':			/* Stream the thumbnails.             */
+	up.stream_name=optarg;
+	break;
+      case 'T':			/* Type of the thumbnails.            */
+	if(strcmp(optarg, "float")==0)      p->outtype=OUT_FLOAT;
+	else if(strcmp(optarg, "input")==0) p->outtype=OUT_INPUT;
+	else if(strcmp(optarg, "short")==0) p->outtype=OUT_SHORT;
+	else
+	  {
+	    fprintf(stderr, "`-T` should be `float`, `input` or `short`, "
+		    "not `%s`.\n\n", optarg);
+	    exit(EXIT_FAILURE);
+	  }
+	break;
 
 
       /* Unrecognized options: */
@@ -542,6 +866,25 @@ setparams(int argc, char *argv[], struct tifaaparams *p)
 	abort();
       }
 
+  /* With a manifest, it is the first band and every `-s` (and `-w`)
+     is one of the other bands. */
+  if(up.manifest)
+    {
+      if(p->numbands==MAXBANDS)
+	{
+	  fprintf(stderr, "At most %d bands (`-M` and `-s`) can be "
+		  "used.\n\n", MAXBANDS);
+	  exit(EXIT_FAILURE);
+	}
+      for(i=p->numbands;i>1;--i)
+	up.band_names[i-1]=up.band_names[i-2];
+      for(i=up.numwbands;i>1;--i)
+	up.wband_names[i-1]=up.wband_names[i-2];
+      if(p->numbands) up.band_names[0]=up.surv_name;
+      if(up.numwbands) up.wband_names[0]=up.wsurv_name;
+      ++p->numbands;
+    }
+
   checkifparamtersset(p, &up);
   checkfilesanddirectories(p, &up);
   readinputcatalogandimgnames(p, &up);
@@ -557,11 +900,34 @@ setparams(int argc, char *argv[], struct tifaaparams *p)
 void
 freeparams(struct tifaaparams *p)
 {
+  size_t i;
+
+  for(i=0;i<p->numbands*p->survglob.gl_pathc;++i)
+    {
+      fzfreeindex(&p->fzindex[i]);
+      fzfreeindex(&p->wfzindex[i]);
+    }
   free(p->cat);
   free(p->log);
   free(p->imginfo);
-  free(p->whichimg);
-  globfree(&p->survglob);
+  free(p->fzindex);
+  free(p->wfzindex);
+  free(p->wioff);
+  free(p->wiimg);
+  if(p->streamfp)
+    fclose(p->streamfp);
+  walkfree(&p->survglob);
   if(p->weightmultip)
-    globfree(&p->wsurvglob);
+    walkfree(&p->wsurvglob);
+  for(i=1;i<p->numbands;++i)
+    {
+      walkfree(&p->bandglob[i-1]);
+      if(p->weightmultip)
+	walkfree(&p->wbandglob[i-1]);
+    }
+  if(p->numbands>1)
+    {
+      free(p->bandglob);
+      free(p->wbandglob);
+    }
 }
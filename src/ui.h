@@ -34,6 +34,11 @@ struct uiparams
   int  delpsfolder;  /* ==0: don't. ==1: do.                           */
   char  *surv_name;  /* Wild card of survey images.                    */
   char *wsurv_name;  /* Wild card of survey weight images.             */
+  char *band_names[MAXBANDS]; /* Wild cards of the other bands.         */
+  char *wband_names[MAXBANDS]; /* Weight wild cards of other bands.     */
+  size_t numwbands;  /* Number of `-w` options.                        */
+  char   *manifest;  /* Manifest of the first band (`-M`).             */
+  char *stream_name; /* Stream of the thumbnails (`-O`).               */
 };
 
 
@@ -0,0 +1,427 @@
+/*********************************************************************
+tifaa - Thumbnail images from astronomical archives
+A simple set of functions to crop thumbnails from astronomical archives.
+
+Copyright (C) 2013-2014 Mohammad Akhlaghi
+Tohoku University Astronomical Institute, Sendai, Japan.
+http://astr.tohoku.ac.jp/~akhlaghi/
+
+tifaa is free software: you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation, either version 3 of the License, or
+(at your option) any later version.
+
+tifaa is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with tifaa.  If not, see <http://www.gnu.org/licenses/>.
+**********************************************************************/
+#include <glob.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <dirent.h>
+#include <fnmatch.h>
+#include <pthread.h>
+#include <sys/stat.h>
+
+#include "walker.h"
+
+
+
+
+
+
+
+
+
+
+
+
+
+
+
+
+
+
+
+
+/******************************************************************/
+/****************        Walker's lists        ********************/
+/******************************************************************/
+/* `name` (which is already allocated) inside `path`. */
+char *
+walkjoin(char *path, char *name)
+{
+  char *out;
+  size_t len=strlen(path);
+
+  if( (out=malloc(len+strlen(name)+2))==NULL ) return NULL;
+  if(len==0)
+    strcpy(out, name);
+  else if(path[len-1]=='/')
+    sprintf(out, "%s%s", path, name);
+  else
+    sprintf(out, "%s/%s", path, name);
+  return out;
+}
+
+
+
+
+
+void
+walknospace(struct walker *w)
+{
+  pthread_mutex_lock(&w->m);
+  w->nospace=1;
+  pthread_mutex_unlock(&w->m);
+}
+
+
+
+
+
+/* Add directory `path` (which is then owned by the walker) to be
+   read for component `comp` of the pattern. */
+void
+walkpushdir(struct walker *w, char *path, size_t comp)
+{
+  struct walkdir *tmp;
+
+  pthread_mutex_lock(&w->m);
+  if(w->ndirs==w->dirssize)
+    {
+      if( (tmp=realloc(w->dirs, 2*w->dirssize*sizeof *tmp))==NULL )
+	{
+	  w->nospace=1;
+	  pthread_mutex_unlock(&w->m);
+	  free(path);
+	  return;
+	}
+      w->dirs=tmp;
+      w->dirssize*=2;
+    }
+  w->dirs[w->ndirs].path=path;
+  w->dirs[w->ndirs++].comp=comp;
+  pthread_cond_signal(&w->c);
+  pthread_mutex_unlock(&w->m);
+}
+
+
+
+
+
+/* Keep the file `name` (which is then owned by the walker) and give
+   it to the `found` function. */
+void
+walkaddname(struct walker *w, char *name)
+{
+  size_t id;
+  struct walkname *tmp;
+
+  pthread_mutex_lock(&w->m);
+  if(w->nnames==w->namessize)
+    {
+      if( (tmp=realloc(w->names, 2*w->namessize*sizeof *tmp))==NULL )
+	{
+	  w->nospace=1;
+	  pthread_mutex_unlock(&w->m);
+	  free(name);
+	  return;
+	}
+      w->names=tmp;
+      w->namessize*=2;
+    }
+  id=w->nnames;
+  w->names[w->nnames].name=name;
+  w->names[w->nnames++].id=id;
+  pthread_mutex_unlock(&w->m);
+
+  /* Without the lock, so the other threads can continue walking. */
+  if(w->found) w->found(name, id, w->arg);
+}
+
+
+
+
+
+int
+walkcomparenames(const void *a, const void *b)
+{
+  return strcmp( ((struct walkname *)a)->name,
+		 ((struct walkname *)b)->name );
+}
+
+
+
+
+
+
+
+
+
+
+
+
+
+
+
+
+
+
+
+
+/******************************************************************/
+/****************          Walking             ********************/
+/******************************************************************/
+int
+walkhaswildcard(char *comp)
+{
+  return strpbrk(comp, "*?[\\")!=NULL;
+}
+
+
+
+
+
+/* Find the files in `path` (the walker owns it) that match component
+   `comp` (and the ones after it) of the pattern. The components
+   without wildcards don't need the directory to be read. */
+void
+walkonedir(struct walker *w, char *path, size_t comp)
+{
+  DIR *dir;
+  char *name;
+  struct stat st;
+  struct dirent *e;
+  int last, isdir;
+
+  /* Components without a wildcard are just appended. */
+  while(comp<w->ncomps && !walkhaswildcard(w->comps[comp]))
+    {
+      name=walkjoin(path, w->comps[comp]);
+      free(path);
+      if( (path=name)==NULL ) { walknospace(w); return; }
+      ++comp;
+    }
+  if(comp==w->ncomps)
+    {
+      if(stat(path, &st)==0) walkaddname(w, path);
+      else                   free(path);
+      return;
+    }
+
+  /* Like glob() (without GLOB_ERR), directories that can't be read
+     are ignored. */
+  last = comp==w->ncomps-1;
+  if( (dir=opendir(*path ? path : "."))==NULL )
+    {
+      free(path);
+      return;
+    }
+  while( (e=readdir(dir))!=NULL )
+    {
+      if(fnmatch(w->comps[comp], e->d_name, FNM_PERIOD)) continue;
+      if( (name=walkjoin(path, e->d_name))==NULL )
+	{
+	  walknospace(w);
+	  break;
+	}
+      if(last)
+	walkaddname(w, name);
+      else
+	{
+	  /* Only stat() when the directory entry doesn't say. */
+	  if(e->d_type==DT_DIR)                                isdir=1;
+	  else if(e->d_type==DT_LNK || e->d_type==DT_UNKNOWN)
+	    isdir = stat(name, &st)==0 && S_ISDIR(st.st_mode);
+	  else                                                 isdir=0;
+	  if(isdir) walkpushdir(w, name, comp+1);
+	  else      free(name);
+	}
+    }
+  closedir(dir);
+  free(path);
+}
+
+
+
+
+
+void *
+walkthread(void *inparams)
+{
+  struct walker *w=(struct walker *)inparams;
+  struct walkdir d;
+
+  pthread_mutex_lock(&w->m);
+  while(1)
+    {
+      /* Wait for a directory, the walk is finished when there is
+	 none and no thread is reading one (to add more). */
+      while(w->ndirs==0 && w->busy)
+	pthread_cond_wait(&w->c, &w->m);
+      if(w->ndirs==0) break;
+      d=w->dirs[--w->ndirs];
+      ++w->busy;
+      pthread_mutex_unlock(&w->m);
+
+      walkonedir(w, d.path, d.comp);
+
+      pthread_mutex_lock(&w->m);
+      if(--w->busy==0 && w->ndirs==0)
+	pthread_cond_broadcast(&w->c);
+    }
+
+  /* Increment the `done` counter and return. */
+  ++w->done;
+  pthread_cond_broadcast(&w->c);
+  pthread_mutex_unlock(&w->m);
+  return NULL;
+}
+
+
+
+
+
+
+
+
+
+
+
+
+
+
+
+
+
+
+
+
+/******************************************************************/
+/****************       Outside functions      ********************/
+/******************************************************************/
+/* Expand the wildcard `pattern` like glob() (the names are sorted
+   with strcmp()), but read the directories on `nt` threads. If
+   `found` isn't NULL, it is called for each file as soon as it is
+   found (on the thread that found it, possibly on several threads at
+   the same time). If `ids` isn't NULL, it is an allocated array
+   keeping the order each file of `g->gl_pathv` was found in (the `id`
+   given to `found`). The output is 0 or one of glob()'s error codes,
+   `g` has to be freed with walkfree(). */
+int
+walkglob(char *pattern, size_t nt, walkfound found, void *arg, glob_t *g,
+	 size_t **ids)
+{
+  pthread_t t;
+  char *copy, *c;
+  size_t i, numactive;
+  pthread_attr_t attr;
+  struct walker w={0};
+
+  g->gl_pathc=0;
+  g->gl_pathv=NULL;
+  g->gl_offs=0;
+  if(ids) *ids=NULL;
+  if(nt==0) nt=1;
+
+  /* Break the pattern into its components. */
+  if( (copy=malloc(strlen(pattern)+1))==NULL )
+    return GLOB_NOSPACE;
+  strcpy(copy, pattern);
+  if( (w.comps=malloc((strlen(pattern)/2+1)*sizeof *w.comps))==NULL )
+    {
+      free(copy);
+      return GLOB_NOSPACE;
+    }
+  for(c=strtok(copy, "/");c;c=strtok(NULL, "/"))
+    w.comps[w.ncomps++]=c;
+  if(w.ncomps==0)
+    {
+      free(w.comps);
+      free(copy);
+      return GLOB_NOMATCH;
+    }
+
+  /* The lists and the first directory. */
+  w.dirssize=w.namessize=WALKQUEUE;
+  w.dirs=malloc(w.dirssize*sizeof *w.dirs);
+  w.names=malloc(w.namessize*sizeof *w.names);
+  w.dirs[0].path=malloc(2);
+  if(w.dirs==NULL || w.names==NULL || w.dirs[0].path==NULL)
+    {
+      if(w.dirs) free(w.dirs[0].path);
+      free(w.dirs); free(w.names); free(w.comps); free(copy);
+      return GLOB_NOSPACE;
+    }
+  strcpy(w.dirs[0].path, pattern[0]=='/' ? "/" : "");
+  w.dirs[0].comp=0;
+  w.ndirs=1;
+  w.found=found;
+  w.arg=arg;
+
+  /* Spin off the threads and wait for them to finish. */
+  pthread_attr_init(&attr);
+  pthread_mutex_init(&w.m, NULL);
+  pthread_cond_init(&w.c, NULL);
+  pthread_attr_setdetachstate(&attr, PTHREAD_CREATE_DETACHED);
+  for(numactive=i=0;i<nt;++i)
+    if(pthread_create(&t, &attr, walkthread, &w)==0)
+      ++numactive;
+  if(numactive==0) walkthread(&w);
+  pthread_mutex_lock(&w.m);
+  while(w.done<(numactive ? numactive : 1))
+    pthread_cond_wait(&w.c, &w.m);
+  pthread_mutex_unlock(&w.m);
+  pthread_attr_destroy(&attr);
+  pthread_mutex_destroy(&w.m);
+  pthread_cond_destroy(&w.c);
+  free(w.dirs);
+  free(w.comps);
+  free(copy);
+
+  /* Put the names in order, like glob(). */
+  if(w.nospace==0 && w.nnames
+     && ( (g->gl_pathv=malloc((w.nnames+1)*sizeof *g->gl_pathv))==NULL
+	  || (ids && (*ids=malloc(w.nnames*sizeof **ids))==NULL) ) )
+    w.nospace=1;
+  if(w.nospace || w.nnames==0)
+    {
+      for(i=0;i<w.nnames;++i) free(w.names[i].name);
+      free(w.names);
+      free(g->gl_pathv);
+      g->gl_pathv=NULL;
+      return w.nospace ? GLOB_NOSPACE : GLOB_NOMATCH;
+    }
+  qsort(w.names, w.nnames, sizeof *w.names, walkcomparenames);
+  for(i=0;i<w.nnames;++i)
+    {
+      g->gl_pathv[i]=w.names[i].name;
+      if(ids) (*ids)[i]=w.names[i].id;
+    }
+  g->gl_pathv[w.nnames]=NULL;
+  g->gl_pathc=w.nnames;
+  free(w.names);
+  return 0;
+}
+
+
+
+
+
+void
+walkfree(glob_t *g)
+{
+  size_t i;
+
+  for(i=0;i<g->gl_pathc;++i)
+    free(g->gl_pathv[i]);
+  free(g->gl_pathv);
+  g->gl_pathc=0;
+  g->gl_pathv=NULL;
+}
@@ -0,0 +1,75 @@
+/*********************************************************************
+tifaa - Thumbnail images from astronomical archives
+A simple set of functions to crop thumbnails from astronomical archives.
+
+Copyright (C) 2013-2014 Mohammad Akhlaghi
+Tohoku University Astronomical Institute, Sendai, Japan.
+http://astr.tohoku.ac.jp/~akhlaghi/
+
+tifaa is free software: you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation, either version 3 of the License, or
+(at your option) any later version.
+
+tifaa is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with tifaa.  If not, see <http://www.gnu.org/licenses/>.
+**********************************************************************/
+#ifndef WALKER_H
+#define WALKER_H
+
+#include <glob.h>
+#include <pthread.h>
+
+#define WALKQUEUE         1024  /* Initial size of the walker's lists. */
+
+/* Called (on one of the walker's threads) for each file as soon as it
+   is found. `id` counts the files in the order they were found. */
+typedef void (*walkfound)(char *name, size_t id, void *arg);
+
+/* A directory that is still to be read: the files (or directories)
+   in `path` that match component `comp` of the pattern. */
+struct walkdir
+{
+  char           *path;  /* Directory ("" for the current one).        */
+  size_t          comp;  /* Pattern component to match in it.          */
+};
+
+/* One file that was found. */
+struct walkname
+{
+  char           *name;  /* Name of the file (as glob() gives it).     */
+  size_t            id;  /* Order it was found in (from 0).            */
+};
+
+struct walker
+{
+  char         **comps;  /* Components of the pattern (between `/`).   */
+  size_t        ncomps;  /* Number of components.                      */
+  struct walkdir *dirs;  /* Directories to read (a stack).             */
+  size_t         ndirs;  /* Number of directories in `dirs`.           */
+  size_t      dirssize;  /* Allocated elements in `dirs`.              */
+  size_t          busy;  /* Threads that are reading a directory.      */
+  struct walkname *names; /* The files that were found.                */
+  size_t        nnames;  /* Number of files found.                     */
+  size_t     namessize;  /* Allocated elements in `names`.             */
+  int          nospace;  /* ==1: There wasn't enough memory.           */
+  size_t          done;  /* Number of finished threads.                */
+  walkfound      found;  /* If !=NULL, called for each file.           */
+  void            *arg;  /* Passed to `found`.                         */
+  pthread_mutex_t    m;  /* Mutex for everything above.                */
+  pthread_cond_t     c;  /* Signaled when a directory is added/done.   */
+};
+
+int
+walkglob(char *pattern, size_t nt, walkfound found, void *arg, glob_t *g,
+	 size_t **ids);
+
+void
+walkfree(glob_t *g);
+
+#endif
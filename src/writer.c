@@ -0,0 +1,159 @@
+/*********************************************************************
+tifaa - Thumbnail images from astronomical archives
+A simple set of functions to crop thumbnails from astronomical archives.
+
+Copyright (C) 2013-2014 Mohammad Akhlaghi
+Tohoku University Astronomical Institute, Sendai, Japan.
+http://astr.tohoku.ac.jp/~akhlaghi/
+
+tifaa is free software: you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation, either version 3 of the License, or
+(at your option) any later version.
+
+tifaa is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with tifaa.  If not, see <http://www.gnu.org/licenses/>.
+**********************************************************************/
+#include <errno.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <assert.h>
+#include <pthread.h>
+
+#include "writer.h"
+
+
+
+
+/* The stream couldn't be written (for example a pipe whose reader
+   has gone: EPIPE, SIGPIPE is ignored in ui.c). Nothing that comes
+   after would be read, so stop. */
+void
+writererror(void)
+{
+  printf("\nError: The output couldn't be written (%s). TIFAA "
+	 "aborted.\n\n", strerror(errno));
+  exit(EXIT_FAILURE);
+}
+
+
+
+
+
+/* The writing thread: Take the items off the queue in order and write
+   them. The stream is only flushed when there is nothing left to
+   write, so when the crop threads are faster than the disk, many
+   items go out in one write and when they are slower, everything is
+   on disk as soon as it is finished. */
+void *
+writerthread(void *inparam)
+{
+  struct writer *w=(struct writer *)inparam;
+  struct writeritem *item;
+
+  pthread_mutex_lock(&w->m);
+  while(1)
+    {
+      if(w->head==NULL)
+	{
+	  if(w->finish) break;
+	  pthread_mutex_unlock(&w->m);
+	  if(fflush(w->fp)) writererror();
+	  pthread_mutex_lock(&w->m);
+	  while(w->head==NULL && w->finish==0)
+	    pthread_cond_wait(&w->c, &w->m);
+	  continue;
+	}
+
+      /* Take the first item off the queue, write it without holding
+	 the mutex so the other threads can continue pushing. */
+      item=w->head;
+      w->head=item->next;
+      if(w->head==NULL) w->tail=NULL;
+      w->bytes-=item->len;
+      pthread_cond_broadcast(&w->space);
+      pthread_mutex_unlock(&w->m);
+
+      if(fwrite(item->buf, 1, item->len, w->fp)!=item->len)
+	writererror();
+      free(item->buf);
+      free(item);
+
+      pthread_mutex_lock(&w->m);
+    }
+  pthread_mutex_unlock(&w->m);
+
+  if(fflush(w->fp)) writererror();
+  return NULL;
+}
+
+
+
+
+
+void
+writerstart(struct writer *w, FILE *fp)
+{
+  w->fp=fp;
+  w->bytes=0;
+  w->finish=0;
+  w->head=w->tail=NULL;
+  pthread_cond_init(&w->c, NULL);
+  pthread_cond_init(&w->space, NULL);
+  pthread_mutex_init(&w->m, NULL);
+  assert( pthread_create(&w->t, NULL, writerthread, w)==0 );
+}
+
+
+
+
+
+/* Add `buf` to the end of the queue. The writer will free it. If the
+   queue already has WRITERMAXBYTES bytes, wait until some of them are
+   written (an empty queue takes an item of any size). */
+void
+writerpush(struct writer *w, char *buf, size_t len)
+{
+  struct writeritem *item;
+
+  assert( (item=malloc(sizeof *item))!=NULL );
+  item->buf=buf;
+  item->len=len;
+  item->next=NULL;
+
+  pthread_mutex_lock(&w->m);
+  while(w->bytes && w->bytes+len>WRITERMAXBYTES)
+    pthread_cond_wait(&w->space, &w->m);
+  w->bytes+=len;
+  if(w->tail) w->tail->next=item;
+  else        w->head=item;
+  w->tail=item;
+  pthread_cond_signal(&w->c);
+  pthread_mutex_unlock(&w->m);
+}
+
+
+
+
+
+/* Wait until everything in the queue has been written. The stream is
+   not closed, that is the job of whoever opened it. */
+void
+writerfinish(struct writer *w)
+{
+  pthread_mutex_lock(&w->m);
+  w->finish=1;
+  pthread_cond_signal(&w->c);
+  pthread_mutex_unlock(&w->m);
+
+  pthread_join(w->t, NULL);
+  pthread_cond_destroy(&w->c);
+  pthread_cond_destroy(&w->space);
+  pthread_mutex_destroy(&w->m);
+}
@@ -0,0 +1,66 @@
+/*********************************************************************
+tifaa - Thumbnail images from astronomical archives
+A simple set of functions to crop thumbnails from astronomical archives.
+
+Copyright (C) 2013-2014 Mohammad Akhlaghi
+Tohoku University Astronomical Institute, Sendai, Japan.
+http://astr.tohoku.ac.jp/~akhlaghi/
+
+tifaa is free software: you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation, either version 3 of the License, or
+(at your option) any later version.
+
+tifaa is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with tifaa.  If not, see <http://www.gnu.org/licenses/>.
+**********************************************************************/
+#ifndef WRITER_H
+#define WRITER_H
+
+#include <stdio.h>
+#include <pthread.h>
+
+#define WRITERMAXBYTES    67108864 /* Queue size that blocks (64MB). */
+
+/* One element in the queue of the writer. `buf` is allocated by the
+   thread that pushes it and is freed by the writer once written. */
+struct writeritem
+{
+  char                 *buf; /* Bytes to write.                       */
+  size_t                len; /* Number of bytes in buf.               */
+  struct writeritem   *next; /* Next item in the queue.               */
+};
+
+/* A dedicated thread that writes everything that is pushed to it
+   into one stream, in the order they were pushed. The crop threads
+   don't have to wait for the disk (or each other) to save their
+   results, unless the queue already has WRITERMAXBYTES bytes (when
+   the reader of a pipe is slower than the crop threads). */
+struct writer
+{
+  FILE                  *fp; /* Stream to write into.                 */
+  int                finish; /* ==1: No more items will come.         */
+  struct writeritem   *head; /* First item to write.                  */
+  struct writeritem   *tail; /* Last item to write.                   */
+  size_t              bytes; /* Bytes of all the items in the queue.  */
+  pthread_t               t; /* The writing thread.                   */
+  pthread_mutex_t         m; /* Mutex for the queue.                  */
+  pthread_cond_t          c; /* Signal new items or finishing.        */
+  pthread_cond_t      space; /* Signal that items were written.       */
+};
+
+void
+writerstart(struct writer *w, FILE *fp);
+
+void
+writerpush(struct writer *w, char *buf, size_t len);
+
+void
+writerfinish(struct writer *w);
+
+#endif